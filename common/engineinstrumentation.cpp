@@ -0,0 +1,214 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+#include "engineinstrumentation.hpp"
+#include <ql/errors.hpp>
+#include <boost/atomic.hpp>
+#include <cstdlib>
+#include <new>
+#include <ostream>
+
+#if defined(QL_ENABLE_ENGINE_INSTRUMENTATION)
+
+namespace {
+
+    boost::atomic<unsigned long> allocations(0);
+    boost::atomic<long> heapInUse(0), heapPeak(0);
+
+    // the size is kept in a header aligned for any type, so that
+    // deallocations can be subtracted from the heap in use
+    const std::size_t heapHeader = 16;
+
+    void* countedAllocation(std::size_t size) {
+        allocations.fetch_add(1, boost::memory_order_relaxed);
+        char* p = static_cast<char*>(std::malloc(size + heapHeader));
+        if (!p)
+            return 0;
+        *reinterpret_cast<std::size_t*>(p) = size;
+        long inUse = heapInUse.fetch_add(long(size)) + long(size);
+        long peak = heapPeak.load();
+        while (inUse > peak && !heapPeak.compare_exchange_weak(peak, inUse))
+            ;
+        return p + heapHeader;
+    }
+
+    void countedDeallocation(void* p) {
+        if (!p)
+            return;
+        char* block = static_cast<char*>(p) - heapHeader;
+        heapInUse.fetch_sub(long(*reinterpret_cast<std::size_t*>(block)));
+        std::free(block);
+    }
+
+}
+
+void* operator new(std::size_t size) {
+    void* p = countedAllocation(size);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](std::size_t size) {
+    void* p = countedAllocation(size);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) throw() {
+    return countedAllocation(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) throw() {
+    return countedAllocation(size);
+}
+
+void operator delete(void* p) throw() {
+    countedDeallocation(p);
+}
+
+void operator delete[](void* p) throw() {
+    countedDeallocation(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) throw() {
+    countedDeallocation(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) throw() {
+    countedDeallocation(p);
+}
+
+#endif
+
+namespace QuantLib {
+
+    unsigned long engineAllocationCount() {
+        #if defined(QL_ENABLE_ENGINE_INSTRUMENTATION)
+        return allocations.load(boost::memory_order_relaxed);
+        #else
+        return 0;
+        #endif
+    }
+
+    long engineHeapInUse() {
+        #if defined(QL_ENABLE_ENGINE_INSTRUMENTATION)
+        return heapInUse.load();
+        #else
+        return 0;
+        #endif
+    }
+
+    long engineHeapPeak() {
+        #if defined(QL_ENABLE_ENGINE_INSTRUMENTATION)
+        return heapPeak.load();
+        #else
+        return 0;
+        #endif
+    }
+
+    void resetEngineHeapPeak() {
+        #if defined(QL_ENABLE_ENGINE_INSTRUMENTATION)
+        heapPeak.store(heapInUse.load());
+        #endif
+    }
+
+
+    EngineInstrumentation::EngineInstrumentation()
+    : current_(0), currentTimer_(0), allocations_(0) {}
+
+    void EngineInstrumentation::start() {
+        timers_.clear();
+        counters_.clear();
+        current_ = 0;
+        currentTimer_ = 0;
+        allocations_ = engineAllocationCount();
+        mark_ = clock::now();
+    }
+
+    void EngineInstrumentation::phase(const char* name) {
+        clock::time_point now = clock::now();
+        if (currentTimer_ != 0)
+            *currentTimer_ +=
+                boost::chrono::duration<double>(now - mark_).count();
+        mark_ = now;
+        // the map is only searched when the phase changes
+        if (name != current_) {
+            current_ = name;
+            currentTimer_ = (name != 0 ? &timers_[name] : 0);
+        }
+    }
+
+    void EngineInstrumentation::count(const char* name, Real n) {
+        counters_[name] += n;
+    }
+
+    void EngineInstrumentation::time(const char* name, double seconds) {
+        timers_[name] += seconds;
+    }
+
+    void EngineInstrumentation::finish() {
+        phase(0);
+        counters_["allocations"] +=
+            Real(engineAllocationCount() - allocations_);
+    }
+
+    void EngineInstrumentation::publish(
+                      std::map<std::string, boost::any>& results) const {
+        for (std::map<std::string, double>::const_iterator i =
+                 timers_.begin(); i != timers_.end(); ++i)
+            results["instrumentation." + i->first] = Real(i->second);
+        for (std::map<std::string, Real>::const_iterator i =
+                 counters_.begin(); i != counters_.end(); ++i)
+            results["instrumentation." + i->first] = i->second;
+    }
+
+
+    void EngineStatistics::add(
+                        const std::string& engine,
+                        const EngineInstrumentation& instrumentation) {
+        boost::mutex::scoped_lock lock(mutex_);
+        totals_[engine + ".calculations"] += 1.0;
+        for (std::map<std::string, double>::const_iterator i =
+                 instrumentation.timers().begin();
+             i != instrumentation.timers().end(); ++i)
+            totals_[engine + "." + i->first] += i->second;
+        for (std::map<std::string, Real>::const_iterator i =
+                 instrumentation.counters().begin();
+             i != instrumentation.counters().end(); ++i)
+            totals_[engine + "." + i->first] += i->second;
+    }
+
+    std::map<std::string, Real> EngineStatistics::totals() const {
+        boost::mutex::scoped_lock lock(mutex_);
+        return totals_;
+    }
+
+    void EngineStatistics::write(std::ostream& out) const {
+        std::map<std::string, Real> totals = this->totals();
+        for (std::map<std::string, Real>::const_iterator i = totals.begin();
+             i != totals.end(); ++i)
+            out << i->first << " " << i->second << "\n";
+    }
+
+    void EngineStatistics::reset() {
+        boost::mutex::scoped_lock lock(mutex_);
+        totals_.clear();
+    }
+
+}
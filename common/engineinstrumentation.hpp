@@ -0,0 +1,167 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file engineinstrumentation.hpp
+    \brief Opt-in timers and counters for pricing engines
+
+    Instrumentation is compiled in only when
+    QL_ENABLE_ENGINE_INSTRUMENTATION is defined; otherwise the
+    QL_ENGINE_* macros expand to nothing and the engines carry no
+    instrumentation state.  When enabled, engineinstrumentation.cpp
+    must be linked in; it also replaces the global operator new in
+    order to count heap allocations and track the heap in use.
+
+    The header lives outside the project folders, since engines in
+    several of them are instrumented.
+*/
+
+#ifndef engine_instrumentation_hpp
+#define engine_instrumentation_hpp
+
+#include <ql/patterns/singleton.hpp>
+#include <ql/types.hpp>
+#include <boost/any.hpp>
+#include <boost/chrono.hpp>
+#include <boost/thread/mutex.hpp>
+#include <iosfwd>
+#include <map>
+#include <string>
+
+namespace QuantLib {
+
+    //! Timers and counters of a single engine calculation
+    /*! Time is split into consecutive phases: each call to phase()
+        closes the current one and charges the elapsed wall-clock
+        time to it.  Counters are plain sums.
+    */
+    class EngineInstrumentation {
+      public:
+        EngineInstrumentation();
+        //! clears the previous calculation and starts the clock
+        void start();
+        //! switches to the given phase
+        void phase(const char* name);
+        //! adds to the given counter
+        void count(const char* name, Real n);
+        //! adds time measured elsewhere to the given timer
+        void time(const char* name, double seconds);
+        //! closes the current phase and counts the heap allocations
+        void finish();
+        const std::map<std::string, double>& timers() const {
+            return timers_;
+        }
+        const std::map<std::string, Real>& counters() const {
+            return counters_;
+        }
+        /*! writes the timers, in seconds, and the counters to the
+            given additional results, prefixed by "instrumentation."
+        */
+        void publish(std::map<std::string, boost::any>& results) const;
+      private:
+        typedef boost::chrono::steady_clock clock;
+        std::map<std::string, double> timers_;
+        std::map<std::string, Real> counters_;
+        const char* current_;
+        double* currentTimer_;
+        clock::time_point mark_;
+        unsigned long allocations_;
+    };
+
+
+    //! Process-wide aggregate of the instrumented calculations
+    /*! Totals are kept per engine name and can be scraped as lines
+        of the form "<engine>.<timer or counter> <value>".
+    */
+    class EngineStatistics : public Singleton<EngineStatistics> {
+        friend class Singleton<EngineStatistics>;
+      public:
+        void add(const std::string& engine,
+                 const EngineInstrumentation& instrumentation);
+        std::map<std::string, Real> totals() const;
+        void write(std::ostream& out) const;
+        void reset();
+      private:
+        EngineStatistics() {}
+        mutable boost::mutex mutex_;
+        std::map<std::string, Real> totals_;
+    };
+
+
+    //! Number of calls to operator new since the start of the process
+    /*! Returns 0 unless QL_ENABLE_ENGINE_INSTRUMENTATION is defined.
+        The count includes allocations made by other threads.
+    */
+    unsigned long engineAllocationCount();
+
+    //! Bytes currently allocated through operator new
+    /*! Returns 0 unless QL_ENABLE_ENGINE_INSTRUMENTATION is defined.
+        Allocations made by other threads are included.
+    */
+    long engineHeapInUse();
+
+    //! Largest heap in use since the last resetEngineHeapPeak() call
+    /*! Returns 0 unless QL_ENABLE_ENGINE_INSTRUMENTATION is defined. */
+    long engineHeapPeak();
+
+    //! Restarts the peak from the heap currently in use
+    void resetEngineHeapPeak();
+
+
+    //! Tree wrapper counting the calls to underlying()
+    /*! For the trees in this library, each call costs one exp or a
+        couple of pow evaluations.
+    */
+    template <class T>
+    class InstrumentedTree : public T {
+      public:
+        template <class P>
+        InstrumentedTree(const P& process, Time end, Size steps,
+                         Real strike)
+        : T(process, end, steps, strike), calls_(0) {}
+        Real underlying(Size i, Size index) const {
+            ++calls_;
+            return T::underlying(i, index);
+        }
+        Size calls() const { return calls_; }
+      private:
+        mutable Size calls_;
+    };
+
+}
+
+
+#if defined(QL_ENABLE_ENGINE_INSTRUMENTATION)
+    #define QL_ENGINE_START(instrumentation) (instrumentation).start()
+    #define QL_ENGINE_PHASE(instrumentation, name) \
+        (instrumentation).phase(name)
+    #define QL_ENGINE_COUNT(instrumentation, name, n) \
+        (instrumentation).count(name, n)
+    #define QL_ENGINE_FINISH(instrumentation, engine, results) \
+        do { \
+            (instrumentation).finish(); \
+            (instrumentation).publish(results); \
+            EngineStatistics::instance().add(engine, instrumentation); \
+        } while (0)
+#else
+    #define QL_ENGINE_START(instrumentation)
+    #define QL_ENGINE_PHASE(instrumentation, name)
+    #define QL_ENGINE_COUNT(instrumentation, name, n)
+    #define QL_ENGINE_FINISH(instrumentation, engine, results)
+#endif
+
+
+#endif
@@ -0,0 +1,82 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file pricingmonitor.hpp
+    \brief Progress reports and cancellation of long calculations
+*/
+
+#ifndef pricing_monitor_hpp
+#define pricing_monitor_hpp
+
+#include <ql/types.hpp>
+#include <boost/shared_ptr.hpp>
+#include <stdexcept>
+
+namespace QuantLib {
+
+    //! Observer of a running calculation
+    /*! Engines deriving from MonitoredEngine report their progress
+        in units of their own (e.g., paths) and poll cancelled(); when
+        it returns true, they stop by throwing PricingCancelled.
+        Both methods are called on the thread running the engine.
+    */
+    class PricingMonitor {
+      public:
+        virtual ~PricingMonitor() {}
+        /*! total is Null<Size>() if not known in advance, e.g., for
+            a simulation run to a given tolerance.
+        */
+        virtual void progress(Size done, Size total) = 0;
+        virtual bool cancelled() const = 0;
+    };
+
+
+    //! Exception thrown by an engine whose calculation was cancelled
+    class PricingCancelled : public std::runtime_error {
+      public:
+        PricingCancelled() : std::runtime_error("pricing cancelled") {}
+    };
+
+
+    //! Engine accepting a PricingMonitor
+    class MonitoredEngine {
+      public:
+        virtual ~MonitoredEngine() {}
+        /*! the monitor is used by the following calculations; a null
+            pointer removes it.
+        */
+        void setMonitor(const boost::shared_ptr<PricingMonitor>& monitor) {
+            monitor_ = monitor;
+        }
+      protected:
+        /*! tells the monitor, if any, of the progress and throws
+            PricingCancelled if it asks to stop.
+        */
+        void checkpoint(Size done, Size total) const {
+            if (monitor_) {
+                monitor_->progress(done, total);
+                if (monitor_->cancelled())
+                    throw PricingCancelled();
+            }
+        }
+        boost::shared_ptr<PricingMonitor> monitor_;
+    };
+
+}
+
+
+#endif
@@ -1,3 +1,79 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
 
 #include "constantblackscholesprocess.hpp"
+#include <ql/settings.hpp>
+
+namespace QuantLib {
+
+    ConstantBlackScholesProcess::ConstantBlackScholesProcess(
+                                                Real underlying,
+                                                Rate riskFreeRate,
+                                                Rate dividendYield,
+                                                Volatility volatility,
+                                                const DayCounter& dayCounter)
+    : underlying_(underlying), riskFreeRate_(riskFreeRate),
+      dividendYield_(dividendYield), volatility_(volatility),
+      dayCounter_(dayCounter) {
+        QL_REQUIRE(underlying > 0.0,
+                   "positive underlying required, " << underlying
+                   << " given");
+        QL_REQUIRE(volatility >= 0.0,
+                   "negative volatility (" << volatility << ") given");
+    }
+
+    Real ConstantBlackScholesProcess::x0() const {
+        return underlying_;
+    }
+
+    Real ConstantBlackScholesProcess::drift(Time, Real) const {
+        return riskFreeRate_ - dividendYield_ - 0.5*volatility_*volatility_;
+    }
+
+    Real ConstantBlackScholesProcess::diffusion(Time, Real) const {
+        return volatility_;
+    }
+
+    Real ConstantBlackScholesProcess::apply(Real x0, Real dx) const {
+        return x0 * std::exp(dx);
+    }
+
+    Real ConstantBlackScholesProcess::expectation(Time, Real x0,
+                                                  Time dt) const {
+        return x0 * std::exp((riskFreeRate_ - dividendYield_)*dt);
+    }
+
+    Real ConstantBlackScholesProcess::stdDeviation(Time, Real,
+                                                   Time dt) const {
+        return volatility_*std::sqrt(dt);
+    }
+
+    Real ConstantBlackScholesProcess::variance(Time, Real, Time dt) const {
+        return volatility_*volatility_*dt;
+    }
+
+    Real ConstantBlackScholesProcess::evolve(Time t0, Real x0, Time dt,
+                                             Real dw) const {
+        return apply(x0, drift(t0, x0)*dt + stdDeviation(t0, x0, dt)*dw);
+    }
+
+    Time ConstantBlackScholesProcess::time(const Date& d) const {
+        return dayCounter_.yearFraction(
+                               Settings::instance().evaluationDate(), d);
+    }
 
+}
@@ -1,13 +1,79 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file constantblackscholesprocess.hpp
+    \brief Black-Scholes process with constant parameters
+*/
+
+#ifndef constant_black_scholes_process_hpp
+#define constant_black_scholes_process_hpp
 
 #include <ql/stochasticprocess.hpp>
+#include <ql/time/daycounters/actual365fixed.hpp>
 
 namespace QuantLib {
 
-    class ConstantBlackScholesProcess : public StochasticProcess1D {
+    //! Black-Scholes process with constant rates and volatility
+    /*! The process follows
+        \f[
+            dS(t, S) = (r - q) S dt + \sigma S dW_t
+        \f]
+        with constant \f$ r \f$, \f$ q \f$ and \f$ \sigma \f$; as in
+        GeneralizedBlackScholesProcess, drift and diffusion refer to
+        \f$ \log S \f$, and evolve() is exact for any time step.
 
-        // your implementation goes here
-        
+        Dates are converted to times from the evaluation date with
+        the given day counter.
+    */
+    class ConstantBlackScholesProcess : public StochasticProcess1D {
+      public:
+        ConstantBlackScholesProcess(
+                            Real underlying,
+                            Rate riskFreeRate,
+                            Rate dividendYield,
+                            Volatility volatility,
+                            const DayCounter& dayCounter = Actual365Fixed());
+        //! \name StochasticProcess1D interface
+        //@{
+        Real x0() const;
+        Real drift(Time t, Real x) const;
+        Real diffusion(Time t, Real x) const;
+        Real apply(Real x0, Real dx) const;
+        Real expectation(Time t0, Real x0, Time dt) const;
+        Real stdDeviation(Time t0, Real x0, Time dt) const;
+        Real variance(Time t0, Real x0, Time dt) const;
+        Real evolve(Time t0, Real x0, Time dt, Real dw) const;
+        Time time(const Date& d) const;
+        //@}
+        //! \name Inspectors
+        //@{
+        Rate riskFreeRate() const { return riskFreeRate_; }
+        Rate dividendYield() const { return dividendYield_; }
+        Volatility volatility() const { return volatility_; }
+        const DayCounter& dayCounter() const { return dayCounter_; }
+        //@}
+      private:
+        Real underlying_;
+        Rate riskFreeRate_, dividendYield_;
+        Volatility volatility_;
+        DayCounter dayCounter_;
     };
 
 }
 
+
+#endif
@@ -0,0 +1,701 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file mcamericanengine.hpp
+    \brief Parallel Longstaff-Schwartz engine for American options
+*/
+
+#ifndef montecarlo_american_engine_2_hpp
+#define montecarlo_american_engine_2_hpp
+
+#include <ql/instruments/vanillaoption.hpp>
+#include <ql/math/randomnumbers/rngtraits.hpp>
+#include <ql/math/randomnumbers/seedgenerator.hpp>
+#include <ql/processes/blackscholesprocess.hpp>
+#include "mcblockseed.hpp"
+#include "mcblockstatistics.hpp"
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/barrier.hpp>
+#include <vector>
+
+namespace QuantLib {
+
+    //! American option pricing engine using Longstaff-Schwartz
+    /*! \ingroup vanillaengines
+
+        The engine simulates the underlying on a regular time grid of
+        log-normal steps built from the term structures of the
+        process (with the Black variance at the strike), so that no
+        discretization error is added.  Exercise is allowed at every
+        step on or after the earliest exercise date.
+
+        Calibration paths are kept as a steps-times-paths matrix, so
+        that the values at one date are contiguous.  The backward
+        induction regresses the discounted cash flows of the
+        in-the-money paths on the monomials of \f$ S/K \f$ up to the
+        given order; the normal equations are accumulated per block
+        of paths, summed in block order and solved by Cholesky
+        decomposition.  Blocks are shared among threads which
+        synchronize once per date, and the result doesn't depend on
+        the number of threads.  The option is then priced on
+        independent paths, exercising where the intrinsic value
+        exceeds the regressed continuation value.
+
+        The random numbers of each segment of about \f$ \sqrt{n} \f$
+        steps are drawn path by path; with PhiloxRandom, each path
+        draws them from its index, and with other policies each block
+        of paths has its own generator, seeded from the engine seed.
+        When path
+        regeneration is enabled, the calibration keeps only the
+        values at the start of the segments and regenerates each
+        segment when the induction reaches it; this reduces the path
+        memory from \f$ n \f$ to about \f$ 2\sqrt{n} \f$ values per
+        path at the cost of generating the paths twice, and gives the
+        same result.
+
+        A first path, multiple of the block size, can be given for
+        the pricing paths, in which case the pricing runs the blocks
+        from that path on; the calibration is the same for any first
+        path.  As in MCBasketEngine_2, a pricing split in ranges of
+        paths gives the same results as the sequential run when the
+        "blockStatistics" additional results of the ranges are
+        appended in path order.
+
+        The numbers of paths are rounded up to whole blocks of 256.
+        The path memory in bytes is returned as the "pathMemory"
+        additional result.
+
+        \warning RNG must be PseudoRandom or PhiloxRandom, since the
+                 sequences of different blocks are independent.
+    */
+    template <class RNG = PseudoRandom>
+    class MCAmericanEngine_2 : public VanillaOption::engine {
+      public:
+        typedef typename RNG::rsg_type rsg_type;
+        enum { blockSize = 256 };
+        /*! If no number of threads is given, the available hardware
+            concurrency is used.
+        */
+        MCAmericanEngine_2(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             Size timeSteps,
+             Size timeStepsPerYear,
+             bool antitheticVariate,
+             Size calibrationSamples,
+             Size requiredSamples,
+             BigNatural seed,
+             Size polynomialOrder = 2,
+             bool regeneratePaths = false,
+             Size threads = 0,
+             BigNatural firstPath = 0);
+        void calculate() const;
+      private:
+        class Calibration;
+        class Pricing;
+        void generate(BigNatural seed, Size phase, Size block, Size segment,
+                      const Real* start, Size startStride,
+                      Real* values, Size stride) const;
+        Real continuation(Size step, Real underlying) const;
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process_;
+        Size timeSteps_, timeStepsPerYear_;
+        bool antithetic_;
+        Size calibrationSamples_, requiredSamples_;
+        BigNatural seed_;
+        Size basisSize_;
+        bool regenerate_;
+        Size threads_;
+        BigNatural firstPath_;
+        // calculation data
+        mutable boost::shared_ptr<PlainVanillaPayoff> payoff_;
+        mutable Size steps_, segmentLength_, segments_, firstExercise_;
+        mutable Real underlying_;
+        mutable std::vector<Real> drift_, stdDev_, discount_;
+        // regression coefficients by step; empty where no exercise
+        mutable std::vector<std::vector<Real> > coefficients_;
+    };
+
+
+    //! Monte Carlo Longstaff-Schwartz engine factory
+    template <class RNG = PseudoRandom>
+    class MakeMCAmericanEngine_2 {
+      public:
+        MakeMCAmericanEngine_2(
+                    const boost::shared_ptr<GeneralizedBlackScholesProcess>&);
+        // named parameters
+        MakeMCAmericanEngine_2& withSteps(Size steps);
+        MakeMCAmericanEngine_2& withStepsPerYear(Size steps);
+        MakeMCAmericanEngine_2& withSamples(Size samples);
+        MakeMCAmericanEngine_2& withCalibrationSamples(Size samples);
+        MakeMCAmericanEngine_2& withSeed(BigNatural seed);
+        MakeMCAmericanEngine_2& withAntitheticVariate(bool b = true);
+        MakeMCAmericanEngine_2& withPolynomialOrder(Size order);
+        MakeMCAmericanEngine_2& withPathRegeneration(bool b = true);
+        MakeMCAmericanEngine_2& withThreads(Size threads);
+        MakeMCAmericanEngine_2& withFirstPath(BigNatural path);
+        // conversion to pricing engine
+        operator boost::shared_ptr<PricingEngine>() const;
+      private:
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process_;
+        bool antithetic_, regenerate_;
+        Size steps_, stepsPerYear_, samples_, calibrationSamples_;
+        Size polynomialOrder_, threads_;
+        BigNatural seed_, firstPath_;
+    };
+
+
+    // inline definitions
+
+    template <class RNG>
+    inline MCAmericanEngine_2<RNG>::MCAmericanEngine_2(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             Size timeSteps,
+             Size timeStepsPerYear,
+             bool antitheticVariate,
+             Size calibrationSamples,
+             Size requiredSamples,
+             BigNatural seed,
+             Size polynomialOrder,
+             bool regeneratePaths,
+             Size threads,
+             BigNatural firstPath)
+    : process_(process), timeSteps_(timeSteps),
+      timeStepsPerYear_(timeStepsPerYear), antithetic_(antitheticVariate),
+      calibrationSamples_(calibrationSamples),
+      requiredSamples_(requiredSamples), seed_(seed),
+      basisSize_(polynomialOrder+1), regenerate_(regeneratePaths),
+      threads_(threads), firstPath_(firstPath) {
+        QL_REQUIRE(timeSteps != Null<Size>() ||
+                   timeStepsPerYear != Null<Size>(),
+                   "no time steps provided");
+        QL_REQUIRE(timeSteps == Null<Size>() ||
+                   timeStepsPerYear == Null<Size>(),
+                   "both time steps and time steps per year were provided");
+        QL_REQUIRE(timeSteps != 0,
+                   "timeSteps must be positive, " << timeSteps <<
+                   " not allowed");
+        QL_REQUIRE(timeStepsPerYear != 0,
+                   "timeStepsPerYear must be positive, "
+                   << timeStepsPerYear << " not allowed");
+        QL_REQUIRE(calibrationSamples > 0,
+                   "positive number of calibration samples required");
+        QL_REQUIRE(requiredSamples != Null<Size>() && requiredSamples > 0,
+                   "positive number of samples required");
+        QL_REQUIRE(polynomialOrder >= 1 && polynomialOrder <= 6,
+                   "polynomial order must be between 1 and 6, "
+                   << polynomialOrder << " given");
+        QL_REQUIRE(firstPath % blockSize == 0,
+                   "first path (" << firstPath << ") is not a multiple "
+                   "of the block size (" << Size(blockSize) << ")");
+        if (seed_ == 0)
+            seed_ = SeedGenerator::instance().get();
+        if (threads_ == 0)
+            threads_ = std::max<Size>(boost::thread::hardware_concurrency(),
+                                      1);
+        registerWith(process_);
+    }
+
+    /* Generates the steps of the given segment for the paths of a
+       block.  start points to the values at the beginning of the
+       segment; the values after each step are written to rows of
+       the given stride. */
+    template <class RNG>
+    inline void MCAmericanEngine_2<RNG>::generate(
+                               BigNatural seed, Size phase, Size block,
+                               Size segment, const Real* start,
+                               Size startStride, Real* values,
+                               Size stride) const {
+        Size first = segment*segmentLength_;
+        Size length = std::min(first+segmentLength_, steps_) - first;
+        rsg_type generator = detail::monteCarloBlockGenerator<RNG>(
+            segmentLength_, seed, phase, block, segment, blockSize);
+        Size draws = (antithetic_ ? blockSize/2 : blockSize);
+        for (Size q=0; q<draws; ++q) {
+            const std::vector<Real>& z = generator.nextSequence().value;
+            for (Size a=0; a<(antithetic_ ? 2 : 1); ++a) {
+                Size p = (antithetic_ ? 2*q+a : q);
+                Real sign = (a == 0 ? 1.0 : -1.0);
+                Real s = start[p*startStride];
+                for (Size j=0; j<length; ++j) {
+                    s *= std::exp(drift_[first+j] +
+                                  sign*stdDev_[first+j]*z[j]);
+                    values[j*stride+p] = s;
+                }
+            }
+        }
+    }
+
+    template <class RNG>
+    inline Real MCAmericanEngine_2<RNG>::continuation(Size step,
+                                                      Real underlying) const {
+        const std::vector<Real>& c = coefficients_[step];
+        Real x = underlying/payoff_->strike(), result = 0.0;
+        for (Size k=c.size(); k>0; --k)
+            result = result*x + c[k-1];
+        return result;
+    }
+
+
+    /* Backward induction on the calibration paths.  Each worker
+       owns a range of blocks; the regression sums of each block are
+       kept in two sets of slots, alternating between dates, so that
+       a single barrier per date separates their writing and their
+       reading. */
+    template <class RNG>
+    class MCAmericanEngine_2<RNG>::Calibration {
+      public:
+        Calibration(const MCAmericanEngine_2<RNG>& engine, Size blocks,
+                    Size workers)
+        : engine_(engine), blocks_(blocks), paths_(blocks*blockSize),
+          workers_(workers), barrier_(workers), values_(paths_),
+          slotSize_(engine.basisSize_*(engine.basisSize_+1)),
+          slots_(2*blocks*slotSize_) {
+            Size n = engine_.steps_;
+            if (engine_.regenerate_) {
+                checkpoints_.resize(engine_.segments_*paths_);
+                buffer_.resize(engine_.segmentLength_*paths_);
+            } else {
+                stored_.resize((n+1)*paths_);
+            }
+        }
+        Size memory() const {
+            return sizeof(Real)*(values_.size() + checkpoints_.size() +
+                                 buffer_.size() + stored_.size());
+        }
+        void operator()(Size worker) {
+            Size b0 = worker*blocks_/workers_,
+                 b1 = (worker+1)*blocks_/workers_;
+            forward(b0, b1);
+            backward(b0, b1, worker == 0);
+        }
+      private:
+        // values at the given step of the paths, with stride 1
+        Real* row(Size step) {
+            if (!engine_.regenerate_)
+                return &stored_[step*paths_];
+            Size segment = (step-1)/engine_.segmentLength_;
+            Size j = step - segment*engine_.segmentLength_ - 1;
+            return &buffer_[j*paths_];
+        }
+        void regenerate(Size b0, Size b1, Size segment) {
+            for (Size b=b0; b<b1; ++b) {
+                Size p0 = b*blockSize;
+                engine_.generate(engine_.seed_, 0, b, segment,
+                                 &checkpoints_[segment*paths_+p0], 1,
+                                 &buffer_[p0], paths_);
+            }
+        }
+        void forward(Size b0, Size b1) {
+            Size n = engine_.steps_, c = engine_.segmentLength_;
+            for (Size b=b0; b<b1; ++b) {
+                Size p0 = b*blockSize;
+                if (!engine_.regenerate_) {
+                    std::fill(&stored_[p0],
+                              &stored_[p0]+blockSize,
+                              engine_.underlying_);
+                    for (Size k=0; k<engine_.segments_; ++k)
+                        engine_.generate(
+                            engine_.seed_, 0, b, k,
+                            &stored_[k*c*paths_+p0], 1,
+                            &stored_[(k*c+1)*paths_+p0], paths_);
+                } else {
+                    std::fill(&checkpoints_[p0],
+                              &checkpoints_[p0]+blockSize,
+                              engine_.underlying_);
+                    for (Size k=0; k<engine_.segments_; ++k) {
+                        regenerate(b, b+1, k);
+                        if (k+1 < engine_.segments_)
+                            std::copy(&buffer_[(c-1)*paths_+p0],
+                                      &buffer_[(c-1)*paths_+p0]+blockSize,
+                                      &checkpoints_[(k+1)*paths_+p0]);
+                    }
+                }
+            }
+            // the buffer now holds the last segment
+            const Real* s = row(n);
+            for (Size p=b0*blockSize; p<b1*blockSize; ++p)
+                values_[p] = engine_.discount_[n]*(*engine_.payoff_)(s[p]);
+        }
+        void backward(Size b0, Size b1, bool store) {
+            Size n = engine_.steps_, c = engine_.segmentLength_;
+            Size m = engine_.basisSize_;
+            const PlainVanillaPayoff& payoff = *engine_.payoff_;
+            Real strike = payoff.strike();
+            std::vector<Real> basis(m), A(m*m), coefficients(m);
+            for (Size i=n-1; i>=engine_.firstExercise_; --i) {
+                if (engine_.regenerate_ && i % c == 0)
+                    regenerate(b0, b1, i/c - 1);
+                const Real* s = row(i);
+                DiscountFactor discount = engine_.discount_[i];
+
+                // normal equations of the block
+                for (Size b=b0; b<b1; ++b) {
+                    Real* sums = &slots_[((i%2)*blocks_+b)*slotSize_];
+                    std::fill(sums, sums+slotSize_, 0.0);
+                    for (Size p=b*blockSize; p<(b+1)*blockSize; ++p) {
+                        if (payoff(s[p]) <= 0.0)
+                            continue;
+                        Real x = s[p]/strike;
+                        basis[0] = 1.0;
+                        for (Size k=1; k<m; ++k)
+                            basis[k] = basis[k-1]*x;
+                        for (Size k=0; k<m; ++k) {
+                            for (Size l=0; l<=k; ++l)
+                                sums[k*m+l] += basis[k]*basis[l];
+                            sums[m*m+k] += basis[k]*values_[p];
+                        }
+                    }
+                }
+                barrier_.wait();
+
+                // every worker solves the same system
+                std::fill(A.begin(), A.end(), 0.0);
+                std::fill(coefficients.begin(), coefficients.end(), 0.0);
+                for (Size b=0; b<blocks_; ++b) {
+                    const Real* sums = &slots_[((i%2)*blocks_+b)*slotSize_];
+                    for (Size k=0; k<m*m; ++k)
+                        A[k] += sums[k];
+                    for (Size k=0; k<m; ++k)
+                        coefficients[k] += sums[m*m+k];
+                }
+                if (!solve(A, coefficients))
+                    continue;
+                if (store)
+                    engine_.coefficients_[i] = coefficients;
+
+                for (Size p=b0*blockSize; p<b1*blockSize; ++p) {
+                    Real exercise = discount*payoff(s[p]);
+                    if (exercise <= 0.0)
+                        continue;
+                    Real x = s[p]/strike, fitted = 0.0;
+                    for (Size k=m; k>0; --k)
+                        fitted = fitted*x + coefficients[k-1];
+                    if (exercise >= fitted)
+                        values_[p] = exercise;
+                }
+                if (i == 1)
+                    break;
+            }
+        }
+        /* Cholesky solution of the normal equations, whose lower
+           triangle is given; returns false if the system is not
+           positive definite, e.g., with too few paths in the money. */
+        bool solve(std::vector<Real>& A, std::vector<Real>& x) const {
+            Size m = x.size();
+            if (A[0] < Real(m+1))
+                return false;
+            for (Size k=0; k<m; ++k) {
+                Real d = A[k*m+k];
+                for (Size l=0; l<k; ++l)
+                    d -= A[k*m+l]*A[k*m+l];
+                if (d <= 1.0e-12*A[k*m+k])
+                    return false;
+                A[k*m+k] = std::sqrt(d);
+                for (Size r=k+1; r<m; ++r) {
+                    Real v = A[r*m+k];
+                    for (Size l=0; l<k; ++l)
+                        v -= A[r*m+l]*A[k*m+l];
+                    A[r*m+k] = v/A[k*m+k];
+                }
+            }
+            for (Size k=0; k<m; ++k) {
+                for (Size l=0; l<k; ++l)
+                    x[k] -= A[k*m+l]*x[l];
+                x[k] /= A[k*m+k];
+            }
+            for (Size k=m; k>0; --k) {
+                for (Size l=k; l<m; ++l)
+                    x[k-1] -= A[l*m+k-1]*x[l];
+                x[k-1] /= A[(k-1)*m+k-1];
+            }
+            return true;
+        }
+        const MCAmericanEngine_2<RNG>& engine_;
+        Size blocks_, paths_, workers_;
+        boost::barrier barrier_;
+        // discounted cash flows of the current exercise policy
+        std::vector<Real> values_;
+        // stored paths, or segment starts and the current segment
+        std::vector<Real> stored_, checkpoints_, buffer_;
+        Size slotSize_;
+        std::vector<Real> slots_;
+    };
+
+
+    /* Pricing on independent paths; each worker generates its
+       blocks one segment at a time and keeps the sums of each block
+       for the final reduction.  Blocks are numbered from the first
+       block of the pricing paths. */
+    template <class RNG>
+    class MCAmericanEngine_2<RNG>::Pricing {
+      public:
+        Pricing(const MCAmericanEngine_2<RNG>& engine, Size firstBlock,
+                Size blocks, Size workers)
+        : engine_(engine), firstBlock_(firstBlock), blocks_(blocks),
+          workers_(workers), sums_(blocks), squares_(blocks) {}
+        void operator()(Size worker) {
+            const MCAmericanEngine_2<RNG>& e = engine_;
+            Size c = e.segmentLength_;
+            std::vector<Real> start(blockSize), buffer(c*blockSize),
+                              values(blockSize);
+            std::vector<bool> stopped(blockSize);
+            for (Size b=worker*blocks_/workers_;
+                 b<(worker+1)*blocks_/workers_; ++b) {
+                std::fill(start.begin(), start.end(), e.underlying_);
+                std::fill(stopped.begin(), stopped.end(), false);
+                for (Size k=0; k<e.segments_; ++k) {
+                    e.generate(e.seed_, 1, firstBlock_+b, k, &start[0], 1,
+                               &buffer[0], blockSize);
+                    Size first = k*c,
+                         last = std::min(first+c, e.steps_);
+                    for (Size i=first+1; i<=last; ++i) {
+                        const Real* s = &buffer[(i-first-1)*blockSize];
+                        bool check = (i < e.steps_ &&
+                                      !e.coefficients_[i].empty());
+                        for (Size p=0; p<blockSize; ++p) {
+                            if (stopped[p])
+                                continue;
+                            Real exercise =
+                                e.discount_[i]*(*e.payoff_)(s[p]);
+                            if (i == e.steps_ ||
+                                (check && exercise > 0.0 &&
+                                 exercise >= e.continuation(i, s[p]))) {
+                                values[p] = exercise;
+                                stopped[p] = true;
+                            }
+                        }
+                    }
+                    std::copy(&buffer[(last-first-1)*blockSize],
+                              &buffer[(last-first)*blockSize],
+                              start.begin());
+                }
+                // antithetic pairs are averaged into one sample
+                Real sum = 0.0, square = 0.0;
+                if (e.antithetic_) {
+                    for (Size p=0; p<blockSize; p+=2) {
+                        Real v = 0.5*(values[p]+values[p+1]);
+                        sum += v;
+                        square += v*v;
+                    }
+                } else {
+                    for (Size p=0; p<blockSize; ++p) {
+                        sum += values[p];
+                        square += values[p]*values[p];
+                    }
+                }
+                sums_[b] = sum;
+                squares_[b] = square;
+            }
+        }
+        BlockStatistics statistics() const {
+            Size samples = (engine_.antithetic_ ? blockSize/2 : blockSize);
+            BlockStatistics result(samples);
+            for (Size b=0; b<blocks_; ++b)
+                result.addBlock(samples, sums_[b], squares_[b]);
+            return result;
+        }
+      private:
+        const MCAmericanEngine_2<RNG>& engine_;
+        Size firstBlock_, blocks_, workers_;
+        std::vector<Real> sums_, squares_;
+    };
+
+
+    template <class RNG>
+    inline void MCAmericanEngine_2<RNG>::calculate() const {
+
+        payoff_ = boost::dynamic_pointer_cast<PlainVanillaPayoff>(
+                                                         arguments_.payoff);
+        QL_REQUIRE(payoff_, "non-plain payoff given");
+        QL_REQUIRE(arguments_.exercise->type() == Exercise::American,
+                   "not an American option");
+
+        Time maturity = process_->time(arguments_.exercise->lastDate());
+        QL_REQUIRE(maturity > 0.0, "expired option");
+        if (timeSteps_ != Null<Size>())
+            steps_ = timeSteps_;
+        else
+            steps_ = std::max<Size>(Size(timeStepsPerYear_*maturity), 1);
+        Size n = steps_;
+        Time dt = maturity/n;
+        segmentLength_ = std::max<Size>(Size(std::ceil(std::sqrt(Real(n)))),
+                                        1);
+        segments_ = (n + segmentLength_ - 1)/segmentLength_;
+
+        // log-normal steps on the term structures
+        underlying_ = process_->x0();
+        Real strike = payoff_->strike();
+        drift_.resize(n);
+        stdDev_.resize(n);
+        discount_.resize(n+1);
+        Real variance = 0.0;
+        DiscountFactor dividends = 1.0;
+        discount_[0] = 1.0;
+        for (Size i=1; i<=n; ++i) {
+            Time t = i*dt;
+            Real v = process_->blackVolatility()->blackVariance(t, strike);
+            DiscountFactor q = process_->dividendYield()->discount(t);
+            discount_[i] = process_->riskFreeRate()->discount(t);
+            Real dv = std::max<Real>(v - variance, 0.0);
+            drift_[i-1] = std::log(q/dividends * discount_[i-1]/discount_[i])
+                - 0.5*dv;
+            stdDev_[i-1] = std::sqrt(dv);
+            variance = v;
+            dividends = q;
+        }
+
+        // exercise steps, snapped as in the binomial engines
+        Time t0 = process_->time(arguments_.exercise->date(0));
+        firstExercise_ = std::max<Size>(
+            1, Size(std::max<Real>(0.0, t0/dt + 0.5)));
+        coefficients_.assign(n+1, std::vector<Real>());
+
+        // calibration
+        Size blocks = (calibrationSamples_ + blockSize - 1)/blockSize;
+        Size workers = std::min(threads_, blocks);
+        Calibration calibration(*this, blocks, workers);
+        {
+            boost::thread_group threads;
+            for (Size k=1; k<workers; ++k)
+                threads.create_thread(
+                    boost::bind<void>(boost::ref(calibration), k));
+            calibration(0);
+            threads.join_all();
+        }
+
+        // pricing
+        blocks = (requiredSamples_ + blockSize - 1)/blockSize;
+        workers = std::min(threads_, blocks);
+        Pricing pricing(*this, firstPath_/blockSize, blocks, workers);
+        {
+            boost::thread_group threads;
+            for (Size k=1; k<workers; ++k)
+                threads.create_thread(
+                    boost::bind<void>(boost::ref(pricing), k));
+            pricing(0);
+            threads.join_all();
+        }
+
+        BlockStatistics statistics = pricing.statistics();
+        results_.value = statistics.mean();
+        if (RNG::allowsErrorEstimate && statistics.samples() > 1)
+            results_.errorEstimate = statistics.errorEstimate();
+        results_.additionalResults["blockStatistics"] = statistics;
+        results_.additionalResults["pathMemory"] = Real(calibration.memory());
+    }
+
+
+    template <class RNG>
+    inline MakeMCAmericanEngine_2<RNG>::MakeMCAmericanEngine_2(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process)
+    : process_(process), antithetic_(false), regenerate_(false),
+      steps_(Null<Size>()), stepsPerYear_(Null<Size>()),
+      samples_(Null<Size>()), calibrationSamples_(2048),
+      polynomialOrder_(2), threads_(0), seed_(0), firstPath_(0) {}
+
+    template <class RNG>
+    inline MakeMCAmericanEngine_2<RNG>&
+    MakeMCAmericanEngine_2<RNG>::withSteps(Size steps) {
+        steps_ = steps;
+        return *this;
+    }
+
+    template <class RNG>
+    inline MakeMCAmericanEngine_2<RNG>&
+    MakeMCAmericanEngine_2<RNG>::withStepsPerYear(Size steps) {
+        stepsPerYear_ = steps;
+        return *this;
+    }
+
+    template <class RNG>
+    inline MakeMCAmericanEngine_2<RNG>&
+    MakeMCAmericanEngine_2<RNG>::withSamples(Size samples) {
+        samples_ = samples;
+        return *this;
+    }
+
+    template <class RNG>
+    inline MakeMCAmericanEngine_2<RNG>&
+    MakeMCAmericanEngine_2<RNG>::withCalibrationSamples(Size samples) {
+        calibrationSamples_ = samples;
+        return *this;
+    }
+
+    template <class RNG>
+    inline MakeMCAmericanEngine_2<RNG>&
+    MakeMCAmericanEngine_2<RNG>::withSeed(BigNatural seed) {
+        seed_ = seed;
+        return *this;
+    }
+
+    template <class RNG>
+    inline MakeMCAmericanEngine_2<RNG>&
+    MakeMCAmericanEngine_2<RNG>::withAntitheticVariate(bool b) {
+        antithetic_ = b;
+        return *this;
+    }
+
+    template <class RNG>
+    inline MakeMCAmericanEngine_2<RNG>&
+    MakeMCAmericanEngine_2<RNG>::withPolynomialOrder(Size order) {
+        polynomialOrder_ = order;
+        return *this;
+    }
+
+    template <class RNG>
+    inline MakeMCAmericanEngine_2<RNG>&
+    MakeMCAmericanEngine_2<RNG>::withPathRegeneration(bool b) {
+        regenerate_ = b;
+        return *this;
+    }
+
+    template <class RNG>
+    inline MakeMCAmericanEngine_2<RNG>&
+    MakeMCAmericanEngine_2<RNG>::withThreads(Size threads) {
+        threads_ = threads;
+        return *this;
+    }
+
+    template <class RNG>
+    inline MakeMCAmericanEngine_2<RNG>&
+    MakeMCAmericanEngine_2<RNG>::withFirstPath(BigNatural path) {
+        firstPath_ = path;
+        return *this;
+    }
+
+    template <class RNG>
+    inline
+    MakeMCAmericanEngine_2<RNG>::operator boost::shared_ptr<PricingEngine>()
+                                                                      const {
+        return boost::shared_ptr<PricingEngine>(new
+            MCAmericanEngine_2<RNG>(process_,
+                                    steps_,
+                                    stepsPerYear_,
+                                    antithetic_,
+                                    calibrationSamples_,
+                                    samples_,
+                                    seed_,
+                                    polynomialOrder_,
+                                    regenerate_,
+                                    threads_,
+                                    firstPath_));
+    }
+
+}
+
+
+#endif
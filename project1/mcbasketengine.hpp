@@ -0,0 +1,477 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file mcbasketengine.hpp
+    \brief Parallel Monte Carlo engine for European basket options
+*/
+
+#ifndef montecarlo_basket_engine_2_hpp
+#define montecarlo_basket_engine_2_hpp
+
+#include <ql/instruments/basketoption.hpp>
+#include <ql/math/comparison.hpp>
+#include <ql/math/matrix.hpp>
+#include <ql/math/matrixutilities/choleskydecomposition.hpp>
+#include <ql/math/randomnumbers/rngtraits.hpp>
+#include <ql/math/randomnumbers/seedgenerator.hpp>
+#include "constantblackscholesprocess.hpp"
+#include "mcblocksimulation.hpp"
+#include <algorithm>
+#include <vector>
+
+namespace QuantLib {
+
+    //! European basket option engine using Monte Carlo simulation
+    /*! \ingroup basketengines
+
+        The assets follow correlated ConstantBlackScholesProcess
+        dynamics, so that their values at maturity are drawn exactly
+        in a single step.  Paths are simulated in blocks of 256:
+        the Gaussian vectors of a block are stored asset by asset,
+        the lower Cholesky factor of the correlation is applied to
+        whole rows of the block and the asset values are folded into
+        the basket one asset at a time, so that the inner loops run
+        over contiguous paths and are vectorized by the compiler.
+        Average, spread, minimum and maximum payoffs are evaluated on
+        the block in the same way; other basket payoffs are evaluated
+        path by path.  With antithetic variates, the second half of a
+        block uses the opposite Gaussian vectors of the first half
+        and each pair is averaged into one sample.
+
+        With PhiloxRandom, each path draws its Gaussians from its
+        index; with other policies, the random numbers of each block
+        are drawn from their own generator, seeded from the engine
+        seed.  Blocks are shared among threads and their sums are
+        added in block order, so that the result doesn't depend on
+        the number of threads.  With a tolerance, blocks are added in
+        rounds until the error estimate falls below it, as in
+        McSimulation.  The block sums are returned as the
+        "blockStatistics" additional result.
+
+        A first path, multiple of the block size, can be given, in
+        which case the simulation runs the blocks from that path on;
+        a simulation can thus be split in ranges of paths among
+        processes, and appending the statistics of the ranges in
+        path order gives the same results as the sequential run.
+
+        The numbers of paths are rounded up to whole blocks.  The
+        processes must share the risk-free rate.
+
+        \warning RNG must be PseudoRandom or PhiloxRandom, since the
+                 sequences of different blocks are independent.
+    */
+    template <class RNG = PseudoRandom>
+    class MCBasketEngine_2 : public BasketOption::engine {
+      public:
+        typedef typename RNG::rsg_type rsg_type;
+        enum { blockSize = 256 };
+        /*! If no number of threads is given, the available hardware
+            concurrency is used.
+        */
+        MCBasketEngine_2(
+            const std::vector<boost::shared_ptr<ConstantBlackScholesProcess> >&
+                                                                   processes,
+            const Matrix& correlation,
+            bool antitheticVariate,
+            Size requiredSamples,
+            Real requiredTolerance,
+            Size maxSamples,
+            BigNatural seed,
+            Size threads = 0,
+            BigNatural firstPath = 0);
+        void calculate() const;
+      private:
+        enum Accumulation { Average, Spread, Min, Max, Generic };
+        class Simulation;
+        std::vector<boost::shared_ptr<ConstantBlackScholesProcess> >
+            processes_;
+        Matrix cholesky_;
+        bool antithetic_;
+        Size requiredSamples_, maxSamples_;
+        Real requiredTolerance_;
+        BigNatural seed_;
+        Size threads_;
+        BigNatural firstPath_;
+        // calculation data
+        mutable boost::shared_ptr<BasketPayoff> payoff_;
+        mutable boost::shared_ptr<PlainVanillaPayoff> vanilla_;
+        mutable Accumulation accumulation_;
+        mutable std::vector<Real> weights_, underlying_, drift_, stdDev_;
+    };
+
+
+    //! Monte Carlo basket engine factory
+    template <class RNG = PseudoRandom>
+    class MakeMCBasketEngine_2 {
+      public:
+        MakeMCBasketEngine_2(
+            const std::vector<boost::shared_ptr<ConstantBlackScholesProcess> >&,
+            const Matrix& correlation);
+        // named parameters
+        MakeMCBasketEngine_2& withSamples(Size samples);
+        MakeMCBasketEngine_2& withAbsoluteTolerance(Real tolerance);
+        MakeMCBasketEngine_2& withMaxSamples(Size samples);
+        MakeMCBasketEngine_2& withSeed(BigNatural seed);
+        MakeMCBasketEngine_2& withAntitheticVariate(bool b = true);
+        MakeMCBasketEngine_2& withThreads(Size threads);
+        MakeMCBasketEngine_2& withFirstPath(BigNatural path);
+        // conversion to pricing engine
+        operator boost::shared_ptr<PricingEngine>() const;
+      private:
+        std::vector<boost::shared_ptr<ConstantBlackScholesProcess> >
+            processes_;
+        Matrix correlation_;
+        bool antithetic_;
+        Size samples_, maxSamples_, threads_;
+        Real tolerance_;
+        BigNatural seed_, firstPath_;
+    };
+
+
+    // inline definitions
+
+    template <class RNG>
+    inline MCBasketEngine_2<RNG>::MCBasketEngine_2(
+            const std::vector<boost::shared_ptr<ConstantBlackScholesProcess> >&
+                                                                   processes,
+            const Matrix& correlation,
+            bool antitheticVariate,
+            Size requiredSamples,
+            Real requiredTolerance,
+            Size maxSamples,
+            BigNatural seed,
+            Size threads,
+            BigNatural firstPath)
+    : processes_(processes), antithetic_(antitheticVariate),
+      requiredSamples_(requiredSamples), maxSamples_(maxSamples),
+      requiredTolerance_(requiredTolerance), seed_(seed),
+      threads_(threads), firstPath_(firstPath) {
+        Size n = processes_.size();
+        QL_REQUIRE(n > 0, "no processes given");
+        for (Size i=0; i<n; ++i) {
+            QL_REQUIRE(processes_[i], "null process given");
+            QL_REQUIRE(close_enough(processes_[i]->riskFreeRate(),
+                                    processes_[0]->riskFreeRate()),
+                       "processes with different risk-free rates given");
+        }
+        QL_REQUIRE(correlation.rows() == n && correlation.columns() == n,
+                   "correlation matrix (" << correlation.rows() << "x"
+                   << correlation.columns() << ") does not match the "
+                   << n << " processes");
+        QL_REQUIRE(requiredSamples != Null<Size>() ||
+                   requiredTolerance != Null<Real>(),
+                   "neither samples nor tolerance given");
+        QL_REQUIRE(requiredSamples == Null<Size>() || requiredSamples > 0,
+                   "positive number of samples required");
+        QL_REQUIRE(requiredTolerance == Null<Real>() ||
+                   RNG::allowsErrorEstimate,
+                   "chosen random generator policy "
+                   "does not allow an error estimate");
+        QL_REQUIRE(firstPath % blockSize == 0,
+                   "first path (" << firstPath << ") is not a multiple "
+                   "of the block size (" << Size(blockSize) << ")");
+        cholesky_ = CholeskyDecomposition(correlation, true);
+        if (seed_ == 0)
+            seed_ = SeedGenerator::instance().get();
+        if (threads_ == 0)
+            threads_ = std::max<Size>(boost::thread::hardware_concurrency(),
+                                      1);
+        for (Size i=0; i<n; ++i)
+            registerWith(processes_[i]);
+    }
+
+
+    /* Simulation of a block of paths; each worker gets a copy and
+       allocates its buffers on the first block. */
+    template <class RNG>
+    class MCBasketEngine_2<RNG>::Simulation {
+      public:
+        explicit Simulation(const MCBasketEngine_2<RNG>& engine)
+        : engine_(engine) {}
+        void operator()(Size b, Real& sum, Real& square) {
+            const MCBasketEngine_2<RNG>& e = engine_;
+            Size n = e.processes_.size();
+            Size draws = (e.antithetic_ ? blockSize/2 : blockSize);
+            if (z_.empty()) {
+                z_.resize(n*draws);
+                w_.resize(draws);
+                s_.resize(blockSize);
+                basket_.resize(blockSize);
+                values_.resize(blockSize);
+                if (e.accumulation_ == Generic)
+                    assets_.resize(n*blockSize);
+            }
+            rsg_type generator = detail::monteCarloBlockGenerator<RNG>(
+                n, e.seed_, 0, b, 0, blockSize);
+            for (Size q=0; q<draws; ++q) {
+                const std::vector<Real>& x = generator.nextSequence().value;
+                for (Size k=0; k<n; ++k)
+                    z_[k*draws+q] = x[k];
+            }
+
+            for (Size i=0; i<n; ++i) {
+                // correlated Gaussians of asset i
+                std::fill(w_.begin(), w_.end(), 0.0);
+                const Real* L = e.cholesky_[i];
+                for (Size k=0; k<=i; ++k) {
+                    Real l = L[k];
+                    if (l == 0.0)
+                        continue;
+                    const Real* zk = &z_[k*draws];
+                    for (Size q=0; q<draws; ++q)
+                        w_[q] += l*zk[q];
+                }
+                Real s0 = e.underlying_[i], mu = e.drift_[i],
+                     sigma = e.stdDev_[i];
+                for (Size q=0; q<draws; ++q)
+                    s_[q] = s0*std::exp(mu + sigma*w_[q]);
+                if (e.antithetic_) {
+                    for (Size q=0; q<draws; ++q)
+                        s_[draws+q] = s0*std::exp(mu - sigma*w_[q]);
+                }
+                accumulate(i);
+            }
+
+            if (e.accumulation_ == Generic) {
+                Array a(n);
+                for (Size p=0; p<blockSize; ++p) {
+                    for (Size i=0; i<n; ++i)
+                        a[i] = assets_[i*blockSize+p];
+                    values_[p] = (*e.payoff_)(a);
+                }
+            } else if (e.vanilla_) {
+                Real strike = e.vanilla_->strike();
+                Real omega =
+                    (e.vanilla_->optionType() == Option::Call ? 1.0 : -1.0);
+                for (Size p=0; p<blockSize; ++p)
+                    values_[p] = std::max<Real>(omega*(basket_[p]-strike),
+                                                0.0);
+            } else {
+                const Payoff& base = *e.payoff_->basePayoff();
+                for (Size p=0; p<blockSize; ++p)
+                    values_[p] = base(basket_[p]);
+            }
+
+            // antithetic pairs are averaged into one sample
+            sum = 0.0;
+            square = 0.0;
+            if (e.antithetic_) {
+                for (Size q=0; q<draws; ++q) {
+                    Real v = 0.5*(values_[q]+values_[draws+q]);
+                    sum += v;
+                    square += v*v;
+                }
+            } else {
+                for (Size p=0; p<blockSize; ++p) {
+                    sum += values_[p];
+                    square += values_[p]*values_[p];
+                }
+            }
+        }
+      private:
+        // folds the values of asset i into the basket
+        void accumulate(Size i) {
+            switch (engine_.accumulation_) {
+              case Average: {
+                  Real a = engine_.weights_[i];
+                  if (i == 0)
+                      std::fill(basket_.begin(), basket_.end(), 0.0);
+                  for (Size p=0; p<blockSize; ++p)
+                      basket_[p] += a*s_[p];
+                }
+                break;
+              case Spread:
+                if (i == 0) {
+                    std::copy(s_.begin(), s_.end(), basket_.begin());
+                } else {
+                    for (Size p=0; p<blockSize; ++p)
+                        basket_[p] -= s_[p];
+                }
+                break;
+              case Min:
+                if (i == 0) {
+                    std::copy(s_.begin(), s_.end(), basket_.begin());
+                } else {
+                    for (Size p=0; p<blockSize; ++p)
+                        basket_[p] = std::min(basket_[p], s_[p]);
+                }
+                break;
+              case Max:
+                if (i == 0) {
+                    std::copy(s_.begin(), s_.end(), basket_.begin());
+                } else {
+                    for (Size p=0; p<blockSize; ++p)
+                        basket_[p] = std::max(basket_[p], s_[p]);
+                }
+                break;
+              case Generic:
+                std::copy(s_.begin(), s_.end(), &assets_[i*blockSize]);
+                break;
+              default:
+                QL_FAIL("unknown accumulation");
+            }
+        }
+        const MCBasketEngine_2<RNG>& engine_;
+        std::vector<Real> z_, w_, s_, basket_, values_, assets_;
+    };
+
+
+    template <class RNG>
+    inline void MCBasketEngine_2<RNG>::calculate() const {
+
+        QL_REQUIRE(arguments_.exercise->type() == Exercise::European,
+                   "not a European option");
+        payoff_ = boost::dynamic_pointer_cast<BasketPayoff>(
+                                                         arguments_.payoff);
+        QL_REQUIRE(payoff_, "non-basket payoff given");
+        vanilla_ = boost::dynamic_pointer_cast<PlainVanillaPayoff>(
+                                                     payoff_->basePayoff());
+
+        Size n = processes_.size();
+        if (boost::dynamic_pointer_cast<AverageBasketPayoff>(payoff_)) {
+            // the average is linear; its weights are its values on
+            // the unit vectors
+            accumulation_ = Average;
+            weights_.resize(n);
+            Array unit(n, 0.0);
+            for (Size i=0; i<n; ++i) {
+                unit[i] = 1.0;
+                weights_[i] = payoff_->accumulate(unit);
+                unit[i] = 0.0;
+            }
+        } else if (boost::dynamic_pointer_cast<SpreadBasketPayoff>(payoff_)) {
+            QL_REQUIRE(n == 2, "spread payoff requires 2 assets, "
+                       << n << " given");
+            accumulation_ = Spread;
+        } else if (boost::dynamic_pointer_cast<MinBasketPayoff>(payoff_)) {
+            accumulation_ = Min;
+        } else if (boost::dynamic_pointer_cast<MaxBasketPayoff>(payoff_)) {
+            accumulation_ = Max;
+        } else {
+            accumulation_ = Generic;
+        }
+
+        Time maturity = processes_[0]->time(arguments_.exercise->lastDate());
+        QL_REQUIRE(maturity > 0.0, "expired option");
+        underlying_.resize(n);
+        drift_.resize(n);
+        stdDev_.resize(n);
+        for (Size i=0; i<n; ++i) {
+            const ConstantBlackScholesProcess& p = *processes_[i];
+            underlying_[i] = p.x0();
+            drift_[i] = p.drift(0.0, p.x0())*maturity;
+            stdDev_[i] = p.stdDeviation(0.0, p.x0(), maturity);
+        }
+        DiscountFactor discount =
+            std::exp(-processes_[0]->riskFreeRate()*maturity);
+
+        BlockStatistics statistics = detail::simulateBlocks(
+            Simulation(*this), blockSize,
+            antithetic_ ? blockSize/2 : blockSize, firstPath_/blockSize,
+            requiredSamples_, requiredTolerance_, maxSamples_,
+            discount, threads_);
+        results_.value = statistics.mean();
+        if (RNG::allowsErrorEstimate && statistics.samples() > 1)
+            results_.errorEstimate = statistics.errorEstimate();
+        results_.additionalResults["blockStatistics"] = statistics;
+    }
+
+
+    template <class RNG>
+    inline MakeMCBasketEngine_2<RNG>::MakeMCBasketEngine_2(
+            const std::vector<boost::shared_ptr<ConstantBlackScholesProcess> >&
+                                                                   processes,
+            const Matrix& correlation)
+    : processes_(processes), correlation_(correlation), antithetic_(false),
+      samples_(Null<Size>()), maxSamples_(Null<Size>()), threads_(0),
+      tolerance_(Null<Real>()), seed_(0), firstPath_(0) {}
+
+    template <class RNG>
+    inline MakeMCBasketEngine_2<RNG>&
+    MakeMCBasketEngine_2<RNG>::withSamples(Size samples) {
+        QL_REQUIRE(tolerance_ == Null<Real>(),
+                   "tolerance already set");
+        samples_ = samples;
+        return *this;
+    }
+
+    template <class RNG>
+    inline MakeMCBasketEngine_2<RNG>&
+    MakeMCBasketEngine_2<RNG>::withAbsoluteTolerance(Real tolerance) {
+        QL_REQUIRE(samples_ == Null<Size>(),
+                   "number of samples already set");
+        QL_REQUIRE(RNG::allowsErrorEstimate,
+                   "chosen random generator policy "
+                   "does not allow an error estimate");
+        tolerance_ = tolerance;
+        return *this;
+    }
+
+    template <class RNG>
+    inline MakeMCBasketEngine_2<RNG>&
+    MakeMCBasketEngine_2<RNG>::withMaxSamples(Size samples) {
+        maxSamples_ = samples;
+        return *this;
+    }
+
+    template <class RNG>
+    inline MakeMCBasketEngine_2<RNG>&
+    MakeMCBasketEngine_2<RNG>::withSeed(BigNatural seed) {
+        seed_ = seed;
+        return *this;
+    }
+
+    template <class RNG>
+    inline MakeMCBasketEngine_2<RNG>&
+    MakeMCBasketEngine_2<RNG>::withAntitheticVariate(bool b) {
+        antithetic_ = b;
+        return *this;
+    }
+
+    template <class RNG>
+    inline MakeMCBasketEngine_2<RNG>&
+    MakeMCBasketEngine_2<RNG>::withThreads(Size threads) {
+        threads_ = threads;
+        return *this;
+    }
+
+    template <class RNG>
+    inline MakeMCBasketEngine_2<RNG>&
+    MakeMCBasketEngine_2<RNG>::withFirstPath(BigNatural path) {
+        firstPath_ = path;
+        return *this;
+    }
+
+    template <class RNG>
+    inline
+    MakeMCBasketEngine_2<RNG>::operator boost::shared_ptr<PricingEngine>()
+                                                                      const {
+        return boost::shared_ptr<PricingEngine>(new
+            MCBasketEngine_2<RNG>(processes_,
+                                  correlation_,
+                                  antithetic_,
+                                  samples_, tolerance_,
+                                  maxSamples_,
+                                  seed_,
+                                  threads_,
+                                  firstPath_));
+    }
+
+}
+
+
+#endif
@@ -0,0 +1,90 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file mcblockseed.hpp
+    \brief Random numbers of the blocks of paths of the parallel Monte Carlo
+           engines
+*/
+
+#ifndef montecarlo_block_seed_hpp
+#define montecarlo_block_seed_hpp
+
+#include <ql/types.hpp>
+#include "philoxrandom.hpp"
+#include <boost/cstdint.hpp>
+
+namespace QuantLib {
+
+    namespace detail {
+
+        /* Seed of the random numbers of a segment of a block of
+           paths, mixed from the engine seed by the SplitMix64
+           finalizer so that nearby blocks get unrelated sequences. */
+        inline BigNatural monteCarloBlockSeed(BigNatural seed,
+                                              Size phase,
+                                              Size block,
+                                              Size segment) {
+            boost::uint64_t x = boost::uint64_t(seed);
+            boost::uint64_t keys[] = { phase, block, segment };
+            for (Size i=0; i<3; ++i) {
+                x += 0x9E3779B97F4A7C15ULL + keys[i];
+                x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+                x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+                x ^= x >> 31;
+            }
+            // a null seed would be replaced by a clock-based one
+            BigNatural result = BigNatural(x & 0xFFFFFFFFUL);
+            return result == 0 ? 1 : result;
+        }
+
+        /* Generator of a segment of a block of paths, whose
+           sequences are the paths of the block in turn.  PhiloxRandom
+           draws each path from its absolute index, with a key mixed
+           from the engine seed, the phase and the segment; other
+           policies, which can't skip, get a generator per block
+           seeded by monteCarloBlockSeed. */
+        template <class RNG>
+        inline typename RNG::rsg_type monteCarloBlockGenerator(
+                                               Size dimension,
+                                               BigNatural seed,
+                                               Size phase,
+                                               Size block,
+                                               Size segment,
+                                               Size blockSize) {
+            return RNG::make_sequence_generator(
+                dimension, monteCarloBlockSeed(seed, phase, block, segment));
+        }
+
+        template <>
+        inline PhiloxRandom::rsg_type monteCarloBlockGenerator<PhiloxRandom>(
+                                               Size dimension,
+                                               BigNatural seed,
+                                               Size phase,
+                                               Size block,
+                                               Size segment,
+                                               Size blockSize) {
+            return PhiloxRandom::make_sequence_generator(
+                dimension, monteCarloBlockSeed(seed, phase, 0, segment),
+                BigNatural(block)*blockSize);
+        }
+
+    }
+
+}
+
+
+#endif
@@ -0,0 +1,148 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file mcblocksimulation.hpp
+    \brief Multi-threaded driver of Monte Carlo simulations by blocks
+*/
+
+#ifndef montecarlo_block_simulation_hpp
+#define montecarlo_block_simulation_hpp
+
+#include <ql/errors.hpp>
+#include <ql/utilities/null.hpp>
+#include "mcblockseed.hpp"
+#include "mcblockstatistics.hpp"
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <algorithm>
+#include <vector>
+
+namespace QuantLib {
+
+    namespace detail {
+
+        /* Runs the blocks from first to last; the sums of block b
+           are stored at b-offset. */
+        template <class Block>
+        inline void simulateBlockRange(Block block, Size first, Size last,
+                                       Size offset,
+                                       std::vector<Real>& sums,
+                                       std::vector<Real>& squares) {
+            for (Size b=first; b<last; ++b)
+                block(b, sums[b-offset], squares[b-offset]);
+        }
+
+        /* Runs the blocks from first to last, split in contiguous
+           ranges among the workers; each worker gets its own copy of
+           the block functor, which can thus keep its buffers. */
+        template <class Block>
+        inline void simulateBlocks(const Block& block, Size first,
+                                   Size last, Size offset, Size threads,
+                                   std::vector<Real>& sums,
+                                   std::vector<Real>& squares) {
+            Size count = last - first;
+            Size workers = std::max<Size>(std::min(threads, count), 1);
+            boost::thread_group group;
+            for (Size k=1; k<workers; ++k)
+                group.create_thread(boost::bind(
+                    &simulateBlockRange<Block>, block,
+                    first + k*count/workers, first + (k+1)*count/workers,
+                    offset, boost::ref(sums), boost::ref(squares)));
+            simulateBlockRange(block, first, first + count/workers,
+                               offset, sums, squares);
+            group.join_all();
+        }
+
+        /* Monte Carlo statistics from independent blocks of paths.
+
+           block(b, sum, square) simulates block b and sets the sum
+           of its samples and of their squares; the sums are then
+           scaled, e.g., by a discount factor, and added to the
+           statistics as one block each.  Blocks are numbered by the
+           index of their first path divided by the block size,
+           starting from firstBlock, so that a block draws the same
+           paths whatever the range of blocks being run.  The numbers
+           of paths are rounded up to whole blocks.  With a tolerance,
+           blocks are added in rounds sized as in McSimulation until
+           the error estimate falls below it.  As the statistics add
+           the block sums in block order, the results don't depend on
+           the number of threads. */
+        template <class Block>
+        inline BlockStatistics simulateBlocks(const Block& block,
+                                              Size blockSize,
+                                              Size samplesPerBlock,
+                                              Size firstBlock,
+                                              Size requiredSamples,
+                                              Real requiredTolerance,
+                                              Size maxSamples,
+                                              Real scale,
+                                              Size threads) {
+            const Size minSamples = 1024;
+            std::vector<Real> sums, squares;
+            BlockStatistics statistics(samplesPerBlock);
+            Size blocks = 0, target;
+            if (requiredTolerance != Null<Real>()) {
+                target = (minSamples + blockSize - 1)/blockSize;
+                if (maxSamples != Null<Size>())
+                    target = std::min(
+                        target, std::max<Size>(maxSamples/blockSize, 1));
+            } else {
+                target = (requiredSamples + blockSize - 1)/blockSize;
+            }
+
+            for (;;) {
+                sums.resize(target - blocks);
+                squares.resize(target - blocks);
+                simulateBlocks(block, firstBlock + blocks,
+                               firstBlock + target, firstBlock + blocks,
+                               threads, sums, squares);
+                for (Size b=0; b<target-blocks; ++b)
+                    statistics.addBlock(samplesPerBlock, scale*sums[b],
+                                        scale*scale*squares[b]);
+                blocks = target;
+
+                if (requiredTolerance == Null<Real>())
+                    return statistics;
+                Real error = (statistics.samples() > 1 ?
+                              statistics.errorEstimate() : Real(0.0));
+                if (error <= requiredTolerance)
+                    return statistics;
+
+                Size paths = blocks*blockSize;
+                Real order = (error*error)/
+                    (requiredTolerance*requiredTolerance);
+                Size next = Size(std::max<Real>(paths*order*0.8 - paths,
+                                                minSamples));
+                if (maxSamples != Null<Size>()) {
+                    QL_REQUIRE(paths < maxSamples,
+                               "max number of samples (" << maxSamples
+                               << ") reached, while error (" << error
+                               << ") is still above tolerance ("
+                               << requiredTolerance << ")");
+                    next = std::min(next, maxSamples - paths);
+                }
+                target = blocks + std::max<Size>(
+                                  (next + blockSize - 1)/blockSize, 1);
+            }
+        }
+
+    }
+
+}
+
+
+#endif
@@ -0,0 +1,191 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file mcblockstatistics.hpp
+    \brief Statistics of Monte Carlo samples summed by blocks of paths
+*/
+
+#ifndef montecarlo_block_statistics_hpp
+#define montecarlo_block_statistics_hpp
+
+#include <ql/errors.hpp>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace QuantLib {
+
+    //! Statistics of Monte Carlo samples summed by blocks
+    /*! Samples are summed in blocks of a fixed number of samples,
+        and the mean and the error estimate are computed from the
+        sums of the blocks added in block order.  The sums of a block
+        thus depend only on its samples, and not on how the
+        simulation was split: a run split in ranges of paths starting
+        at multiples of the block size, among threads or processes,
+        gives the blocks of the sequential run, and appending the
+        statistics of the ranges in path order reproduces its results
+        bit by bit.
+
+        Can be used as the statistics parameter of the Monte Carlo
+        engines in place of Statistics; the engines of this project
+        return it as the "blockStatistics" additional result.
+    */
+    class BlockStatistics {
+      public:
+        typedef Real value_type;
+        explicit BlockStatistics(Size blockSize = 1024);
+        //! \name Inspectors
+        //@{
+        Size blockSize() const { return blockSize_; }
+        //! number of completed blocks
+        Size blocks() const { return blocks_.size(); }
+        Size samples() const;
+        Real weightSum() const;
+        Real mean() const;
+        Real variance() const;
+        Real standardDeviation() const;
+        Real errorEstimate() const;
+        //@}
+        //! \name Modifiers
+        //@{
+        void add(Real value, Real weight = 1.0);
+        //! adds a whole block given the sums of its unit-weight samples
+        void addBlock(Size samples, Real sum, Real sumOfSquares);
+        /*! appends the blocks of the paths following the current
+            ones; empty statistics take the block size of the others.
+        */
+        void append(const BlockStatistics& other);
+        void reset();
+        //@}
+      private:
+        struct Block {
+            Block() : samples(0), weight(0.0), sum(0.0), square(0.0) {}
+            Size samples;
+            Real weight, sum, square;
+        };
+        Block total() const;
+        Size blockSize_;
+        std::vector<Block> blocks_;
+        // the samples added after the last completed block
+        Block current_;
+    };
+
+
+    // inline definitions
+
+    inline BlockStatistics::BlockStatistics(Size blockSize)
+    : blockSize_(blockSize) {
+        QL_REQUIRE(blockSize > 0, "null block size");
+    }
+
+    inline BlockStatistics::Block BlockStatistics::total() const {
+        Block result;
+        for (Size b=0; b<blocks_.size(); ++b) {
+            result.samples += blocks_[b].samples;
+            result.weight += blocks_[b].weight;
+            result.sum += blocks_[b].sum;
+            result.square += blocks_[b].square;
+        }
+        result.samples += current_.samples;
+        result.weight += current_.weight;
+        result.sum += current_.sum;
+        result.square += current_.square;
+        return result;
+    }
+
+    inline Size BlockStatistics::samples() const {
+        return total().samples;
+    }
+
+    inline Real BlockStatistics::weightSum() const {
+        return total().weight;
+    }
+
+    inline Real BlockStatistics::mean() const {
+        Block t = total();
+        QL_REQUIRE(t.weight > 0.0, "sampleWeight_= 0, unsufficient");
+        return t.sum/t.weight;
+    }
+
+    inline Real BlockStatistics::variance() const {
+        Block t = total();
+        QL_REQUIRE(t.weight > 0.0, "sampleWeight_= 0, unsufficient");
+        QL_REQUIRE(t.samples > 1,
+                   "sample number <= 1, unsufficient");
+        Real m = t.sum/t.weight;
+        Real v = (t.square/t.weight - m*m) * t.samples/(t.samples-1.0);
+        return std::max<Real>(v, 0.0);
+    }
+
+    inline Real BlockStatistics::standardDeviation() const {
+        return std::sqrt(variance());
+    }
+
+    inline Real BlockStatistics::errorEstimate() const {
+        return std::sqrt(variance()/samples());
+    }
+
+    inline void BlockStatistics::add(Real value, Real weight) {
+        QL_REQUIRE(weight >= 0.0,
+                   "negative weight (" << weight << ") not allowed");
+        current_.samples += 1;
+        current_.weight += weight;
+        current_.sum += weight*value;
+        current_.square += weight*value*value;
+        if (current_.samples == blockSize_) {
+            blocks_.push_back(current_);
+            current_ = Block();
+        }
+    }
+
+    inline void BlockStatistics::addBlock(Size samples, Real sum,
+                                          Real sumOfSquares) {
+        QL_REQUIRE(current_.samples == 0,
+                   "a block can't follow an incomplete one");
+        Block block;
+        block.samples = samples;
+        block.weight = Real(samples);
+        block.sum = sum;
+        block.square = sumOfSquares;
+        blocks_.push_back(block);
+    }
+
+    inline void BlockStatistics::append(const BlockStatistics& other) {
+        if (blocks_.empty() && current_.samples == 0) {
+            *this = other;
+            return;
+        }
+        QL_REQUIRE(other.blockSize_ == blockSize_,
+                   "block sizes differ (" << blockSize_ << " and "
+                   << other.blockSize_ << ")");
+        QL_REQUIRE(current_.samples == 0,
+                   "can't append to an incomplete block; the range "
+                   "must end at a multiple of the block size");
+        blocks_.insert(blocks_.end(),
+                       other.blocks_.begin(), other.blocks_.end());
+        current_ = other.current_;
+    }
+
+    inline void BlockStatistics::reset() {
+        blocks_.clear();
+        current_ = Block();
+    }
+
+}
+
+
+#endif
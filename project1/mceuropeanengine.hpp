@@ -28,19 +28,66 @@
 
 #include <ql/pricingengines/vanilla/mcvanillaengine.hpp>
 #include <ql/processes/blackscholesprocess.hpp>
+#include <ql/math/distributions/normaldistribution.hpp>
 #include <ql/termstructures/volatility/equityfx/blackconstantvol.hpp>
 #include <ql/termstructures/volatility/equityfx/blackvariancecurve.hpp>
+#include "../common/engineinstrumentation.hpp"
+#include "../common/pricingmonitor.hpp"
+#include "constantblackscholesprocess.hpp"
+#include "mcblockstatistics.hpp"
+#include "philoxrandom.hpp"
 
 namespace QuantLib {
 
     //! European option pricing engine using Monte Carlo simulation
     /*! \ingroup vanillaengines
 
+        If QL_ENABLE_ENGINE_INSTRUMENTATION is defined, the simulation
+        time, split between path pricing and path generation (the
+        latter including the setup and the statistics), the number
+        of samples and the heap allocations are returned as
+        "instrumentation.*" additional results and added to
+        EngineStatistics.
+
+        If a PricingMonitor is set, it is told of the paths priced
+        every 1024 paths, and the simulation is cancelled as soon as
+        the monitor asks for it.
+
+        With importance sampling, the paths of out-of-the-money
+        options are drawn with the drift moved so that the median of
+        the underlying at maturity is the strike, and the payoffs are
+        weighted by the likelihood ratio; see
+        ImportanceSamplingPathPricer_2.  The shifted paths follow a
+        ConstantBlackScholesProcess with the same distribution at
+        maturity as the given process, i.e., with the zero rates to
+        maturity and the Black volatility at the strike.  The shift,
+        in standard deviations of the log of the underlying, and the
+        variance reduction with respect to crude Monte Carlo on the
+        same number of paths (including the effect of antithetic
+        variates, if used) are returned as the
+        "importanceSampling.shift" and
+        "importanceSampling.varianceReduction" additional results,
+        the latter only if the random generator policy allows an
+        error estimate.
+
+        A first path can be given, in which case the simulation draws
+        the paths from that index on; with the required number of
+        samples, this selects a range of paths, so that a simulation
+        can be split among threads or processes.  Only policies with
+        random access by path, such as PhiloxRandom, accept a first
+        path other than 0; see makeSequenceGenerator.  With
+        BlockStatistics as the statistics parameter, the statistics
+        are also returned as the "blockStatistics" additional result;
+        for ranges starting at multiples of its block size, appending
+        them in path order gives the results of the sequential run
+        bit by bit.
+
         \test the correctness of the returned value is tested by
               checking it against analytic results.
     */
     template <class RNG = PseudoRandom, class S = Statistics>
-    class MCEuropeanEngine_2 : public MCVanillaEngine<SingleVariate,RNG,S> {
+    class MCEuropeanEngine_2 : public MCVanillaEngine<SingleVariate,RNG,S>,
+                               public MonitoredEngine {
       public:
         typedef
         typename MCVanillaEngine<SingleVariate,RNG,S>::path_generator_type
@@ -60,9 +107,28 @@ namespace QuantLib {
              Size requiredSamples,
              Real requiredTolerance,
              Size maxSamples,
-             BigNatural seed);
+             BigNatural seed,
+             bool importanceSampling = false,
+             BigNatural firstPath = 0);
+        void calculate() const;
       protected:
+        boost::shared_ptr<path_generator_type> pathGenerator() const;
         boost::shared_ptr<path_pricer_type> pathPricer() const;
+        bool importanceSampling_;
+        BigNatural firstPath_;
+        #if defined(QL_ENABLE_ENGINE_INSTRUMENTATION)
+        mutable EngineInstrumentation instrumentation_;
+        mutable double pricingTime_;
+        #endif
+      private:
+        // distribution of the underlying at maturity
+        struct Terminal {
+            Option::Type type;
+            Real spot, strike, forward, stdDev, shift;
+            Time maturity;
+            DiscountFactor discount;
+        };
+        Terminal terminal() const;
     };
 
     //! Monte Carlo European engine factory
@@ -80,6 +146,9 @@ namespace QuantLib {
         MakeMCEuropeanEngine_2& withMaxSamples(Size samples);
         MakeMCEuropeanEngine_2& withSeed(BigNatural seed);
         MakeMCEuropeanEngine_2& withAntitheticVariate(bool b = true);
+        MakeMCEuropeanEngine_2& withImportanceSampling(bool b = true);
+        //! draws the samples from the given path on
+        MakeMCEuropeanEngine_2& withFirstPath(BigNatural path);
         // conversion to pricing engine
         operator boost::shared_ptr<PricingEngine>() const;
       private:
@@ -89,6 +158,8 @@ namespace QuantLib {
         Real tolerance_;
         bool brownianBridge_;
         BigNatural seed_;
+        bool importanceSampling_;
+        BigNatural firstPath_;
     };
 
     class EuropeanPathPricer_2 : public PathPricer<Path> {
@@ -102,9 +173,97 @@ namespace QuantLib {
         DiscountFactor discount_;
     };
 
+    //! European path pricer for paths drawn with a shifted drift
+    /*! The log of the underlying at maturity is expected to be
+        normal with the given mean and standard deviation, which
+        include a shift of theta standard deviations with respect to
+        the pricing measure; the payoff is multiplied by the
+        likelihood ratio \f$ \exp(-\theta y - \theta^2/2) \f$, where
+        \f$ y \f$ is the standardized log of the underlying.
+    */
+    class ImportanceSamplingPathPricer_2 : public PathPricer<Path> {
+      public:
+        ImportanceSamplingPathPricer_2(Option::Type type,
+                                       Real strike,
+                                       DiscountFactor discount,
+                                       Real logDrift,
+                                       Real logStdDev,
+                                       Real shift);
+        Real operator()(const Path& path) const;
+      private:
+        PlainVanillaPayoff payoff_;
+        DiscountFactor discount_;
+        Real logDrift_, logStdDev_, shift_;
+    };
+
+    //! Path pricer reporting to a PricingMonitor
+    /*! Before each given number of paths, the monitor is told of
+        the paths priced so far and polled for cancellation.
+    */
+    class MonitoredPathPricer_2 : public PathPricer<Path> {
+      public:
+        MonitoredPathPricer_2(
+                      const boost::shared_ptr<PathPricer<Path> >& pricer,
+                      const boost::shared_ptr<PricingMonitor>& monitor,
+                      Size totalPaths,
+                      Size interval = 1024)
+        : pricer_(pricer), monitor_(monitor), totalPaths_(totalPaths),
+          interval_(interval), paths_(0) {}
+        Real operator()(const Path& path) const {
+            if (paths_ % interval_ == 0) {
+                monitor_->progress(paths_, totalPaths_);
+                if (monitor_->cancelled())
+                    throw PricingCancelled();
+            }
+            ++paths_;
+            return (*pricer_)(path);
+        }
+      private:
+        boost::shared_ptr<PathPricer<Path> > pricer_;
+        boost::shared_ptr<PricingMonitor> monitor_;
+        Size totalPaths_, interval_;
+        mutable Size paths_;
+    };
+
+    #if defined(QL_ENABLE_ENGINE_INSTRUMENTATION)
+    //! Path pricer adding the time spent in another one to a timer
+    class InstrumentedPathPricer_2 : public PathPricer<Path> {
+      public:
+        InstrumentedPathPricer_2(
+                      const boost::shared_ptr<PathPricer<Path> >& pricer,
+                      double& seconds)
+        : pricer_(pricer), seconds_(seconds) {}
+        Real operator()(const Path& path) const {
+            typedef boost::chrono::steady_clock clock;
+            clock::time_point start = clock::now();
+            Real result = (*pricer_)(path);
+            seconds_ +=
+                boost::chrono::duration<double>(clock::now()-start).count();
+            return result;
+        }
+      private:
+        boost::shared_ptr<PathPricer<Path> > pricer_;
+        double& seconds_;
+    };
+    #endif
+
 
     // inline definitions
 
+    namespace detail {
+
+        // only block statistics can be combined across ranges of paths
+        template <class S, class Results>
+        inline void addBlockStatistics(const S&, Results&) {}
+
+        template <class Results>
+        inline void addBlockStatistics(const BlockStatistics& statistics,
+                                       Results& results) {
+            results["blockStatistics"] = statistics;
+        }
+
+    }
+
     template <class RNG, class S>
     inline
     MCEuropeanEngine_2<RNG,S>::MCEuropeanEngine_2(
@@ -116,7 +275,9 @@ namespace QuantLib {
              Size requiredSamples,
              Real requiredTolerance,
              Size maxSamples,
-             BigNatural seed)
+             BigNatural seed,
+             bool importanceSampling,
+             BigNatural firstPath)
     : MCVanillaEngine<SingleVariate,RNG,S>(process,
                                            timeSteps,
                                            timeStepsPerYear,
@@ -126,14 +287,69 @@ namespace QuantLib {
                                            requiredSamples,
                                            requiredTolerance,
                                            maxSamples,
-                                           seed) {}
+                                           seed),
+      importanceSampling_(importanceSampling), firstPath_(firstPath) {}
 
 
     template <class RNG, class S>
-    inline
-    boost::shared_ptr<typename MCEuropeanEngine_2<RNG,S>::path_pricer_type>
-    MCEuropeanEngine_2<RNG,S>::pathPricer() const {
+    inline void MCEuropeanEngine_2<RNG,S>::calculate() const {
+        #if defined(QL_ENABLE_ENGINE_INSTRUMENTATION)
+        QL_ENGINE_START(instrumentation_);
+        QL_ENGINE_PHASE(instrumentation_, "simulation");
+        pricingTime_ = 0.0;
+        MCVanillaEngine<SingleVariate,RNG,S>::calculate();
+        QL_ENGINE_PHASE(instrumentation_, 0);
+
+        double simulation = instrumentation_.timers().find("simulation")
+                                                                  ->second;
+        instrumentation_.time("simulation.pathPricing", pricingTime_);
+        instrumentation_.time("simulation.pathGeneration",
+                              simulation - pricingTime_);
+        QL_ENGINE_COUNT(instrumentation_, "samples",
+                        this->mcModel_->sampleAccumulator().samples());
+        QL_ENGINE_FINISH(instrumentation_, "MCEuropeanEngine_2",
+                         this->results_.additionalResults);
+        #else
+        MCVanillaEngine<SingleVariate,RNG,S>::calculate();
+        #endif
+        detail::addBlockStatistics(this->mcModel_->sampleAccumulator(),
+                                   this->results_.additionalResults);
+
+        if (!importanceSampling_)
+            return;
+
+        Terminal t = terminal();
+        this->results_.additionalResults["importanceSampling.shift"] =
+            t.shift;
+        if (!RNG::allowsErrorEstimate)
+            return;
+
+        // variance of the discounted payoff under the pricing measure
+        Real w = (t.type == Option::Call ? 1.0 : -1.0);
+        Real variance = 0.0;
+        if (t.stdDev > 0.0) {
+            CumulativeNormalDistribution N;
+            Real v = t.stdDev, f = t.forward, k = t.strike;
+            Real d1 = std::log(f/k)/v + 0.5*v, d2 = d1 - v;
+            Real value = w*(f*N(w*d1) - k*N(w*d2));
+            Real square = f*f*std::exp(v*v)*N(w*(d1+v))
+                        - 2.0*k*f*N(w*d1) + k*k*N(w*d2);
+            variance = t.discount*t.discount*(square - value*value);
+        }
+
+        Real error = this->results_.errorEstimate;
+        Size paths = this->mcModel_->sampleAccumulator().samples() *
+                     (this->antitheticVariate_ ? 2 : 1);
+        this->results_.additionalResults[
+                                 "importanceSampling.varianceReduction"] =
+            (error > 0.0 ? Real(variance/(paths*error*error))
+                         : Null<Real>());
+    }
 
+
+    template <class RNG, class S>
+    inline typename MCEuropeanEngine_2<RNG,S>::Terminal
+    MCEuropeanEngine_2<RNG,S>::terminal() const {
         boost::shared_ptr<PlainVanillaPayoff> payoff =
             boost::dynamic_pointer_cast<PlainVanillaPayoff>(
                 this->arguments_.payoff);
@@ -144,12 +360,97 @@ namespace QuantLib {
                 this->process_);
         QL_REQUIRE(process, "Black-Scholes process required");
 
-        return boost::shared_ptr<
+        Terminal t;
+        t.type = payoff->optionType();
+        t.strike = payoff->strike();
+        t.maturity = this->timeGrid().back();
+        t.discount = process->riskFreeRate()->discount(t.maturity);
+        t.spot = process->x0();
+        t.forward = t.spot *
+            process->dividendYield()->discount(t.maturity) / t.discount;
+        t.stdDev = std::sqrt(process->blackVolatility()->blackVariance(
+                                                  t.maturity, t.strike));
+
+        // the median is moved to the strike for out-of-the-money
+        // options only, i.e., when the shift is -d2 and goes towards
+        // the exercise region
+        t.shift = 0.0;
+        if (t.stdDev > 0.0 && t.strike > 0.0) {
+            Real d2 = std::log(t.forward/t.strike)/t.stdDev - 0.5*t.stdDev;
+            if ((t.type == Option::Call && d2 < 0.0) ||
+                (t.type == Option::Put && d2 > 0.0))
+                t.shift = -d2;
+        }
+        return t;
+    }
+
+
+    template <class RNG, class S>
+    inline
+    boost::shared_ptr<typename MCEuropeanEngine_2<RNG,S>::path_generator_type>
+    MCEuropeanEngine_2<RNG,S>::pathGenerator() const {
+        Terminal t = terminal();
+        boost::shared_ptr<StochasticProcess> process = this->process_;
+        if (importanceSampling_ && t.shift != 0.0) {
+            // constant parameters giving the terminal distribution,
+            // with the shift taken from the dividend yield
+            Time T = t.maturity;
+            Volatility sigma = t.stdDev/std::sqrt(T);
+            Rate r = -std::log(t.discount)/T;
+            Rate q = r - std::log(t.forward/t.spot)/T
+                   - t.shift*sigma/std::sqrt(T);
+            process = boost::shared_ptr<StochasticProcess>(
+                    new ConstantBlackScholesProcess(t.spot, r, q, sigma));
+        }
+
+        TimeGrid grid = this->timeGrid();
+        typename RNG::rsg_type generator =
+            makeSequenceGenerator<RNG>(grid.size()-1, this->seed_,
+                                       firstPath_);
+        return boost::shared_ptr<path_generator_type>(
+                   new path_generator_type(process, grid, generator,
+                                           this->brownianBridge_));
+    }
+
+
+    template <class RNG, class S>
+    inline
+    boost::shared_ptr<typename MCEuropeanEngine_2<RNG,S>::path_pricer_type>
+    MCEuropeanEngine_2<RNG,S>::pathPricer() const {
+
+        Terminal t = terminal();
+        boost::shared_ptr<
+                       typename MCEuropeanEngine_2<RNG,S>::path_pricer_type>
+            pricer;
+        if (importanceSampling_)
+            pricer = boost::shared_ptr<
+                       typename MCEuropeanEngine_2<RNG,S>::path_pricer_type>(
+                new ImportanceSamplingPathPricer_2(
+                    t.type, t.strike, t.discount,
+                    std::log(t.forward/t.spot) - 0.5*t.stdDev*t.stdDev
+                                               + t.shift*t.stdDev,
+                    t.stdDev, t.shift));
+        else
+            pricer = boost::shared_ptr<
                        typename MCEuropeanEngine_2<RNG,S>::path_pricer_type>(
-          new EuropeanPathPricer_2(
-              payoff->optionType(),
-              payoff->strike(),
-              process->riskFreeRate()->discount(this->timeGrid().back())));
+                new EuropeanPathPricer_2(t.type, t.strike, t.discount));
+        #if defined(QL_ENABLE_ENGINE_INSTRUMENTATION)
+        pricer = boost::shared_ptr<
+                       typename MCEuropeanEngine_2<RNG,S>::path_pricer_type>(
+                         new InstrumentedPathPricer_2(pricer, pricingTime_));
+        #endif
+        if (this->monitor_) {
+            // antithetic samples price two paths
+            Size totalPaths = Null<Size>();
+            if (this->requiredSamples_ != Null<Size>())
+                totalPaths = this->requiredSamples_ *
+                             (this->antitheticVariate_ ? 2 : 1);
+            pricer = boost::shared_ptr<
+                       typename MCEuropeanEngine_2<RNG,S>::path_pricer_type>(
+                 new MonitoredPathPricer_2(pricer, this->monitor_,
+                                           totalPaths));
+        }
+        return pricer;
     }
 
 
@@ -159,7 +460,8 @@ namespace QuantLib {
     : process_(process), antithetic_(false),
       steps_(Null<Size>()), stepsPerYear_(Null<Size>()),
       samples_(Null<Size>()), maxSamples_(Null<Size>()),
-      tolerance_(Null<Real>()), brownianBridge_(false), seed_(0) {}
+      tolerance_(Null<Real>()), brownianBridge_(false), seed_(0),
+      importanceSampling_(false), firstPath_(0) {}
 
     template <class RNG, class S>
     inline MakeMCEuropeanEngine_2<RNG,S>&
@@ -224,6 +526,20 @@ namespace QuantLib {
         return *this;
     }
 
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withImportanceSampling(bool b) {
+        importanceSampling_ = b;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withFirstPath(BigNatural path) {
+        firstPath_ = path;
+        return *this;
+    }
+
     template <class RNG, class S>
     inline
     MakeMCEuropeanEngine_2<RNG,S>::operator boost::shared_ptr<PricingEngine>()
@@ -240,7 +556,9 @@ namespace QuantLib {
                                       antithetic_,
                                       samples_, tolerance_,
                                       maxSamples_,
-                                      seed_));
+                                      seed_,
+                                      importanceSampling_,
+                                      firstPath_));
     }
 
 
@@ -258,6 +576,30 @@ namespace QuantLib {
         return payoff_(path.back()) * discount_;
     }
 
+
+    inline ImportanceSamplingPathPricer_2::ImportanceSamplingPathPricer_2(
+                                                  Option::Type type,
+                                                  Real strike,
+                                                  DiscountFactor discount,
+                                                  Real logDrift,
+                                                  Real logStdDev,
+                                                  Real shift)
+    : payoff_(type, strike), discount_(discount), logDrift_(logDrift),
+      logStdDev_(logStdDev), shift_(shift) {
+        QL_REQUIRE(strike>=0.0,
+                   "strike less than zero not allowed");
+    }
+
+    inline Real ImportanceSamplingPathPricer_2::operator()(
+                                                  const Path& path) const {
+        QL_REQUIRE(path.length() > 0, "the path cannot be empty");
+        Real payoff = payoff_(path.back());
+        if (payoff == 0.0 || shift_ == 0.0)
+            return payoff * discount_;
+        Real y = (std::log(path.back()/path.front()) - logDrift_)/logStdDev_;
+        return payoff * discount_ * std::exp(-shift_*(y + 0.5*shift_));
+    }
+
 }
 
 
@@ -0,0 +1,500 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file mchestonengine.hpp
+    \brief Parallel Monte Carlo engine for European options under Heston
+*/
+
+#ifndef montecarlo_heston_engine_2_hpp
+#define montecarlo_heston_engine_2_hpp
+
+#include <ql/instruments/vanillaoption.hpp>
+#include <ql/math/distributions/normaldistribution.hpp>
+#include <ql/math/randomnumbers/rngtraits.hpp>
+#include <ql/math/randomnumbers/seedgenerator.hpp>
+#include <ql/processes/hestonprocess.hpp>
+#include "mcblocksimulation.hpp"
+#include <algorithm>
+#include <vector>
+
+namespace QuantLib {
+
+    //! European option pricing engine using Monte Carlo under Heston
+    /*! \ingroup vanillaengines
+
+        The log of the underlying and the variance are simulated on
+        a regular time grid with one of the following schemes:
+        - HestonProcess::QuadraticExponentialMartingale, Andersen's
+          quadratic-exponential scheme for the variance with the
+          log-spot step corrected so that the discounted underlying
+          is a martingale; a few steps per year are usually enough.
+          Where the correction is not defined, which can happen for
+          large positive correlations, the uncorrected step is used;
+        - HestonProcess::QuadraticExponential, the same without the
+          correction;
+        - HestonProcess::FullTruncation, the Euler scheme with the
+          variance floored at zero in the drift and diffusion, mostly
+          useful as a reference.
+
+        Paths are simulated in blocks of 256, with the log-spot and
+        the variance of a block stored as contiguous arrays and
+        advanced one step at a time for the whole block, so that the
+        compiler can vectorize the steps.  Each path draws the two
+        Gaussians of all its steps as one sequence, which are laid
+        out as rows of the block before the steps are taken; with
+        antithetic variates, the second half of a block uses the
+        opposite Gaussians of the first half and each pair is
+        averaged into one sample.  Threads, seeds, the first path
+        and the "blockStatistics" additional result work as in
+        MCBasketEngine_2, and the result doesn't depend on the
+        number of threads.
+
+        The numbers of paths are rounded up to whole blocks.
+
+        \warning RNG must be PseudoRandom or PhiloxRandom, since the
+                 sequences of different blocks are independent.
+    */
+    template <class RNG = PseudoRandom>
+    class MCHestonEngine_2 : public VanillaOption::engine {
+      public:
+        typedef typename RNG::rsg_type rsg_type;
+        enum { blockSize = 256 };
+        /*! If no number of threads is given, the available hardware
+            concurrency is used.
+        */
+        MCHestonEngine_2(const boost::shared_ptr<HestonProcess>& process,
+                         Size timeSteps,
+                         Size timeStepsPerYear,
+                         bool antitheticVariate,
+                         Size requiredSamples,
+                         Real requiredTolerance,
+                         Size maxSamples,
+                         BigNatural seed,
+                         HestonProcess::Discretization discretization =
+                             HestonProcess::QuadraticExponentialMartingale,
+                         Size threads = 0,
+                         BigNatural firstPath = 0);
+        void calculate() const;
+      private:
+        class Simulation;
+        boost::shared_ptr<HestonProcess> process_;
+        Size timeSteps_, timeStepsPerYear_;
+        bool antithetic_;
+        Size requiredSamples_, maxSamples_;
+        Real requiredTolerance_;
+        BigNatural seed_;
+        HestonProcess::Discretization discretization_;
+        Size threads_;
+        BigNatural firstPath_;
+        // calculation data
+        mutable boost::shared_ptr<Payoff> payoff_;
+        mutable boost::shared_ptr<PlainVanillaPayoff> vanilla_;
+        mutable Size steps_;
+        mutable Time dt_;
+        mutable std::vector<Real> drift_;
+    };
+
+
+    //! Monte Carlo Heston engine factory
+    template <class RNG = PseudoRandom>
+    class MakeMCHestonEngine_2 {
+      public:
+        MakeMCHestonEngine_2(const boost::shared_ptr<HestonProcess>&);
+        // named parameters
+        MakeMCHestonEngine_2& withSteps(Size steps);
+        MakeMCHestonEngine_2& withStepsPerYear(Size steps);
+        MakeMCHestonEngine_2& withSamples(Size samples);
+        MakeMCHestonEngine_2& withAbsoluteTolerance(Real tolerance);
+        MakeMCHestonEngine_2& withMaxSamples(Size samples);
+        MakeMCHestonEngine_2& withSeed(BigNatural seed);
+        MakeMCHestonEngine_2& withAntitheticVariate(bool b = true);
+        MakeMCHestonEngine_2& withDiscretization(
+                                      HestonProcess::Discretization d);
+        MakeMCHestonEngine_2& withThreads(Size threads);
+        MakeMCHestonEngine_2& withFirstPath(BigNatural path);
+        // conversion to pricing engine
+        operator boost::shared_ptr<PricingEngine>() const;
+      private:
+        boost::shared_ptr<HestonProcess> process_;
+        bool antithetic_;
+        Size steps_, stepsPerYear_, samples_, maxSamples_, threads_;
+        Real tolerance_;
+        BigNatural seed_, firstPath_;
+        HestonProcess::Discretization discretization_;
+    };
+
+
+    // inline definitions
+
+    template <class RNG>
+    inline MCHestonEngine_2<RNG>::MCHestonEngine_2(
+                          const boost::shared_ptr<HestonProcess>& process,
+                          Size timeSteps,
+                          Size timeStepsPerYear,
+                          bool antitheticVariate,
+                          Size requiredSamples,
+                          Real requiredTolerance,
+                          Size maxSamples,
+                          BigNatural seed,
+                          HestonProcess::Discretization discretization,
+                          Size threads,
+                          BigNatural firstPath)
+    : process_(process), timeSteps_(timeSteps),
+      timeStepsPerYear_(timeStepsPerYear), antithetic_(antitheticVariate),
+      requiredSamples_(requiredSamples), maxSamples_(maxSamples),
+      requiredTolerance_(requiredTolerance), seed_(seed),
+      discretization_(discretization), threads_(threads),
+      firstPath_(firstPath) {
+        QL_REQUIRE(process_, "no process given");
+        QL_REQUIRE(timeSteps != Null<Size>() ||
+                   timeStepsPerYear != Null<Size>(),
+                   "no time steps provided");
+        QL_REQUIRE(timeSteps == Null<Size>() ||
+                   timeStepsPerYear == Null<Size>(),
+                   "both time steps and time steps per year were provided");
+        QL_REQUIRE(timeSteps != 0,
+                   "timeSteps must be positive, " << timeSteps <<
+                   " not allowed");
+        QL_REQUIRE(timeStepsPerYear != 0,
+                   "timeStepsPerYear must be positive, "
+                   << timeStepsPerYear << " not allowed");
+        QL_REQUIRE(requiredSamples != Null<Size>() ||
+                   requiredTolerance != Null<Real>(),
+                   "neither samples nor tolerance given");
+        QL_REQUIRE(requiredSamples == Null<Size>() || requiredSamples > 0,
+                   "positive number of samples required");
+        QL_REQUIRE(requiredTolerance == Null<Real>() ||
+                   RNG::allowsErrorEstimate,
+                   "chosen random generator policy "
+                   "does not allow an error estimate");
+        QL_REQUIRE(
+            discretization == HestonProcess::QuadraticExponentialMartingale ||
+            discretization == HestonProcess::QuadraticExponential ||
+            discretization == HestonProcess::FullTruncation,
+            "unsupported discretization");
+        QL_REQUIRE(discretization == HestonProcess::FullTruncation ||
+                   process_->sigma() > 0.0,
+                   "the quadratic-exponential scheme requires "
+                   "a positive volatility of variance");
+        QL_REQUIRE(firstPath % blockSize == 0,
+                   "first path (" << firstPath << ") is not a multiple "
+                   "of the block size (" << Size(blockSize) << ")");
+        if (seed_ == 0)
+            seed_ = SeedGenerator::instance().get();
+        if (threads_ == 0)
+            threads_ = std::max<Size>(boost::thread::hardware_concurrency(),
+                                      1);
+        registerWith(process_);
+    }
+
+
+    /* Simulation of a block of paths; each worker gets a copy and
+       allocates its buffers on the first block. */
+    template <class RNG>
+    class MCHestonEngine_2<RNG>::Simulation {
+      public:
+        explicit Simulation(const MCHestonEngine_2<RNG>& engine)
+        : engine_(engine) {}
+        void operator()(Size b, Real& sum, Real& square) {
+            const MCHestonEngine_2<RNG>& e = engine_;
+            const HestonProcess& process = *e.process_;
+            Size draws = (e.antithetic_ ? blockSize/2 : blockSize);
+            if (x_.empty()) {
+                x_.resize(blockSize);
+                v_.resize(blockSize);
+                values_.resize(blockSize);
+                z_.resize(2*e.steps_*draws);
+            }
+            std::fill(x_.begin(), x_.end(),
+                      std::log(process.s0()->value()));
+            std::fill(v_.begin(), v_.end(), process.v0());
+
+            // the Gaussians of step i are rows 2i and 2i+1
+            rsg_type generator = detail::monteCarloBlockGenerator<RNG>(
+                2*e.steps_, e.seed_, 0, b, 0, blockSize);
+            for (Size q=0; q<draws; ++q) {
+                const std::vector<Real>& z = generator.nextSequence().value;
+                for (Size k=0; k<2*e.steps_; ++k)
+                    z_[k*draws+q] = z[k];
+            }
+            for (Size i=0; i<e.steps_; ++i) {
+                const Real* zv = &z_[2*i*draws];
+                const Real* zx = &z_[(2*i+1)*draws];
+                if (e.discretization_ == HestonProcess::FullTruncation)
+                    eulerStep(e.drift_[i], zv, zx, draws);
+                else
+                    quadraticExponentialStep(e.drift_[i], zv, zx, draws);
+            }
+
+            if (e.vanilla_) {
+                Real strike = e.vanilla_->strike();
+                Real omega =
+                    (e.vanilla_->optionType() == Option::Call ? 1.0 : -1.0);
+                for (Size p=0; p<blockSize; ++p)
+                    values_[p] = std::max<Real>(
+                                     omega*(std::exp(x_[p])-strike), 0.0);
+            } else {
+                for (Size p=0; p<blockSize; ++p)
+                    values_[p] = (*e.payoff_)(std::exp(x_[p]));
+            }
+
+            // antithetic pairs are averaged into one sample
+            sum = 0.0;
+            square = 0.0;
+            if (e.antithetic_) {
+                for (Size q=0; q<draws; ++q) {
+                    Real v = 0.5*(values_[q]+values_[draws+q]);
+                    sum += v;
+                    square += v*v;
+                }
+            } else {
+                for (Size p=0; p<blockSize; ++p) {
+                    sum += values_[p];
+                    square += values_[p]*values_[p];
+                }
+            }
+        }
+      private:
+        /* Full-truncation Euler step; zv and zx are the independent
+           Gaussians of the variance and of the log-spot. */
+        void eulerStep(Real drift, const Real* zv, const Real* zx,
+                       Size draws) {
+            const HestonProcess& process = *engine_.process_;
+            Real dt = engine_.dt_, kappa = process.kappa(),
+                 theta = process.theta(), sigma = process.sigma(),
+                 rho = process.rho();
+            Real sqrtDt = std::sqrt(dt), rhoBar = std::sqrt(1.0-rho*rho);
+            for (Size p=0; p<blockSize; ++p) {
+                Size q = (p < draws ? p : p - draws);
+                Real sign = (p < draws ? 1.0 : -1.0);
+                Real v = std::max<Real>(v_[p], 0.0);
+                Real sv = std::sqrt(v)*sqrtDt;
+                Real w = sign*zv[q];
+                x_[p] += drift - 0.5*v*dt + sv*(rho*w + sign*rhoBar*zx[q]);
+                v_[p] += kappa*(theta-v)*dt + sigma*sv*w;
+            }
+        }
+
+        /* Andersen's quadratic-exponential step with gamma1 = gamma2
+           = 1/2; the variance is switched at psi = 1.5 and sampled
+           from the Gaussian zv in both regimes. */
+        void quadraticExponentialStep(Real drift, const Real* zv,
+                                      const Real* zx, Size draws) {
+            const HestonProcess& process = *engine_.process_;
+            Real dt = engine_.dt_, kappa = process.kappa(),
+                 theta = process.theta(), sigma = process.sigma(),
+                 rho = process.rho();
+            bool martingale = (engine_.discretization_ ==
+                               HestonProcess::QuadraticExponentialMartingale);
+            Real ex = std::exp(-kappa*dt);
+            Real c1 = sigma*sigma*ex*(1.0-ex)/kappa;
+            Real c2 = theta*sigma*sigma*(1.0-ex)*(1.0-ex)/(2.0*kappa);
+            Real k0 = -rho*kappa*theta*dt/sigma;
+            Real k1 = 0.5*dt*(kappa*rho/sigma - 0.5) - rho/sigma;
+            Real k2 = 0.5*dt*(kappa*rho/sigma - 0.5) + rho/sigma;
+            Real k3 = 0.5*dt*(1.0-rho*rho);
+            Real A = k2 + 0.5*k3;
+            for (Size p=0; p<blockSize; ++p) {
+                Size q = (p < draws ? p : p - draws);
+                Real sign = (p < draws ? 1.0 : -1.0);
+                Real v = v_[p];
+                Real m = theta + (v-theta)*ex;
+                Real s2 = v*c1 + c2;
+                Real psi = s2/(m*m);
+                Real w = sign*zv[q], vNext, correction = k0;
+                if (psi <= 1.5) {
+                    Real r = 2.0/psi;
+                    Real b2 = r - 1.0 + std::sqrt(r*(r-1.0));
+                    Real a = m/(1.0+b2), b = std::sqrt(b2);
+                    vNext = a*(b+w)*(b+w);
+                    if (martingale && A < 0.5/a)
+                        correction = -A*b2*a/(1.0-2.0*A*a)
+                            + 0.5*std::log(1.0-2.0*A*a) - (k1+0.5*k3)*v;
+                } else {
+                    Real pr = (psi-1.0)/(psi+1.0);
+                    Real beta = (1.0-pr)/m;
+                    // 1-U from the upper tail, to keep its precision
+                    Real tail = cumulative_(-w);
+                    vNext = (tail >= 1.0-pr ? 0.0
+                                            : std::log((1.0-pr)/tail)/beta);
+                    if (martingale && A < beta)
+                        correction = -std::log(pr + beta*(1.0-pr)/(beta-A))
+                            - (k1+0.5*k3)*v;
+                }
+                x_[p] += drift + correction + k1*v + k2*vNext
+                    + std::sqrt(k3*(v+vNext))*sign*zx[q];
+                v_[p] = vNext;
+            }
+        }
+
+        const MCHestonEngine_2<RNG>& engine_;
+        CumulativeNormalDistribution cumulative_;
+        std::vector<Real> x_, v_, values_, z_;
+    };
+
+
+    template <class RNG>
+    inline void MCHestonEngine_2<RNG>::calculate() const {
+
+        QL_REQUIRE(arguments_.exercise->type() == Exercise::European,
+                   "not a European option");
+        payoff_ = arguments_.payoff;
+        QL_REQUIRE(payoff_, "no payoff given");
+        vanilla_ = boost::dynamic_pointer_cast<PlainVanillaPayoff>(payoff_);
+
+        Time maturity = process_->time(arguments_.exercise->lastDate());
+        QL_REQUIRE(maturity > 0.0, "expired option");
+        if (timeSteps_ != Null<Size>())
+            steps_ = timeSteps_;
+        else
+            steps_ = std::max<Size>(Size(timeStepsPerYear_*maturity), 1);
+        dt_ = maturity/steps_;
+
+        // log-forward drift of each step from the term structures
+        const Handle<YieldTermStructure>& riskFree =
+            process_->riskFreeRate();
+        const Handle<YieldTermStructure>& dividends =
+            process_->dividendYield();
+        drift_.resize(steps_);
+        for (Size i=0; i<steps_; ++i) {
+            Time t0 = i*dt_, t1 = (i+1)*dt_;
+            drift_[i] = std::log(dividends->discount(t1)/
+                                 dividends->discount(t0)
+                                 * riskFree->discount(t0)/
+                                 riskFree->discount(t1));
+        }
+
+        BlockStatistics statistics = detail::simulateBlocks(
+            Simulation(*this), blockSize,
+            antithetic_ ? blockSize/2 : blockSize, firstPath_/blockSize,
+            requiredSamples_, requiredTolerance_, maxSamples_,
+            riskFree->discount(maturity), threads_);
+        results_.value = statistics.mean();
+        if (RNG::allowsErrorEstimate && statistics.samples() > 1)
+            results_.errorEstimate = statistics.errorEstimate();
+        results_.additionalResults["blockStatistics"] = statistics;
+    }
+
+
+    template <class RNG>
+    inline MakeMCHestonEngine_2<RNG>::MakeMCHestonEngine_2(
+                          const boost::shared_ptr<HestonProcess>& process)
+    : process_(process), antithetic_(false),
+      steps_(Null<Size>()), stepsPerYear_(Null<Size>()),
+      samples_(Null<Size>()), maxSamples_(Null<Size>()), threads_(0),
+      tolerance_(Null<Real>()), seed_(0), firstPath_(0),
+      discretization_(HestonProcess::QuadraticExponentialMartingale) {}
+
+    template <class RNG>
+    inline MakeMCHestonEngine_2<RNG>&
+    MakeMCHestonEngine_2<RNG>::withSteps(Size steps) {
+        steps_ = steps;
+        return *this;
+    }
+
+    template <class RNG>
+    inline MakeMCHestonEngine_2<RNG>&
+    MakeMCHestonEngine_2<RNG>::withStepsPerYear(Size steps) {
+        stepsPerYear_ = steps;
+        return *this;
+    }
+
+    template <class RNG>
+    inline MakeMCHestonEngine_2<RNG>&
+    MakeMCHestonEngine_2<RNG>::withSamples(Size samples) {
+        QL_REQUIRE(tolerance_ == Null<Real>(),
+                   "tolerance already set");
+        samples_ = samples;
+        return *this;
+    }
+
+    template <class RNG>
+    inline MakeMCHestonEngine_2<RNG>&
+    MakeMCHestonEngine_2<RNG>::withAbsoluteTolerance(Real tolerance) {
+        QL_REQUIRE(samples_ == Null<Size>(),
+                   "number of samples already set");
+        QL_REQUIRE(RNG::allowsErrorEstimate,
+                   "chosen random generator policy "
+                   "does not allow an error estimate");
+        tolerance_ = tolerance;
+        return *this;
+    }
+
+    template <class RNG>
+    inline MakeMCHestonEngine_2<RNG>&
+    MakeMCHestonEngine_2<RNG>::withMaxSamples(Size samples) {
+        maxSamples_ = samples;
+        return *this;
+    }
+
+    template <class RNG>
+    inline MakeMCHestonEngine_2<RNG>&
+    MakeMCHestonEngine_2<RNG>::withSeed(BigNatural seed) {
+        seed_ = seed;
+        return *this;
+    }
+
+    template <class RNG>
+    inline MakeMCHestonEngine_2<RNG>&
+    MakeMCHestonEngine_2<RNG>::withAntitheticVariate(bool b) {
+        antithetic_ = b;
+        return *this;
+    }
+
+    template <class RNG>
+    inline MakeMCHestonEngine_2<RNG>&
+    MakeMCHestonEngine_2<RNG>::withDiscretization(
+                                       HestonProcess::Discretization d) {
+        discretization_ = d;
+        return *this;
+    }
+
+    template <class RNG>
+    inline MakeMCHestonEngine_2<RNG>&
+    MakeMCHestonEngine_2<RNG>::withThreads(Size threads) {
+        threads_ = threads;
+        return *this;
+    }
+
+    template <class RNG>
+    inline MakeMCHestonEngine_2<RNG>&
+    MakeMCHestonEngine_2<RNG>::withFirstPath(BigNatural path) {
+        firstPath_ = path;
+        return *this;
+    }
+
+    template <class RNG>
+    inline
+    MakeMCHestonEngine_2<RNG>::operator boost::shared_ptr<PricingEngine>()
+                                                                      const {
+        return boost::shared_ptr<PricingEngine>(new
+            MCHestonEngine_2<RNG>(process_,
+                                  steps_,
+                                  stepsPerYear_,
+                                  antithetic_,
+                                  samples_, tolerance_,
+                                  maxSamples_,
+                                  seed_,
+                                  discretization_,
+                                  threads_,
+                                  firstPath_));
+    }
+
+}
+
+
+#endif
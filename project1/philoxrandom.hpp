@@ -0,0 +1,218 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file philoxrandom.hpp
+    \brief Counter-based Gaussian sequences with random access by path
+*/
+
+#ifndef philox_random_hpp
+#define philox_random_hpp
+
+#include <ql/mathconstants.hpp>
+#include <ql/math/randomnumbers/seedgenerator.hpp>
+#include <ql/methods/montecarlo/sample.hpp>
+#include <boost/cstdint.hpp>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace QuantLib {
+
+    //! Philox-4x32-10 counter-based random bits
+    /*! Maps a 128-bit counter and a 64-bit key to 128 random bits
+        with ten rounds of the Philox bijection; see J.K. Salmon et
+        al., "Parallel random numbers: as easy as 1, 2, 3", SC11.
+        There's no state: any counter can be evaluated directly.
+
+        generate() evaluates a batch of counters differing in their
+        first word; its loops run across the batch, so that the
+        compiler can vectorize them.
+    */
+    class Philox4x32 {
+      public:
+        typedef boost::uint32_t word;
+        enum { rounds = 10, batch = 8 };
+        /*! sets out[4*i] ... out[4*i+3] to the bits of the counter
+            (first + i, c1, c2, c3) for i < batch */
+        static void generate(word first, word c1, word c2, word c3,
+                             const word key[2], word out[4*batch]);
+    };
+
+
+    //! Gaussian sequences drawn from Philox by path index
+    /*! Variate d of path p depends only on the seed, p and d: pairs
+        of variates are obtained by Box-Muller from the bits of the
+        counter (d/2, 0, p mod 2^32, p / 2^32) with the seed as key.
+        Skipping to any path is thus O(1), and a simulation split in
+        ranges of paths, among threads or processes, draws exactly
+        the variates of a single sequential run.
+
+        nextSequence() returns path after path, starting from the
+        first path passed to the constructor or to skipTo().
+
+        As for other QuantLib generators, a null seed is replaced by
+        one drawn from the SeedGenerator.
+    */
+    class PhiloxGaussianRsg {
+      public:
+        typedef Sample<std::vector<Real> > sample_type;
+        explicit PhiloxGaussianRsg(Size dimensionality,
+                                   BigNatural seed = 0,
+                                   BigNatural firstPath = 0);
+        const sample_type& nextSequence() const;
+        const sample_type& lastSequence() const { return sequence_; }
+        Size dimension() const { return dimensionality_; }
+        //! the next call to nextSequence() returns the given path
+        void skipTo(BigNatural path) { path_ = path; }
+        BigNatural nextPath() const { return path_; }
+        //! writes the dimension() variates of the given path
+        void variates(BigNatural path, Real* output) const;
+      private:
+        Size dimensionality_;
+        Philox4x32::word key_[2];
+        mutable BigNatural path_;
+        mutable sample_type sequence_;
+    };
+
+
+    //! Philox generator policy for the Monte Carlo engines
+    /*! Can be used as the RNG parameter of the engines in place of
+        PseudoRandom.
+    */
+    struct PhiloxRandom {
+        typedef PhiloxGaussianRsg rsg_type;
+        enum { allowsErrorEstimate = 1 };
+        static rsg_type make_sequence_generator(Size dimension,
+                                                BigNatural seed,
+                                                BigNatural firstPath = 0) {
+            return rsg_type(dimension, seed, firstPath);
+        }
+    };
+
+
+    //! Sequence generator of the given policy starting at a given path
+    /*! Only policies with random access by path, such as
+        PhiloxRandom, can start elsewhere than at the first path.
+    */
+    template <class RNG>
+    typename RNG::rsg_type makeSequenceGenerator(Size dimension,
+                                                 BigNatural seed,
+                                                 BigNatural firstPath) {
+        QL_REQUIRE(firstPath == 0,
+                   "the random-number policy can't skip to path "
+                   << firstPath);
+        return RNG::make_sequence_generator(dimension, seed);
+    }
+
+    template <>
+    inline PhiloxRandom::rsg_type makeSequenceGenerator<PhiloxRandom>(
+                                                      Size dimension,
+                                                      BigNatural seed,
+                                                      BigNatural firstPath) {
+        return PhiloxRandom::make_sequence_generator(dimension, seed,
+                                                     firstPath);
+    }
+
+
+    // inline definitions
+
+    inline void Philox4x32::generate(word first, word c1, word c2, word c3,
+                                     const word key[2],
+                                     word out[4*batch]) {
+        const boost::uint64_t m0 = 0xD2511F53, m1 = 0xCD9E8D57;
+        const word w0 = 0x9E3779B9, w1 = 0xBB67AE85;
+        word x0[batch], x1[batch], x2[batch], x3[batch];
+        for (Size i=0; i<batch; ++i) {
+            x0[i] = first + word(i);
+            x1[i] = c1;
+            x2[i] = c2;
+            x3[i] = c3;
+        }
+        word k0 = key[0], k1 = key[1];
+        for (Size r=0; r<rounds; ++r) {
+            for (Size i=0; i<batch; ++i) {
+                boost::uint64_t p0 = m0*x0[i], p1 = m1*x2[i];
+                word y0 = word(p1 >> 32) ^ x1[i] ^ k0;
+                word y1 = word(p1);
+                word y2 = word(p0 >> 32) ^ x3[i] ^ k1;
+                word y3 = word(p0);
+                x0[i] = y0;
+                x1[i] = y1;
+                x2[i] = y2;
+                x3[i] = y3;
+            }
+            k0 += w0;
+            k1 += w1;
+        }
+        for (Size i=0; i<batch; ++i) {
+            out[4*i] = x0[i];
+            out[4*i+1] = x1[i];
+            out[4*i+2] = x2[i];
+            out[4*i+3] = x3[i];
+        }
+    }
+
+
+    inline PhiloxGaussianRsg::PhiloxGaussianRsg(Size dimensionality,
+                                                BigNatural seed,
+                                                BigNatural firstPath)
+    : dimensionality_(dimensionality), path_(firstPath),
+      sequence_(std::vector<Real>(dimensionality), 1.0) {
+        QL_REQUIRE(dimensionality > 0, "null dimensionality");
+        boost::uint64_t s =
+            (seed != 0 ? seed : SeedGenerator::instance().get());
+        key_[0] = Philox4x32::word(s);
+        key_[1] = Philox4x32::word(s >> 32);
+    }
+
+    inline const PhiloxGaussianRsg::sample_type&
+    PhiloxGaussianRsg::nextSequence() const {
+        variates(path_++, &sequence_.value[0]);
+        return sequence_;
+    }
+
+    inline void PhiloxGaussianRsg::variates(BigNatural path,
+                                            Real* output) const {
+        typedef Philox4x32::word word;
+        const Size batch = Philox4x32::batch;
+        const Real twoPi = 2.0*M_PI, scale = 1.0/9007199254740992.0;
+        word c2 = word(path), c3 = word(boost::uint64_t(path) >> 32);
+        word bits[4*batch];
+        Real radius[batch], angle[batch];
+        for (Size d=0; d<dimensionality_; d+=2*batch) {
+            Philox4x32::generate(word(d/2), 0, c2, c3, key_, bits);
+            // two 53-bit uniforms in (0,1) from each counter
+            for (Size i=0; i<batch; ++i) {
+                Real u1 = (Real((boost::uint64_t(bits[4*i]) << 21) |
+                                (bits[4*i+1] >> 11)) + 0.5)*scale;
+                Real u2 = (Real((boost::uint64_t(bits[4*i+2]) << 21) |
+                                (bits[4*i+3] >> 11)) + 0.5)*scale;
+                radius[i] = std::sqrt(-2.0*std::log(u1));
+                angle[i] = twoPi*u2;
+            }
+            Size n = std::min<Size>(2*batch, dimensionality_ - d);
+            for (Size i=0; i<n; ++i)
+                output[d+i] = radius[i/2]*(i % 2 == 0 ?
+                                           std::cos(angle[i/2]) :
+                                           std::sin(angle[i/2]));
+        }
+    }
+
+}
+
+
+#endif
@@ -0,0 +1,291 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+#include "asyncpricer.hpp"
+#include "../common/pricingmonitor.hpp"
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <algorithm>
+#include <map>
+#include <queue>
+
+namespace QuantLib {
+
+    namespace detail {
+
+        // state shared by a ticket and the pricer; it also monitors
+        // the engine while the pricing runs
+        class AsyncPricing : public PricingMonitor {
+          public:
+            typedef AsyncPricer::clock clock;
+            AsyncPricing(const ext::shared_ptr<VanillaOption>& option,
+                         const ext::shared_ptr<PortfolioEngineFactory>& engine,
+                         clock::time_point deadline,
+                         const AsyncPricer::ProgressCallback& callback)
+            : option(option), engine(engine), deadline(deadline),
+              callback(callback), cancelRequested(false) {}
+            void progress(Size done, Size total) {
+                if (callback)
+                    callback(done, total);
+            }
+            bool cancelled() const {
+                return cancelRequested.load() || clock::now() >= deadline;
+            }
+            // reason for stopping, if cancelled() returned true
+            std::string reason() const {
+                return cancelRequested.load() ? "pricing cancelled"
+                                              : "deadline expired";
+            }
+            ext::shared_ptr<VanillaOption> option;
+            ext::shared_ptr<PortfolioEngineFactory> engine;
+            clock::time_point deadline;
+            AsyncPricer::ProgressCallback callback;
+            boost::atomic<bool> cancelRequested;
+            boost::promise<PortfolioResult> promise;
+        };
+
+    }
+
+
+    namespace {
+
+        struct QueuedPricing {
+            AsyncPricer::clock::time_point deadline;
+            unsigned long sequence;
+            ext::shared_ptr<detail::AsyncPricing> pricing;
+            // the top of a priority queue is the greatest element
+            bool operator<(const QueuedPricing& other) const {
+                if (deadline != other.deadline)
+                    return deadline > other.deadline;
+                return sequence > other.sequence;
+            }
+        };
+
+        typedef std::map<const PortfolioEngineFactory*,
+                         std::pair<ext::shared_ptr<PortfolioEngineFactory>,
+                                   ext::shared_ptr<PricingEngine> > >
+            EngineMap;
+
+        // sets the monitor of an engine for the duration of a pricing
+        class MonitorGuard {
+          public:
+            MonitorGuard(PricingEngine& engine,
+                         const ext::shared_ptr<PricingMonitor>& monitor)
+            : engine_(dynamic_cast<MonitoredEngine*>(&engine)) {
+                if (engine_)
+                    engine_->setMonitor(monitor);
+            }
+            ~MonitorGuard() {
+                if (engine_)
+                    engine_->setMonitor(ext::shared_ptr<PricingMonitor>());
+            }
+          private:
+            MonitoredEngine* engine_;
+        };
+
+    }
+
+
+    class AsyncPricer::Impl {
+      public:
+        explicit Impl(Size threads)
+        : threads_(threads), stopping_(false), sequence_(0),
+          engines_(threads), running_(threads) {}
+
+        void start() {
+            for (Size k=0; k<threads_; ++k)
+                workers_.create_thread(boost::bind(&Impl::work, this, k));
+        }
+
+        void submit(const ext::shared_ptr<detail::AsyncPricing>& pricing) {
+            boost::mutex::scoped_lock lock(mutex_);
+            QueuedPricing entry;
+            entry.deadline = pricing->deadline;
+            entry.sequence = sequence_++;
+            entry.pricing = pricing;
+            queue_.push(entry);
+            condition_.notify_one();
+        }
+
+        void stop() {
+            std::vector<ext::shared_ptr<detail::AsyncPricing> > dropped;
+            {
+                boost::mutex::scoped_lock lock(mutex_);
+                stopping_ = true;
+                while (!queue_.empty()) {
+                    dropped.push_back(queue_.top().pricing);
+                    queue_.pop();
+                }
+                for (Size k=0; k<threads_; ++k)
+                    if (running_[k])
+                        running_[k]->cancelRequested = true;
+                condition_.notify_all();
+            }
+            for (Size i=0; i<dropped.size(); ++i) {
+                PortfolioResult result;
+                result.error = "pricing cancelled";
+                dropped[i]->promise.set_value(result);
+            }
+            workers_.join_all();
+        }
+
+        Size threads() const { return threads_; }
+
+        Size pending() const {
+            boost::mutex::scoped_lock lock(mutex_);
+            return queue_.size();
+        }
+
+      private:
+        void work(Size index) {
+            for (;;) {
+                ext::shared_ptr<detail::AsyncPricing> pricing;
+                {
+                    boost::mutex::scoped_lock lock(mutex_);
+                    while (queue_.empty() && !stopping_)
+                        condition_.wait(lock);
+                    if (stopping_)
+                        return;
+                    pricing = queue_.top().pricing;
+                    queue_.pop();
+                    running_[index] = pricing;
+                }
+                price(index, pricing);
+                boost::mutex::scoped_lock lock(mutex_);
+                running_[index].reset();
+            }
+        }
+
+        const ext::shared_ptr<PricingEngine>& engine(
+                 Size index,
+                 const ext::shared_ptr<PortfolioEngineFactory>& factory) {
+            std::pair<ext::shared_ptr<PortfolioEngineFactory>,
+                      ext::shared_ptr<PricingEngine> >& entry =
+                engines_[index][factory.get()];
+            if (!entry.second) {
+                // engines register with the process as observers,
+                // which is not a thread-safe operation
+                boost::mutex::scoped_lock lock(registration_);
+                entry.first = factory;
+                entry.second = factory->create();
+            }
+            return entry.second;
+        }
+
+        void price(Size index,
+                   const ext::shared_ptr<detail::AsyncPricing>& pricing) {
+            PortfolioResult result;
+            result.worker = index;
+            clock::time_point start = clock::now();
+            try {
+                if (pricing->cancelled())
+                    throw PricingCancelled();
+                QL_REQUIRE(pricing->option, "no option given");
+                QL_REQUIRE(pricing->engine, "no engine given");
+                const ext::shared_ptr<PricingEngine>& e =
+                    engine(index, pricing->engine);
+                MonitorGuard guard(*e, pricing);
+                e->reset();
+                pricing->option->setupArguments(e->getArguments());
+                e->getArguments()->validate();
+                e->calculate();
+
+                const OneAssetOption::results* r =
+                    dynamic_cast<const OneAssetOption::results*>(
+                                                          e->getResults());
+                QL_ENSURE(r != 0, "no results returned from engine");
+                result.value = r->value;
+                result.errorEstimate = r->errorEstimate;
+                result.delta = r->delta;
+                result.gamma = r->gamma;
+                result.theta = r->theta;
+                result.vega = r->vega;
+                result.rho = r->rho;
+                result.dividendRho = r->dividendRho;
+            } catch (PricingCancelled&) {
+                result = PortfolioResult();
+                result.worker = index;
+                result.error = pricing->reason();
+            } catch (std::exception& e) {
+                result.error = e.what();
+            } catch (...) {
+                result.error = "unknown error";
+            }
+            result.seconds =
+                boost::chrono::duration<double>(clock::now()-start).count();
+            pricing->promise.set_value(result);
+        }
+
+        Size threads_;
+        mutable boost::mutex mutex_;
+        boost::condition_variable condition_;
+        std::priority_queue<QueuedPricing> queue_;
+        bool stopping_;
+        unsigned long sequence_;
+        // the engines outlive the threads, so that they are also
+        // unregistered from their processes on the owner's thread
+        std::vector<EngineMap> engines_;
+        std::vector<ext::shared_ptr<detail::AsyncPricing> > running_;
+        boost::mutex registration_;
+        boost::thread_group workers_;
+    };
+
+
+    void PricingTicket::cancel() {
+        if (pricing_)
+            pricing_->cancelRequested = true;
+    }
+
+
+    AsyncPricer::AsyncPricer(Size threads) {
+        if (threads == 0)
+            threads = std::max<Size>(boost::thread::hardware_concurrency(),
+                                     1);
+        impl_ = ext::shared_ptr<Impl>(new Impl(threads));
+        impl_->start();
+    }
+
+    AsyncPricer::~AsyncPricer() {
+        impl_->stop();
+    }
+
+    PricingTicket AsyncPricer::priceAsync(
+                 const ext::shared_ptr<VanillaOption>& option,
+                 const ext::shared_ptr<PortfolioEngineFactory>& engine,
+                 clock::time_point deadline,
+                 const ProgressCallback& progress) {
+        ext::shared_ptr<detail::AsyncPricing> pricing(
+              new detail::AsyncPricing(option, engine, deadline, progress));
+        PricingTicket ticket;
+        ticket.pricing_ = pricing;
+        ticket.result_ = pricing->promise.get_future();
+        impl_->submit(pricing);
+        return ticket;
+    }
+
+    Size AsyncPricer::threads() const {
+        return impl_->threads();
+    }
+
+    Size AsyncPricer::pending() const {
+        return impl_->pending();
+    }
+
+}
@@ -0,0 +1,108 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file asyncpricer.hpp
+    \brief Non-blocking pricing of vanilla options on a shared executor
+*/
+
+#ifndef async_pricer_hpp
+#define async_pricer_hpp
+
+#include "portfoliopricer.hpp"
+#include <boost/chrono.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/future.hpp>
+
+namespace QuantLib {
+
+    namespace detail {
+
+        class AsyncPricing;
+
+    }
+
+
+    //! Handle on a pricing submitted to the AsyncPricer
+    /*! The result becomes ready when the pricing is over, whether it
+        succeeded, failed, was cancelled or missed its deadline; in
+        the last three cases, the error field of the result says why.
+    */
+    class PricingTicket {
+      public:
+        const boost::shared_future<PortfolioResult>& result() const {
+            return result_;
+        }
+        /*! pricings still queued are dropped; running ones stop at
+            the next check if their engine is a MonitoredEngine, and
+            run to completion otherwise.
+        */
+        void cancel();
+      private:
+        friend class AsyncPricer;
+        ext::shared_ptr<detail::AsyncPricing> pricing_;
+        boost::shared_future<PortfolioResult> result_;
+    };
+
+
+    //! Asynchronous pricer for vanilla options
+    /*! priceAsync() queues the pricing and returns at once; a pool
+        of worker threads takes the queued pricings by earliest
+        deadline, then in order of submission.  A pricing whose
+        deadline has passed is not started, and monitored engines
+        (e.g., MCEuropeanEngine_2) are stopped when it passes.  The
+        progress callback, if any, is called by monitored engines on
+        the worker thread.
+
+        As in the PortfolioPricer, each worker builds its own engines
+        from the configurations it encounters and keeps them, along
+        with the configurations, for the lifetime of the pricer;
+        configurations should therefore be reused across pricings.
+
+        \warning market data must not change while pricings are in
+                 flight, and lazy term structures should be calculated
+                 beforehand since they are read concurrently by the
+                 workers.
+    */
+    class AsyncPricer : private boost::noncopyable {
+      public:
+        typedef boost::chrono::steady_clock clock;
+        //! called with the work done and the total, if known
+        typedef boost::function<void (Size, Size)> ProgressCallback;
+        /*! if no number of threads is given, the available hardware
+            concurrency is used.
+        */
+        explicit AsyncPricer(Size threads = 0);
+        //! cancels the pending pricings and waits for the workers
+        ~AsyncPricer();
+        PricingTicket priceAsync(
+                 const ext::shared_ptr<VanillaOption>& option,
+                 const ext::shared_ptr<PortfolioEngineFactory>& engine,
+                 clock::time_point deadline = clock::time_point::max(),
+                 const ProgressCallback& progress = ProgressCallback());
+        Size threads() const;
+        //! number of pricings queued and not yet started
+        Size pending() const;
+      private:
+        class Impl;
+        ext::shared_ptr<Impl> impl_;
+    };
+
+}
+
+
+#endif
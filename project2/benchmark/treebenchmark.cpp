@@ -0,0 +1,418 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*  Node-level benchmark of the Extended trees of project 2 against
+    the constant-parameter trees of project 3.
+
+    For each model, implementation, process and number of steps, the
+    program times the tree construction, a sweep of underlying() and
+    of probability() over all the nodes, and the rollback of a
+    European put, and prints the time per node in nanoseconds.
+
+    It is a separate program; build it together with
+    ../extendedbinomialtree.cpp and ../../project3/binomialtree.cpp.
+
+    usage: treebenchmark [--baseline file] [--update] [--tolerance x]
+
+    Timings are compared with the ones stored in the baseline file
+    (treebenchmark.baseline by default) and those slower by more
+    than the tolerance (0.10, i.e., 10%, by default) are flagged;
+    the program then returns 1.  With --update, the current timings
+    are written to the baseline file instead.  Baselines are only
+    meaningful on the machine and with the compiler flags they were
+    produced with, so none is stored in the repository.
+*/
+
+#include "../extendedbinomialtree.hpp"
+#include "../../project3/binomialtree.hpp"
+#include <ql/processes/blackscholesprocess.hpp>
+#include <ql/quotes/simplequote.hpp>
+#include <ql/termstructures/yield/flatforward.hpp>
+#include <ql/termstructures/yield/zerocurve.hpp>
+#include <ql/termstructures/volatility/equityfx/blackconstantvol.hpp>
+#include <ql/termstructures/volatility/equityfx/blackvariancecurve.hpp>
+#include <ql/time/calendars/target.hpp>
+#include <ql/time/daycounters/actual365fixed.hpp>
+
+#include <boost/chrono.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace QuantLib;
+
+namespace {
+
+    typedef boost::chrono::steady_clock clock_type;
+
+    // results are accumulated here so that the timed loops are not
+    // optimized away
+    volatile Real sink = 0.0;
+
+    const Time maturity = 1.0;
+    const Real strike = 40.0;
+
+    Size nodes(Size columns) {
+        return columns*(columns+1)/2;
+    }
+
+
+    // timed operations; each returns a value depending on all the
+    // work it did
+
+    template <class T>
+    class Construction {
+      public:
+        Construction(const ext::shared_ptr<StochasticProcess1D>& process,
+                     Size steps)
+        : process_(process), steps_(steps) {}
+        Real operator()() const {
+            T tree(process_, maturity, steps_, strike);
+            return tree.underlying(0, 0);
+        }
+      private:
+        ext::shared_ptr<StochasticProcess1D> process_;
+        Size steps_;
+    };
+
+    template <class T>
+    class UnderlyingSweep {
+      public:
+        explicit UnderlyingSweep(const T& tree) : tree_(tree) {}
+        Real operator()() const {
+            Real sum = 0.0;
+            for (Size i=0; i<tree_.columns(); ++i)
+                for (Size j=0; j<tree_.size(i); ++j)
+                    sum += tree_.underlying(i, j);
+            return sum;
+        }
+      private:
+        const T& tree_;
+    };
+
+    template <class T>
+    class ProbabilitySweep {
+      public:
+        explicit ProbabilitySweep(const T& tree) : tree_(tree) {}
+        Real operator()() const {
+            Real sum = 0.0;
+            for (Size i=0; i<tree_.columns(); ++i)
+                for (Size j=0; j<tree_.size(i); ++j)
+                    sum += tree_.probability(i, j, 0)
+                         + tree_.probability(i, j, 1);
+            return sum;
+        }
+      private:
+        const T& tree_;
+    };
+
+    // European put rolled back through the generic tree interface,
+    // as a lattice would do
+    template <class T>
+    class Rollback {
+      public:
+        Rollback(const T& tree, DiscountFactor discount)
+        : tree_(tree), discount_(discount), values_(tree.columns()) {}
+        Real operator()() const {
+            Size n = tree_.columns()-1;
+            for (Size j=0; j<tree_.size(n); ++j)
+                values_[j] = std::max(strike - tree_.underlying(n, j), 0.0);
+            for (Size i=n; i>0; --i) {
+                Size k = i-1;
+                for (Size j=0; j<tree_.size(k); ++j)
+                    values_[j] = discount_ *
+                        (tree_.probability(k, j, 0)*values_[j] +
+                         tree_.probability(k, j, 1)*values_[j+1]);
+            }
+            return values_[0];
+        }
+      private:
+        const T& tree_;
+        DiscountFactor discount_;
+        mutable std::vector<Real> values_;
+    };
+
+
+    // runs the operation until at least minTime seconds have passed,
+    // three times, and returns the best time per node
+    template <class Operation>
+    double nanosecondsPerNode(const Operation& operation, Size nodeCount) {
+        const double minTime = 0.02;
+        double best = 0.0;
+        for (Size k=0; k<3; ++k) {
+            Size runs = 0;
+            double elapsed = 0.0;
+            clock_type::time_point start = clock_type::now();
+            do {
+                sink = sink + operation();
+                ++runs;
+                elapsed = boost::chrono::duration<double>(
+                                          clock_type::now()-start).count();
+            } while (elapsed < minTime);
+            double ns = 1.0e9*elapsed/(double(runs)*nodeCount);
+            if (k == 0 || ns < best)
+                best = ns;
+        }
+        return best;
+    }
+
+
+    class Report {
+      public:
+        Report(const std::map<std::string, double>& baseline,
+               double tolerance)
+        : baseline_(baseline), tolerance_(tolerance), regressions_(0) {
+            std::cout << std::setw(widths[0]) << std::left << "Benchmark"
+                      << std::setw(widths[1]) << std::right << "ns/node"
+                      << std::setw(widths[2]) << std::right << "baseline"
+                      << std::setw(widths[3]) << std::right << "change"
+                      << std::endl;
+        }
+        void add(const std::string& name, double ns) {
+            results_[name] = ns;
+            std::cout << std::setw(widths[0]) << std::left << name
+                      << std::fixed << std::setprecision(3)
+                      << std::setw(widths[1]) << std::right << ns;
+            std::map<std::string, double>::const_iterator i =
+                baseline_.find(name);
+            if (i != baseline_.end() && i->second > 0.0) {
+                double change = ns/i->second - 1.0;
+                std::cout << std::setw(widths[2]) << std::right << i->second
+                          << std::setw(widths[3]-1) << std::right
+                          << std::showpos << 100.0*change << std::noshowpos
+                          << "%";
+                // construction costs a tiny fraction of a nanosecond
+                // per node for some trees, where relative changes are
+                // mostly noise
+                if (change > tolerance_ && ns - i->second > 0.01) {
+                    std::cout << "  REGRESSION";
+                    ++regressions_;
+                }
+            }
+            std::cout << std::endl;
+        }
+        const std::map<std::string, double>& results() const {
+            return results_;
+        }
+        Size regressions() const { return regressions_; }
+      private:
+        static const Size widths[4];
+        std::map<std::string, double> baseline_, results_;
+        double tolerance_;
+        Size regressions_;
+    };
+
+    const Size Report::widths[4] = { 50, 12, 12, 10 };
+
+
+    template <class T>
+    void benchmark(const std::string& name,
+                   const ext::shared_ptr<GeneralizedBlackScholesProcess>&
+                                                                    process,
+                   Size steps,
+                   Report& report) {
+        T tree(process, maturity, steps, strike);
+        // some trees adjust the number of steps
+        Size columns = tree.columns();
+        Size count = nodes(columns);
+        DiscountFactor discount =
+            process->riskFreeRate()->discount(maturity/(columns-1));
+
+        report.add(name + "/construction",
+                   nanosecondsPerNode(Construction<T>(process, steps),
+                                      count));
+        report.add(name + "/underlying",
+                   nanosecondsPerNode(UnderlyingSweep<T>(tree), count));
+        report.add(name + "/probability",
+                   nanosecondsPerNode(ProbabilitySweep<T>(tree), count));
+        report.add(name + "/rollback",
+                   nanosecondsPerNode(Rollback<T>(tree, discount), count));
+    }
+
+    template <class Extended, class Constant>
+    void benchmarkModel(const std::string& model,
+                        const std::string& processName,
+                        const ext::shared_ptr<GeneralizedBlackScholesProcess>&
+                                                                    process,
+                        Size steps,
+                        Report& report) {
+        std::ostringstream suffix;
+        suffix << "/" << steps;
+        benchmark<Extended>(processName + "/" + model + "/Extended" +
+                            suffix.str(), process, steps, report);
+        benchmark<Constant>(processName + "/" + model + "/_2" +
+                            suffix.str(), process, steps, report);
+    }
+
+
+    std::map<std::string, double> readBaseline(const std::string& file) {
+        std::map<std::string, double> baseline;
+        std::ifstream in(file.c_str());
+        std::string name;
+        double ns;
+        while (in >> name >> ns)
+            baseline[name] = ns;
+        return baseline;
+    }
+
+    void writeBaseline(const std::string& file,
+                       const std::map<std::string, double>& results) {
+        std::ofstream out(file.c_str());
+        QL_REQUIRE(out, "cannot write " << file);
+        out << std::setprecision(6);
+        for (std::map<std::string, double>::const_iterator i =
+                 results.begin(); i != results.end(); ++i)
+            out << i->first << " " << i->second << "\n";
+    }
+
+}
+
+
+int main(int argc, char* argv[]) {
+
+    try {
+
+        std::string baselineFile = "treebenchmark.baseline";
+        bool update = false;
+        double tolerance = 0.10;
+        for (int i=1; i<argc; ++i) {
+            if (std::strcmp(argv[i], "--baseline") == 0 && i+1 < argc)
+                baselineFile = argv[++i];
+            else if (std::strcmp(argv[i], "--update") == 0)
+                update = true;
+            else if (std::strcmp(argv[i], "--tolerance") == 0 && i+1 < argc)
+                tolerance = std::atof(argv[++i]);
+            else
+                QL_FAIL("usage: " << argv[0] << " [--baseline file]"
+                        " [--update] [--tolerance x]");
+        }
+
+        // market data
+        Calendar calendar = TARGET();
+        DayCounter dayCounter = Actual365Fixed();
+        Date todaysDate(15, May, 1998);
+        Settings::instance().evaluationDate() = todaysDate;
+
+        Handle<Quote> underlyingH(
+            ext::shared_ptr<Quote>(new SimpleQuote(36.0)));
+        Handle<YieldTermStructure> flatDividendTS(
+            ext::shared_ptr<YieldTermStructure>(
+                new FlatForward(todaysDate, 0.0, dayCounter)));
+
+        // flat process
+        Handle<YieldTermStructure> flatTermStructure(
+            ext::shared_ptr<YieldTermStructure>(
+                new FlatForward(todaysDate, 0.06, dayCounter)));
+        Handle<BlackVolTermStructure> flatVolTS(
+            ext::shared_ptr<BlackVolTermStructure>(
+                new BlackConstantVol(todaysDate, calendar, 0.20,
+                                     dayCounter)));
+        ext::shared_ptr<GeneralizedBlackScholesProcess> flatProcess(
+                 new BlackScholesMertonProcess(underlyingH, flatDividendTS,
+                                               flatTermStructure, flatVolTS));
+
+        // time-dependent process; the _2 trees only sample it at the
+        // start, so their timings are unaffected
+        std::vector<Date> dates;
+        std::vector<Rate> rates;
+        std::vector<Volatility> vols;
+        dates.push_back(todaysDate);
+        rates.push_back(0.04);
+        for (Integer i=1; i<=4; ++i) {
+            dates.push_back(todaysDate + 3*i*Months);
+            rates.push_back(0.04 + 0.01*i);
+            vols.push_back(0.20 + 0.02*i);
+        }
+        Handle<YieldTermStructure> zeroTermStructure(
+            ext::shared_ptr<YieldTermStructure>(
+                new ZeroCurve(dates, rates, dayCounter)));
+        Handle<BlackVolTermStructure> curveVolTS(
+            ext::shared_ptr<BlackVolTermStructure>(
+                new BlackVarianceCurve(todaysDate,
+                                       std::vector<Date>(dates.begin()+1,
+                                                         dates.end()),
+                                       vols, dayCounter)));
+        ext::shared_ptr<GeneralizedBlackScholesProcess> curveProcess(
+                 new BlackScholesMertonProcess(underlyingH, flatDividendTS,
+                                               zeroTermStructure,
+                                               curveVolTS));
+
+        Report report(update ? std::map<std::string, double>()
+                             : readBaseline(baselineFile),
+                      tolerance);
+
+        Size steps[] = { 100, 500, 2500 };
+        for (Size k=0; k<2; ++k) {
+            std::string processName = (k == 0 ? "flat" : "curve");
+            ext::shared_ptr<GeneralizedBlackScholesProcess> process =
+                (k == 0 ? flatProcess : curveProcess);
+            for (Size i=0; i<sizeof(steps)/sizeof(steps[0]); ++i) {
+                benchmarkModel<ExtendedJarrowRudd, JarrowRudd_2>(
+                             "JarrowRudd", processName, process, steps[i],
+                             report);
+                benchmarkModel<ExtendedCoxRossRubinstein,
+                               CoxRossRubinstein_2>(
+                             "CoxRossRubinstein", processName, process,
+                             steps[i], report);
+                benchmarkModel<ExtendedAdditiveEQPBinomialTree,
+                               AdditiveEQPBinomialTree_2>(
+                             "AdditiveEQP", processName, process, steps[i],
+                             report);
+                benchmarkModel<ExtendedTrigeorgis, Trigeorgis_2>(
+                             "Trigeorgis", processName, process, steps[i],
+                             report);
+                benchmarkModel<ExtendedTian, Tian_2>(
+                             "Tian", processName, process, steps[i],
+                             report);
+                benchmarkModel<ExtendedLeisenReimer, LeisenReimer_2>(
+                             "LeisenReimer", processName, process,
+                             steps[i], report);
+                benchmarkModel<ExtendedJoshi4, Joshi4_2>(
+                             "Joshi4", processName, process, steps[i],
+                             report);
+            }
+        }
+
+        if (update) {
+            writeBaseline(baselineFile, report.results());
+            std::cout << "baseline written to " << baselineFile
+                      << std::endl;
+            return 0;
+        }
+        if (report.regressions() > 0) {
+            std::cout << std::setprecision(0)
+                      << report.regressions() << " regression(s) above "
+                      << 100.0*tolerance << "%" << std::endl;
+            return 1;
+        }
+        return 0;
+
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    } catch (...) {
+        std::cerr << "unknown error" << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,309 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+#include "cranknicolsonbatchpricer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+namespace QuantLib {
+
+    namespace {
+
+        // average of the payoff over the cell [a, b] of log-underlying
+        Real cellAverage(const PlainVanillaPayoff& payoff, Real a, Real b) {
+            Real strike = payoff.strike(), k = std::log(strike);
+            if (payoff.optionType() == Option::Call) {
+                if (b <= k)
+                    return 0.0;
+                Real from = std::max(a, k);
+                return (std::exp(b) - std::exp(from) - strike*(b-from))
+                    / (b-a);
+            } else {
+                if (a >= k)
+                    return 0.0;
+                Real to = std::min(b, k);
+                return (strike*(to-a) - std::exp(to) + std::exp(a))/(b-a);
+            }
+        }
+
+        // European value at a boundary node, from the forward
+        Real boundaryValue(const PlainVanillaPayoff& payoff,
+                           Real underlying, DiscountFactor dividends,
+                           DiscountFactor riskFree) {
+            Real omega = (payoff.optionType() == Option::Call ? 1.0 : -1.0);
+            return std::max<Real>(omega*(underlying*dividends -
+                                         payoff.strike()*riskFree), 0.0);
+        }
+
+    }
+
+
+    CrankNicolsonBatchResult::CrankNicolsonBatchResult()
+    : value(Null<Real>()), delta(Null<Real>()), gamma(Null<Real>()) {}
+
+
+    CrankNicolsonBatchPricer::CrankNicolsonBatchPricer(
+             const ext::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             Size timeSteps,
+             Size gridPoints,
+             Size dampingSteps)
+    : process_(process), timeSteps_(timeSteps), gridPoints_(gridPoints),
+      dampingSteps_(dampingSteps) {
+        QL_REQUIRE(process_, "no process given");
+        QL_REQUIRE(timeSteps >= 1,
+                   "at least 1 time step required, "
+                   << timeSteps << " provided");
+        QL_REQUIRE(gridPoints >= 5,
+                   "at least 5 grid points required, "
+                   << gridPoints << " provided");
+        QL_REQUIRE(dampingSteps <= timeSteps,
+                   "more damping steps (" << dampingSteps
+                   << ") than time steps (" << timeSteps << ")");
+    }
+
+    std::vector<CrankNicolsonBatchResult> CrankNicolsonBatchPricer::price(
+             const std::vector<ext::shared_ptr<VanillaOption> >& options)
+                                                                     const {
+        std::vector<CrankNicolsonBatchResult> results(options.size());
+        std::map<Date, std::vector<Size> > maturities;
+        for (Size i=0; i<options.size(); ++i) {
+            try {
+                QL_REQUIRE(options[i], "null option given");
+                QL_REQUIRE(ext::dynamic_pointer_cast<PlainVanillaPayoff>(
+                                                      options[i]->payoff()),
+                           "non-plain payoff given");
+                const ext::shared_ptr<Exercise>& exercise =
+                    options[i]->exercise();
+                QL_REQUIRE(exercise, "no exercise given");
+                QL_REQUIRE(process_->time(exercise->lastDate()) > 0.0,
+                           "expired option");
+                maturities[exercise->lastDate()].push_back(i);
+            } catch (std::exception& e) {
+                results[i].error = e.what();
+            }
+        }
+
+        for (std::map<Date, std::vector<Size> >::const_iterator m =
+                 maturities.begin(); m != maturities.end(); ++m) {
+            try {
+                priceMaturity(options, m->second, m->first, results);
+            } catch (std::exception& e) {
+                for (Size k=0; k<m->second.size(); ++k) {
+                    CrankNicolsonBatchResult& r = results[m->second[k]];
+                    r = CrankNicolsonBatchResult();
+                    r.error = e.what();
+                }
+            }
+        }
+        return results;
+    }
+
+    void CrankNicolsonBatchPricer::priceMaturity(
+             const std::vector<ext::shared_ptr<VanillaOption> >& options,
+             const std::vector<Size>& batch, const Date& maturity,
+             std::vector<CrankNicolsonBatchResult>& results) const {
+
+        Size N = batch.size(), M = gridPoints_, n = timeSteps_;
+        std::vector<ext::shared_ptr<PlainVanillaPayoff> > payoffs(N);
+        for (Size k=0; k<N; ++k)
+            payoffs[k] = ext::dynamic_pointer_cast<PlainVanillaPayoff>(
+                                           options[batch[k]]->payoff());
+
+        // grid in log-underlying, with the spot on a node
+        Time T = process_->time(maturity);
+        Real spot = process_->x0(), x0 = std::log(spot);
+        const Handle<YieldTermStructure>& riskFree =
+            process_->riskFreeRate();
+        const Handle<YieldTermStructure>& dividends =
+            process_->dividendYield();
+        const Handle<BlackVolTermStructure>& volatility =
+            process_->blackVolatility();
+        Real stdDev = std::sqrt(volatility->blackVariance(T, spot));
+        QL_REQUIRE(stdDev > 0.0, "null volatility given");
+        Real lowest = x0, highest = x0;
+        for (Size k=0; k<N; ++k) {
+            QL_REQUIRE(payoffs[k]->strike() > 0.0,
+                       "positive strike required");
+            lowest = std::min(lowest, std::log(payoffs[k]->strike()));
+            highest = std::max(highest, std::log(payoffs[k]->strike()));
+        }
+        lowest -= 5.0*stdDev;
+        highest += 5.0*stdDev;
+        Real h = (highest - lowest)/(M-1);
+        Size j0 = std::min<Size>(std::max<Real>(1.0, (x0-lowest)/h + 0.5),
+                                 M-2);
+        std::vector<Real> x(M), s(M);
+        for (Size j=0; j<M; ++j) {
+            x[j] = x0 + (Real(j) - Real(j0))*h;
+            s[j] = std::exp(x[j]);
+        }
+
+        // values by node, with the options contiguous
+        std::vector<Real> values(M*N), intrinsic(M*N), rhs(M*N);
+        for (Size j=0; j<M; ++j) {
+            for (Size k=0; k<N; ++k) {
+                values[j*N+k] =
+                    cellAverage(*payoffs[k], x[j]-0.5*h, x[j]+0.5*h);
+                intrinsic[j*N+k] = (*payoffs[k])(s[j]);
+            }
+        }
+
+        // exercise flags by step, snapped as in the binomial engines
+        Time dt = T/n;
+        std::vector<char> exercise(n*N, 0);
+        std::vector<bool> exercisable(n, false);
+        for (Size k=0; k<N; ++k) {
+            const Exercise& e = *options[batch[k]]->exercise();
+            switch (e.type()) {
+              case Exercise::American: {
+                  Time t0 = process_->time(e.date(0));
+                  Size first = std::min<Size>(
+                      n, Size(std::max<Real>(0.0, t0/dt + 0.5)));
+                  for (Size i=first; i<n; ++i)
+                      exercise[i*N+k] = 1;
+                }
+                break;
+              case Exercise::Bermudan:
+                for (Size d=0; d<e.dates().size(); ++d) {
+                    Time t = process_->time(e.date(d));
+                    if (t < 0.0)
+                        continue;
+                    Size i = Size(t/dt + 0.5);
+                    if (i < n)
+                        exercise[i*N+k] = 1;
+                }
+                break;
+              case Exercise::European:
+                break;
+              default:
+                QL_FAIL("invalid exercise type");
+            }
+        }
+        for (Size i=0; i<n; ++i)
+            for (Size k=0; k<N; ++k)
+                if (exercise[i*N+k])
+                    exercisable[i] = true;
+
+        // Thomas factors of the interior system, kept while the
+        // coefficients don't change
+        std::vector<Real> upper(M), pivot(M);
+        Real factoredLower = Null<Real>(), factoredDiagonal = Null<Real>(),
+             factoredUpper = Null<Real>();
+
+        DiscountFactor riskFreeT = riskFree->discount(T),
+                       dividendsT = dividends->discount(T);
+        for (Size i=n; i>0; --i) {
+            Time t0 = (i-1)*dt, t1 = i*dt;
+            DiscountFactor r0 = riskFree->discount(t0),
+                           r1 = riskFree->discount(t1),
+                           q0 = dividends->discount(t0),
+                           q1 = dividends->discount(t1);
+            Rate r = std::log(r0/r1)/dt, q = std::log(q0/q1)/dt;
+            Real variance = (volatility->blackVariance(t1, spot) -
+                             volatility->blackVariance(t0, spot))/dt;
+            Real theta = (n-i < dampingSteps_ ? 1.0 : 0.5);
+
+            // L V = a V'' + b V' - r V on the log grid
+            Real a = 0.5*variance/(h*h),
+                 b = (r - q - 0.5*variance)/(2.0*h);
+            Real l = a - b, c = -2.0*a - r, u = a + b;
+
+            // explicit part
+            Real e = (1.0-theta)*dt;
+            for (Size j=1; j<M-1; ++j) {
+                const Real* v = &values[j*N];
+                Real* y = &rhs[j*N];
+                for (Size k=0; k<N; ++k)
+                    y[k] = v[k] + e*(l*v[k-N] + c*v[k] + u*v[k+N]);
+            }
+
+            // new boundary values
+            Real* bottom = &values[0];
+            Real* top = &values[(M-1)*N];
+            for (Size k=0; k<N; ++k) {
+                bottom[k] = boundaryValue(*payoffs[k], s[0],
+                                          dividendsT/q0, riskFreeT/r0);
+                top[k] = boundaryValue(*payoffs[k], s[M-1],
+                                       dividendsT/q0, riskFreeT/r0);
+            }
+            Real lower = -theta*dt*l, diagonal = 1.0 - theta*dt*c,
+                 upperCoefficient = -theta*dt*u;
+            for (Size k=0; k<N; ++k) {
+                rhs[N+k] -= lower*bottom[k];
+                rhs[(M-2)*N+k] -= upperCoefficient*top[k];
+            }
+
+            if (lower != factoredLower || diagonal != factoredDiagonal ||
+                upperCoefficient != factoredUpper) {
+                pivot[1] = 1.0/diagonal;
+                upper[1] = upperCoefficient*pivot[1];
+                for (Size j=2; j<M-1; ++j) {
+                    pivot[j] = 1.0/(diagonal - lower*upper[j-1]);
+                    upper[j] = upperCoefficient*pivot[j];
+                }
+                factoredLower = lower;
+                factoredDiagonal = diagonal;
+                factoredUpper = upperCoefficient;
+            }
+
+            // batched Thomas pass
+            for (Size k=0; k<N; ++k)
+                rhs[N+k] *= pivot[1];
+            for (Size j=2; j<M-1; ++j) {
+                Real* y = &rhs[j*N];
+                const Real* previous = &rhs[(j-1)*N];
+                Real p = pivot[j];
+                for (Size k=0; k<N; ++k)
+                    y[k] = (y[k] - lower*previous[k])*p;
+            }
+            std::copy(&rhs[(M-2)*N], &rhs[(M-1)*N], &values[(M-2)*N]);
+            for (Size j=M-2; j>1; --j) {
+                Real* v = &values[(j-1)*N];
+                const Real* y = &rhs[(j-1)*N];
+                const Real* next = &values[j*N];
+                Real w = upper[j-1];
+                for (Size k=0; k<N; ++k)
+                    v[k] = y[k] - w*next[k];
+            }
+
+            // projection on the exercise value
+            if (exercisable[i-1]) {
+                const char* flags = &exercise[(i-1)*N];
+                for (Size j=0; j<M; ++j) {
+                    Real* v = &values[j*N];
+                    const Real* intrinsicValue = &intrinsic[j*N];
+                    for (Size k=0; k<N; ++k)
+                        if (flags[k])
+                            v[k] = std::max(v[k], intrinsicValue[k]);
+                }
+            }
+        }
+
+        for (Size k=0; k<N; ++k) {
+            Real down = values[(j0-1)*N+k], middle = values[j0*N+k],
+                 up = values[(j0+1)*N+k];
+            Real first = (up - down)/(2.0*h),
+                 second = (up - 2.0*middle + down)/(h*h);
+            CrankNicolsonBatchResult& result = results[batch[k]];
+            result.value = middle;
+            result.delta = first/spot;
+            result.gamma = (second - first)/(spot*spot);
+        }
+    }
+
+}
@@ -0,0 +1,93 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file cranknicolsonbatchpricer.hpp
+    \brief Finite-difference pricing of many vanilla options in one sweep
+*/
+
+#ifndef crank_nicolson_batch_pricer_hpp
+#define crank_nicolson_batch_pricer_hpp
+
+#include <ql/instruments/vanillaoption.hpp>
+#include <ql/processes/blackscholesprocess.hpp>
+#include <string>
+#include <vector>
+
+namespace QuantLib {
+
+    //! Results of an option priced by the CrankNicolsonBatchPricer
+    /*! If the pricing failed, error holds the reason and all values
+        are null.
+    */
+    struct CrankNicolsonBatchResult {
+        CrankNicolsonBatchResult();
+        Real value, delta, gamma;
+        std::string error;
+    };
+
+
+    //! Crank-Nicolson pricer for batches of vanilla options
+    /*! Options with the same maturity are priced together on a
+        single grid, uniform in the log of the underlying, which
+        covers the spot and all the strikes with five standard
+        deviations on each side and has the spot on a node.  Since
+        the coefficients of the Black-Scholes operator don't depend
+        on the underlying, each time step has a single tridiagonal
+        system; it is factored once, or only when the coefficients
+        change, and solved for all the options by a Thomas pass in
+        which the values of the options at each node are contiguous,
+        so that the inner loops run across options and are
+        vectorized by the compiler.
+
+        American and Bermudan exercise is applied by projecting the
+        values on the intrinsic value after each step at which the
+        option can be exercised, with exercise dates snapped to the
+        nearest step as in BinomialVanillaEngine_2.  The payoff is
+        averaged over the grid cells, so that strikes need not lie
+        on nodes, and the first damping steps are fully implicit.
+
+        The rates are the forward rates of the term structures over
+        each step, and the volatility is the Black volatility at the
+        spot; the smile is not used.  Dividends are not supported.
+        Delta and gamma are taken from the grid at the spot.
+
+        \warning as for the PortfolioPricer, market data must not
+                 change during the pricing.
+    */
+    class CrankNicolsonBatchPricer {
+      public:
+        CrankNicolsonBatchPricer(
+             const ext::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             Size timeSteps,
+             Size gridPoints,
+             Size dampingSteps = 0);
+        std::vector<CrankNicolsonBatchResult> price(
+             const std::vector<ext::shared_ptr<VanillaOption> >& options)
+                                                                      const;
+      private:
+        void priceMaturity(
+             const std::vector<ext::shared_ptr<VanillaOption> >& options,
+             const std::vector<Size>& batch, const Date& maturity,
+             std::vector<CrankNicolsonBatchResult>& results) const;
+        ext::shared_ptr<GeneralizedBlackScholesProcess> process_;
+        Size timeSteps_, gridPoints_, dampingSteps_;
+    };
+
+}
+
+
+#endif
@@ -0,0 +1,294 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*  Resident pricing daemon around PricingService (POSIX only).
+
+    It is a separate program; build it together with
+    ../pricingservice.cpp and ../../project3/binomialtree.cpp.
+
+    usage: pricingdaemon                  serves stdin and stdout
+           pricingdaemon --socket path    serves a Unix domain socket
+           pricingdaemon --client path [requests] [model] [steps]
+                                          measures the round-trip
+                                          latency of a running daemon
+
+    The request protocol is described in pricingservice.hpp; in
+    addition, SHUTDOWN stops the daemon once the batch containing it
+    has been answered.
+    Every poll of the connections forms a batch with all the
+    complete lines received, so that concurrent requests are grouped
+    by underlying.  For instance:
+
+        printf 'MARKET XYZ 36 0.06 0 0.2\n'\
+'PRICE 1 XYZ put 40 365 american crr 200\n' | ./pricingdaemon
+*/
+
+#include "../pricingservice.hpp"
+#include <boost/chrono.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace QuantLib;
+
+namespace {
+
+    struct Connection {
+        Connection(int in, int out) : in(in), out(out) {}
+        int in, out;
+        std::string buffer;
+    };
+
+    // appends the complete lines read from the connection; returns
+    // false when the peer closed it
+    bool readLines(Connection& connection, std::vector<std::string>& lines) {
+        char data[4096];
+        ssize_t n = ::read(connection.in, data, sizeof(data));
+        if (n < 0 && errno == EINTR)
+            return true;
+        if (n <= 0)
+            return false;
+        connection.buffer.append(data, n);
+        std::string::size_type start = 0, end;
+        while ((end = connection.buffer.find('\n', start))
+                                                     != std::string::npos) {
+            std::string line = connection.buffer.substr(start, end-start);
+            if (!line.empty() && line[line.size()-1] == '\r')
+                line.erase(line.size()-1);
+            lines.push_back(line);
+            start = end+1;
+        }
+        connection.buffer.erase(0, start);
+        return true;
+    }
+
+    void writeAll(int fd, const std::string& data) {
+        std::string::size_type written = 0;
+        while (written < data.size()) {
+            ssize_t n = ::write(fd, data.data()+written,
+                                data.size()-written);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return;
+            written += n;
+        }
+    }
+
+    sockaddr_un socketAddress(const std::string& path) {
+        sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        QL_REQUIRE(path.size() < sizeof(address.sun_path),
+                   "socket path too long: " << path);
+        std::strcpy(address.sun_path, path.c_str());
+        return address;
+    }
+
+    int listenOn(const std::string& path) {
+        int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        QL_REQUIRE(fd >= 0, "cannot create socket: " << std::strerror(errno));
+        sockaddr_un address = socketAddress(path);
+        ::unlink(path.c_str());
+        QL_REQUIRE(::bind(fd, reinterpret_cast<sockaddr*>(&address),
+                          sizeof(address)) == 0,
+                   "cannot bind " << path << ": " << std::strerror(errno));
+        QL_REQUIRE(::listen(fd, 64) == 0,
+                   "cannot listen on " << path << ": "
+                   << std::strerror(errno));
+        return fd;
+    }
+
+    int connectTo(const std::string& path) {
+        int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        QL_REQUIRE(fd >= 0, "cannot create socket: " << std::strerror(errno));
+        sockaddr_un address = socketAddress(path);
+        QL_REQUIRE(::connect(fd, reinterpret_cast<sockaddr*>(&address),
+                             sizeof(address)) == 0,
+                   "cannot connect to " << path << ": "
+                   << std::strerror(errno));
+        return fd;
+    }
+
+    // serves the given connections and, if listener is not negative,
+    // the ones accepted from it
+    void serve(int listener, std::vector<Connection> connections) {
+        PricingService service;
+        bool shutdown = false;
+        while (!shutdown && (listener >= 0 || !connections.empty())) {
+            std::vector<pollfd> fds;
+            for (Size i=0; i<connections.size(); ++i) {
+                pollfd p = { connections[i].in, POLLIN, 0 };
+                fds.push_back(p);
+            }
+            if (listener >= 0) {
+                pollfd p = { listener, POLLIN, 0 };
+                fds.push_back(p);
+            }
+            if (::poll(&fds[0], fds.size(), -1) < 0) {
+                QL_REQUIRE(errno == EINTR,
+                           "poll failed: " << std::strerror(errno));
+                continue;
+            }
+
+            // batch of the lines received from all the connections
+            std::vector<std::string> requests;
+            std::vector<Size> owners;
+            std::vector<bool> closed(connections.size(), false);
+            for (Size i=0; i<connections.size(); ++i) {
+                if (fds[i].revents == 0)
+                    continue;
+                Size first = requests.size();
+                closed[i] = !readLines(connections[i], requests);
+                owners.resize(requests.size(), i);
+                for (Size k=first; k<requests.size(); ++k)
+                    if (requests[k] == "SHUTDOWN")
+                        shutdown = true;
+            }
+
+            std::vector<std::string> replies = service.process(requests);
+            std::vector<std::string> output(connections.size());
+            for (Size k=0; k<replies.size(); ++k) {
+                if (requests[k] == "SHUTDOWN")
+                    replies[k] = "OK SHUTDOWN";
+                output[owners[k]] += replies[k] + "\n";
+            }
+            for (Size i=0; i<connections.size(); ++i)
+                if (!output[i].empty())
+                    writeAll(connections[i].out, output[i]);
+
+            for (Size i=connections.size(); i>0; --i) {
+                if (closed[i-1]) {
+                    if (connections[i-1].in != STDIN_FILENO)
+                        ::close(connections[i-1].in);
+                    connections.erase(connections.begin()+(i-1));
+                }
+            }
+
+            if (listener >= 0 && (fds.back().revents & POLLIN)) {
+                int fd = ::accept(listener, 0, 0);
+                if (fd >= 0)
+                    connections.push_back(Connection(fd, fd));
+            }
+        }
+        for (Size i=0; i<connections.size(); ++i)
+            if (connections[i].in != STDIN_FILENO)
+                ::close(connections[i].in);
+    }
+
+    std::string readReply(int fd, std::string& buffer) {
+        std::string::size_type end;
+        while ((end = buffer.find('\n')) == std::string::npos) {
+            char data[4096];
+            ssize_t n = ::read(fd, data, sizeof(data));
+            QL_REQUIRE(n > 0, "connection closed by the daemon");
+            buffer.append(data, n);
+        }
+        std::string reply = buffer.substr(0, end);
+        buffer.erase(0, end+1);
+        return reply;
+    }
+
+    // sends sequential requests and prints the latency percentiles
+    void measureLatency(const std::string& path, Size requests,
+                        const std::string& model, Size steps) {
+        typedef boost::chrono::steady_clock clock_type;
+        int fd = connectTo(path);
+        std::string buffer;
+        writeAll(fd, "MARKET LATENCY 36 0.06 0.0 0.2\n");
+        std::string reply = readReply(fd, buffer);
+        QL_REQUIRE(reply == "OK MARKET LATENCY",
+                   "unexpected reply: " << reply);
+
+        std::vector<double> latencies;
+        Size errors = 0;
+        for (Size i=0; i<requests; ++i) {
+            std::ostringstream request;
+            request << "PRICE " << i << " LATENCY put " << 30 + i%20
+                    << " 365 american " << model << " " << steps << "\n";
+            clock_type::time_point start = clock_type::now();
+            writeAll(fd, request.str());
+            reply = readReply(fd, buffer);
+            latencies.push_back(1.0e6*boost::chrono::duration<double>(
+                                          clock_type::now()-start).count());
+            if (reply.find(" OK ") == std::string::npos) {
+                if (errors++ == 0)
+                    std::cerr << reply << std::endl;
+            }
+        }
+        ::close(fd);
+
+        std::sort(latencies.begin(), latencies.end());
+        Size n = latencies.size();
+        std::cout << requests << " requests, " << model << " " << steps
+                  << " steps, " << errors << " errors" << std::endl
+                  << "latency (us): p50 " << latencies[n/2]
+                  << ", p99 " << latencies[std::min(n-1, (99*n)/100)]
+                  << ", max " << latencies[n-1] << std::endl;
+    }
+
+}
+
+
+int main(int argc, char* argv[]) {
+
+    try {
+
+        // a client disconnecting must not kill the daemon
+        std::signal(SIGPIPE, SIG_IGN);
+
+        if (argc == 1) {
+            serve(-1, std::vector<Connection>(
+                          1, Connection(STDIN_FILENO, STDOUT_FILENO)));
+        } else if (argc == 3 && std::strcmp(argv[1], "--socket") == 0) {
+            int listener = listenOn(argv[2]);
+            serve(listener, std::vector<Connection>());
+            ::close(listener);
+            ::unlink(argv[2]);
+        } else if (argc >= 3 && argc <= 6 &&
+                   std::strcmp(argv[1], "--client") == 0) {
+            Size requests = (argc > 3 ? std::atoi(argv[3]) : 10000);
+            std::string model = (argc > 4 ? argv[4] : "crr");
+            Size steps = (argc > 5 ? std::atoi(argv[5]) : 100);
+            QL_REQUIRE(requests > 0, "positive number of requests required");
+            measureLatency(argv[2], requests, model, steps);
+        } else {
+            QL_FAIL("usage: " << argv[0] << " [--socket path | "
+                    "--client path [requests] [model] [steps]]");
+        }
+        return 0;
+
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    } catch (...) {
+        std::cerr << "unknown error" << std::endl;
+        return 1;
+    }
+}
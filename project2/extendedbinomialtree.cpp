@@ -32,9 +32,9 @@ namespace QuantLib {
     : ExtendedEqualProbabilitiesBinomialTree<ExtendedJarrowRudd>(
                                                         process, end, steps) {
         // drift removed
-        for (Size i = 0; i <= steps; i ++) {
-            Time stepTime = i*this->dt_;
-            upStepCache.push_back(this->upStep(stepTime));
+        if (!homogeneous_) {
+            for (Size i = 0; i <= steps; i ++)
+                upStepCache.push_back(this->upStep(i));
         }
         up_ = process->stdDeviation(0.0, x0_, dt_);
     }
@@ -51,10 +51,11 @@ namespace QuantLib {
                         Time end, Size steps, Real)
     : ExtendedEqualJumpsBinomialTree<ExtendedCoxRossRubinstein>(
                                                         process, end, steps) {
-        for (Size i = 0; i <= steps; i ++) {
-            Time stepTime = i*this->dt_;
-            dxStepCache.push_back(this->dxStep(stepTime));
-            probUpCache.push_back(this->probUp(stepTime));
+        if (!homogeneous_) {
+            for (Size i = 0; i <= steps; i ++) {
+                dxStepCache.push_back(this->dxStep(i));
+                probUpCache.push_back(this->probUp(i));
+            }
         }
         dx_ = process->stdDeviation(0.0, x0_, dt_);
         pu_ = 0.5 + 0.5*this->driftStepCache[0] / dx_;
@@ -79,9 +80,9 @@ namespace QuantLib {
     : ExtendedEqualProbabilitiesBinomialTree<ExtendedAdditiveEQPBinomialTree>(
                                                         process, end, steps) {
           Real driftStep_ = this->driftStepCache[0];
-          for (Size i = 0; i <= steps; i ++) {
-              Time stepTime = i*this->dt_;
-              upStepCache.push_back(this->upStep(stepTime));
+          if (!homogeneous_) {
+              for (Size i = 0; i <= steps; i ++)
+                  upStepCache.push_back(this->upStep(i));
           }
           up_ = -0.5 * driftStep_ + 0.5 *
 				      std::sqrt(4.0*process->variance(0.0, x0_, dt_) -
@@ -104,14 +105,15 @@ namespace QuantLib {
                         Time end, Size steps, Real)
     : ExtendedEqualJumpsBinomialTree<ExtendedTrigeorgis>(process, end, steps) {
         Real driftStep_ = this->driftStepCache[0];
-        for (Size i = 0; i <= steps; i ++) {
-            Time stepTime = i*this->dt_;
-            dxStepCache.push_back(this->dxStep(stepTime));
-            probUpCache.push_back(this->probUp(stepTime));
+        if (!homogeneous_) {
+            for (Size i = 0; i <= steps; i ++) {
+                dxStepCache.push_back(this->dxStep(i));
+                probUpCache.push_back(this->probUp(i));
+            }
         }
         dx_ = std::sqrt(process->variance(0.0, x0_, dt_) +
             driftStep_*driftStep_);
-        pu_ = 0.5 + 0.5*driftStep_ / this->dxStepCache[0];
+        pu_ = 0.5 + 0.5*driftStep_ / dx_;
         pd_ = 1.0 - pu_;
 
         QL_REQUIRE(pu_<=1.0, "negative probability");
@@ -149,31 +151,31 @@ namespace QuantLib {
 
         QL_REQUIRE(pu_<=1.0, "negative probability");
         QL_REQUIRE(pu_>=0.0, "negative probability");
+
+        if (!homogeneous_) {
+            for (Size i = 0; i <= steps; i ++) {
+                Time stepTime = i*this->dt_;
+                Real q = std::exp(process->variance(stepTime, x0_, dt_));
+                Real r = std::exp(this->driftStepCache[i])*std::sqrt(q);
+                Real up = 0.5 * r * q * (q + 1 + std::sqrt(q * q + 2 * q - 3));
+                Real down = 0.5 * r * q * (q + 1 - std::sqrt(q * q + 2 * q - 3));
+                upCache_.push_back(up);
+                downCache_.push_back(down);
+                puCache_.push_back((r - down) / (up - down));
+            }
+        }
     }
 
     Real ExtendedTian::underlying(Size i, Size index) const {
-        Time stepTime = i*this->dt_;
-        Real q = std::exp(this->treeProcess_->variance(stepTime, x0_, dt_));
-        Real r = std::exp(this->driftStepCache[i])*std::sqrt(q);
-
-        Real up = 0.5 * r * q * (q + 1 + std::sqrt(q * q + 2 * q - 3));
-        Real down = 0.5 * r * q * (q + 1 - std::sqrt(q * q + 2 * q - 3));
-
+        Real up = homogeneous_ ? up_ : upCache_[i];
+        Real down = homogeneous_ ? down_ : downCache_[i];
         return x0_ * std::pow(down, Real(BigInteger(i)-BigInteger(index)))
             * std::pow(up, Real(index));
     }
 
     Real ExtendedTian::probability(Size i, Size, Size branch) const {
-        Time stepTime = i*this->dt_;
-        Real q = std::exp(this->treeProcess_->variance(stepTime, x0_, dt_));
-        Real r = std::exp(this->driftStepCache[i])*std::sqrt(q);
-        Real up = 0.5 * r * q * (q + 1 + std::sqrt(q * q + 2 * q - 3));
-        Real down = 0.5 * r * q * (q + 1 - std::sqrt(q * q + 2 * q - 3));
-
-        Real pu = (r - down) / (up - down);
-        Real pd = 1.0 - pu;
-
-        return (branch == 1 ? pu : pd);
+        Real pu = homogeneous_ ? pu_ : puCache_[i];
+        return (branch == 1 ? pu : 1.0 - pu);
     }
 
 
@@ -202,38 +204,35 @@ namespace QuantLib {
         up_ = ermqdt * pdash / pu_;
         down_ = (ermqdt - pu_ * up_) / (1.0 - pu_);
 
+        if (!homogeneous_) {
+            for (Size i = 0; i <= oddSteps_; i ++) {
+                Time stepTime = i*this->dt_;
+                Real variance = process->variance(stepTime, x0_, end_);
+                Real driftStep = this->driftStepCache[i];
+                Real ermqdt = std::exp(driftStep + 0.5*variance / oddSteps_);
+                Real d2 = (std::log(x0_ / strike_) + driftStep*oddSteps_) /
+                    std::sqrt(variance);
+                Real pu = PeizerPrattMethod2Inversion(d2, oddSteps_);
+                Real pdash = PeizerPrattMethod2Inversion(
+                                      d2+std::sqrt(variance), oddSteps_);
+                Real up = ermqdt * pdash / pu;
+                upCache_.push_back(up);
+                downCache_.push_back((ermqdt - pu * up) / (1.0 - pu));
+                puCache_.push_back(pu);
+            }
+        }
     }
 
     Real ExtendedLeisenReimer::underlying(Size i, Size index) const {
-        Time stepTime = i*this->dt_;
-        Real variance = this->treeProcess_->variance(stepTime, x0_, end_);
-
-        Real driftStep_ = this->driftStepCache[i];
-
-        Real ermqdt = std::exp(driftStep_ + 0.5*variance / oddSteps_);
-		    Real d2 = (std::log(x0_ / strike_) + driftStep_*oddSteps_) /
-			     std::sqrt(variance);
-
-        Real pu = PeizerPrattMethod2Inversion(d2, oddSteps_);
-        Real pdash = PeizerPrattMethod2Inversion(d2+std::sqrt(variance),
-            oddSteps_);
-        Real up = ermqdt * pdash / pu;
-        Real down = (ermqdt - pu * up) / (1.0 - pu);
-
+        Real up = homogeneous_ ? up_ : upCache_[i];
+        Real down = homogeneous_ ? down_ : downCache_[i];
         return x0_ * std::pow(down, Real(BigInteger(i)-BigInteger(index)))
             * std::pow(up, Real(index));
     }
 
     Real ExtendedLeisenReimer::probability(Size i, Size, Size branch) const {
-        Time stepTime = i*this->dt_;
-        Real variance = this->treeProcess_->variance(stepTime, x0_, end_);
-        Real d2 = (std::log(x0_ / strike_) + this->driftStepCache[i]*oddSteps_) /
-			std::sqrt(variance);
-
-        Real pu = PeizerPrattMethod2Inversion(d2, oddSteps_);
-        Real pd = 1.0 - pu;
-
-        return (branch == 1 ? pu : pd);
+        Real pu = homogeneous_ ? pu_ : puCache_[i];
+        return (branch == 1 ? pu : 1.0 - pu);
     }
 
 
@@ -278,38 +277,36 @@ namespace QuantLib {
         Real pdash = computeUpProb((oddSteps_-1.0)/2.0,d2+std::sqrt(variance));
         up_ = ermqdt * pdash / pu_;
         down_ = (ermqdt - pu_ * up_) / (1.0 - pu_);
+
+        if (!homogeneous_) {
+            for (Size i = 0; i <= oddSteps_; i ++) {
+                Time stepTime = i*this->dt_;
+                Real variance = process->variance(stepTime, x0_, end_);
+                Real driftStep = this->driftStepCache[i];
+                Real ermqdt = std::exp(driftStep + 0.5*variance / oddSteps_);
+                Real d2 = (std::log(x0_ / strike_) + driftStep*oddSteps_) /
+                    std::sqrt(variance);
+                Real pu = computeUpProb((oddSteps_-1.0)/2.0, d2);
+                Real pdash = computeUpProb((oddSteps_-1.0)/2.0,
+                                           d2+std::sqrt(variance));
+                Real up = ermqdt * pdash / pu;
+                upCache_.push_back(up);
+                downCache_.push_back((ermqdt - pu * up) / (1.0 - pu));
+                puCache_.push_back(pu);
+            }
+        }
     }
 
     Real ExtendedJoshi4::underlying(Size i, Size index) const {
-        Time stepTime = i*this->dt_;
-        Real variance = this->treeProcess_->variance(stepTime, x0_, end_);
-
-        Real driftStep_ = this->driftStepCache[i];
-
-        Real ermqdt = std::exp(driftStep_ + 0.5*variance / oddSteps_);
-		Real d2 = (std::log(x0_ / strike_) + driftStep_*oddSteps_) /
-			std::sqrt(variance);
-
-        Real pu = computeUpProb((oddSteps_-1.0)/2.0,d2 );
-        Real pdash = computeUpProb((oddSteps_-1.0)/2.0,d2+std::sqrt(variance));
-        Real up = ermqdt * pdash / pu;
-        Real down = (ermqdt - pu * up) / (1.0 - pu);
-
+        Real up = homogeneous_ ? up_ : upCache_[i];
+        Real down = homogeneous_ ? down_ : downCache_[i];
         return x0_ * std::pow(down, Real(BigInteger(i)-BigInteger(index)))
             * std::pow(up, Real(index));
     }
 
     Real ExtendedJoshi4::probability(Size i, Size, Size branch) const {
-        Time stepTime = i*this->dt_;
-        Real variance = this->treeProcess_->variance(stepTime, x0_, end_);
-
-        Real d2 = (std::log(x0_ / strike_) + this->driftStepCache[i]*oddSteps_) /
-			std::sqrt(variance);
-
-        Real pu = computeUpProb((oddSteps_-1.0)/2.0,d2 );
-        Real pd = 1.0 - pu;
-
-        return (branch == 1 ? pu : pd);
+        Real pu = homogeneous_ ? pu_ : puCache_[i];
+        return (branch == 1 ? pu : 1.0 - pu);
     }
 
 }
@@ -36,7 +36,15 @@
 namespace QuantLib {
 
     //! Binomial tree base class
-    /*! \ingroup lattices */
+    /*! At construction, the tree checks whether the drift and the
+        variance of the process over each step are the same for all
+        steps within a relative tolerance.  If so, the tree is
+        time-homogeneous and derived classes use scalar up/down moves
+        and probabilities as the constant-parameter trees do;
+        otherwise, they read per-step tables.
+
+        \ingroup lattices
+    */
     using namespace ext::placeholders;
 
     template <class T>
@@ -51,9 +59,21 @@ namespace QuantLib {
             x0_ = process->x0();
             dt_ = end/steps;
             driftPerStep_ = process->drift(0.0, x0_) * dt_;
+            Real variance = process->variance(0.0, x0_, dt_);
+            // drift and variance are compared on the scale of the
+            // standard deviation and of the variance per step
+            Real tolerance = 1.0e-10;
+            homogeneous_ = true;
             for (Size i = 0; i <= steps; i ++) {
                 Time stepTime = i*this->dt_;
                 driftStepCache.push_back(this->driftStep(stepTime));
+                if (homogeneous_ && i > 0) {
+                    Real v = process->variance(stepTime, x0_, dt_);
+                    homogeneous_ =
+                        std::fabs(driftStepCache[i] - driftPerStep_) <=
+                            tolerance*std::sqrt(variance) &&
+                        std::fabs(v - variance) <= tolerance*variance;
+                }
             }
 
         }
@@ -63,6 +83,8 @@ namespace QuantLib {
         Size descendant(Size, Size index, Size branch) const {
             return index + branch;
         }
+        //! whether the tree uses constant per-step parameters
+        bool homogeneous() const { return homogeneous_; }
       protected:
         //time dependent drift per step
         Real driftStep(Time driftTime) const {
@@ -71,6 +93,7 @@ namespace QuantLib {
         std::vector<Real> driftStepCache;
         Real x0_, driftPerStep_;
         Time dt_;
+        bool homogeneous_;
 
       protected:
         ext::shared_ptr<StochasticProcess1D> treeProcess_;
@@ -92,6 +115,8 @@ namespace QuantLib {
 
         Real underlying(Size i, Size index) const {
             BigInteger j = 2*BigInteger(index) - BigInteger(i);
+            if (this->homogeneous_)
+                return this->x0_*std::exp(i*this->driftPerStep_ + j*up_);
             return this->x0_*std::exp(i*this->driftStepCache[i] + j*this->upStepCache[i]);
         }
 
@@ -119,11 +144,15 @@ namespace QuantLib {
             // Time stepTime = i*this->dt_;
             BigInteger j = 2*BigInteger(index) - BigInteger(i);
             // exploiting equal jump and the x0_ tree centering
+            if (this->homogeneous_)
+                return this->x0_*std::exp(j*dx_);
             return this->x0_*std::exp(j*this->dxStepCache[i]);
 
         }
 
         Real probability(Size i, Size, Size branch) const {
+            if (this->homogeneous_)
+                return (branch == 1 ? pu_ : pd_);
             Real upProb = this->probUpCache[i];
             Real downProb = 1 - upProb;
             return (branch == 1 ? upProb : downProb);
@@ -213,6 +242,8 @@ namespace QuantLib {
         Real probability(Size, Size, Size branch) const;
       protected:
         Real up_, down_, pu_, pd_;
+        // per-step moves and probabilities, if not homogeneous
+        std::vector<Real> upCache_, downCache_, puCache_;
     };
 
     //! Leisen & Reimer tree: multiplicative approach
@@ -231,6 +262,8 @@ namespace QuantLib {
         Time end_;
         Size oddSteps_;
         Real strike_, up_, down_, pu_, pd_;
+        // per-step moves and probabilities, if not homogeneous
+        std::vector<Real> upCache_, downCache_, puCache_;
     };
 
 
@@ -248,6 +281,8 @@ namespace QuantLib {
         Time end_;
         Size oddSteps_;
         Real strike_, up_, down_, pu_, pd_;
+        // per-step moves and probabilities, if not homogeneous
+        std::vector<Real> upCache_, downCache_, puCache_;
     };
 
 
@@ -37,14 +37,61 @@
 #include <ql/time/calendars/target.hpp>
 #include <ql/utilities/dataformatters.hpp>
 
+#include <boost/bind.hpp>
 #include <boost/timer.hpp>
+#include <boost/chrono.hpp>
 #include <iostream>
 #include <iomanip>
+#include <sstream>
 
 #include <ql/experimental/lattices/extendedbinomialtree.hpp>
+#include "../project3/adaptivebinomialengine.hpp"
+#include "../project3/binomialengine.hpp"
+#include "../project3/cachingengine.hpp"
+#include "../common/engineinstrumentation.hpp"
+#include "../project3/routingengine.hpp"
+#include "../project1/mcamericanengine.hpp"
+#include "../project1/mceuropeanengine.hpp"
+#include "../project1/mchestonengine.hpp"
+#include "../project1/philoxrandom.hpp"
+#include "portfoliopricer.hpp"
+#include "cranknicolsonbatchpricer.hpp"
+#include "asyncpricer.hpp"
 
 using namespace QuantLib;
 
+namespace {
+
+    struct MonteCarloRun {
+        Real value;
+        double seconds;
+        long memory;
+    };
+
+    // NPV, time and peak heap growth of a calculation; the heap is
+    // only tracked when QL_ENABLE_ENGINE_INSTRUMENTATION is defined
+    MonteCarloRun monteCarloRun(VanillaOption& option,
+                                const ext::shared_ptr<PricingEngine>& engine) {
+        option.setPricingEngine(engine);
+        long start = engineHeapInUse();
+        resetEngineHeapPeak();
+        boost::chrono::steady_clock::time_point t0 =
+            boost::chrono::steady_clock::now();
+        MonteCarloRun run;
+        run.value = option.NPV();
+        run.seconds = boost::chrono::duration<double>(
+                          boost::chrono::steady_clock::now() - t0).count();
+        run.memory = engineHeapPeak() - start;
+        return run;
+    }
+
+    // progress callback of the asynchronous pricings
+    void countProgress(Size& reports, Size, Size) {
+        ++reports;
+    }
+
+}
+
 #if defined(QL_ENABLE_SESSIONS)
 namespace QuantLib {
 
@@ -237,6 +284,27 @@ int main(int, char* []) {
         //           << std::setw(widths[3]) << std::left << americanOption.NPV()
         //           << std::endl;
 
+        // Finite differences, the three options in a single sweep
+        method = "Batched Crank-Nicolson";
+        std::vector<ext::shared_ptr<VanillaOption> > batch;
+        batch.push_back(ext::shared_ptr<VanillaOption>(
+                             new VanillaOption(payoff, europeanExercise)));
+        batch.push_back(ext::shared_ptr<VanillaOption>(
+                             new VanillaOption(payoff, bermudanExercise)));
+        batch.push_back(ext::shared_ptr<VanillaOption>(
+                             new VanillaOption(payoff, americanExercise)));
+        std::vector<CrankNicolsonBatchResult> batchResults =
+            CrankNicolsonBatchPricer(bsmProcess, 800, 800, 2).price(batch);
+        std::cout << std::setw(widths[0]) << std::left << method
+                  << std::fixed
+                  << std::setw(widths[1]) << std::left
+                  << batchResults[0].value
+                  << std::setw(widths[2]) << std::left
+                  << batchResults[1].value
+                  << std::setw(widths[3]) << std::left
+                  << batchResults[2].value
+                  << std::endl;
+
         // Binomial method: Jarrow-Rudd
         method = "Extended Binomial Jarrow-Rudd";
         europeanOption.setPricingEngine(ext::shared_ptr<PricingEngine>(
@@ -346,6 +414,32 @@ int main(int, char* []) {
                   << std::setw(widths[3]) << std::left << americanOption.NPV()
                   << std::endl;
 
+        // Binomial method behind a router: the European option is
+        // priced by the Black-Scholes formula instead of the tree
+        method = "Routed Binomial Cox-Ross-Rubinstein";
+        ext::shared_ptr<PricingEngine> routedEngine(
+            new RoutingVanillaEngine_2(ext::shared_ptr<PricingEngine>(
+                new BinomialVanillaEngine_2<ExtendedCoxRossRubinstein>(
+                                                    bsmProcess, timeSteps)),
+                                       bsmProcess));
+        europeanOption.setPricingEngine(routedEngine);
+        bermudanOption.setPricingEngine(routedEngine);
+        americanOption.setPricingEngine(routedEngine);
+        std::cout << std::setw(widths[0]) << std::left << method
+                  << std::fixed
+                  << std::setw(widths[1]) << std::left << europeanOption.NPV()
+                  << std::setw(widths[2]) << std::left << bermudanOption.NPV()
+                  << std::setw(widths[3]) << std::left << americanOption.NPV()
+                  << std::endl;
+        std::cout << std::setw(widths[0]) << std::left << "  route"
+                  << std::setw(widths[1]) << std::left
+                  << europeanOption.result<std::string>("route")
+                  << std::setw(widths[2]) << std::left
+                  << bermudanOption.result<std::string>("route")
+                  << std::setw(widths[3]) << std::left
+                  << americanOption.result<std::string>("route")
+                  << std::endl;
+
         // Monte Carlo Method: MC (crude)
         // timeSteps = 1;
         // method = "MC (crude)";
@@ -380,22 +474,515 @@ int main(int, char* []) {
         //           << std::setw(widths[3]) << std::left << "N/A"
         //           << std::endl;
 
-        // Monte Carlo Method: MC (Longstaff Schwartz)
-        // method = "MC (Longstaff Schwartz)";
-        // ext::shared_ptr<PricingEngine> mcengine3;
-        // mcengine3 = MakeMCAmericanEngine<PseudoRandom>(bsmProcess)
-        //     .withSteps(100)
-        //     .withAntitheticVariate()
-        //     .withCalibrationSamples(4096)
-        //     .withAbsoluteTolerance(0.02)
-        //     .withSeed(mcSeed);
-        // americanOption.setPricingEngine(mcengine3);
-        // std::cout << std::setw(widths[0]) << std::left << method
-        //           << std::fixed
-        //           << std::setw(widths[1]) << std::left << "N/A"
-        //           << std::setw(widths[2]) << std::left << "N/A"
-        //           << std::setw(widths[3]) << std::left << americanOption.NPV()
-        //           << std::endl;
+        // Monte Carlo Method: MC (Philox); the variates of each path
+        // are drawn directly from its index, so that a generator
+        // skipped to any path reproduces the sequential run, and the
+        // samples are summed by blocks of paths
+        method = "MC (Philox)";
+        europeanOption.setPricingEngine(
+            MakeMCEuropeanEngine_2<PhiloxRandom,BlockStatistics>(bsmProcess)
+                .withSteps(1)
+                .withSamples(32768)
+                .withSeed(42));
+        Real philoxValue = europeanOption.NPV();
+        std::cout << std::setw(widths[0]) << std::left << method
+                  << std::fixed
+                  << std::setw(widths[1]) << std::left << philoxValue
+                  << std::setw(widths[2]) << std::left << "N/A"
+                  << std::setw(widths[3]) << std::left << "N/A"
+                  << std::endl;
+        PhiloxGaussianRsg sequential(100, 42), skipped(100, 42, 1000);
+        bool reproduced = true;
+        for (Size i=0; i<2000; ++i) {
+            const std::vector<Real>& x = sequential.nextSequence().value;
+            if (i >= 1000 && x != skipped.nextSequence().value)
+                reproduced = false;
+        }
+        std::cout << "Philox paths 1000-1999 reproduced after skipping: "
+                  << (reproduced ? "yes" : "no") << std::endl;
+        // the same simulation split in four ranges of paths, as four
+        // processes would run it; the ranges draw the same paths and
+        // sum the same blocks, so that appending their statistics in
+        // path order gives the sequential value bit by bit
+        Size ranges = 4, rangeSamples = 32768/ranges;
+        BlockStatistics rangeStatistics;
+        for (Size k=0; k<ranges; ++k) {
+            europeanOption.setPricingEngine(
+                MakeMCEuropeanEngine_2<PhiloxRandom,BlockStatistics>(
+                                                               bsmProcess)
+                    .withSteps(1)
+                    .withSamples(rangeSamples)
+                    .withSeed(42)
+                    .withFirstPath(k*rangeSamples));
+            rangeStatistics.append(europeanOption.result<BlockStatistics>(
+                                                        "blockStatistics"));
+        }
+        std::cout << "Philox run split in " << ranges
+                  << " path ranges, same value as sequential run: "
+                  << (rangeStatistics.mean() == philoxValue ? "yes" : "no")
+                  << std::endl;
+
+        // the Monte Carlo engine is cached by wrapping it; the
+        // configuration lists the parameters affecting its results
+        ext::shared_ptr<PricingResultCache> resultCache(
+                                               new PricingResultCache(16));
+        ext::shared_ptr<PricingEngine> cachedEngine(
+            new CachingVanillaEngine_2(
+                MakeMCEuropeanEngine_2<PhiloxRandom,BlockStatistics>(
+                                                               bsmProcess)
+                    .withSteps(1)
+                    .withSamples(32768)
+                    .withSeed(42),
+                bsmProcess, "mceuropean:philox,1,32768,42", resultCache));
+        Real cachedValue = 0.0;
+        for (Size i=0; i<2; ++i) {
+            europeanOption.setPricingEngine(cachedEngine);
+            cachedValue = europeanOption.NPV();
+        }
+        std::cout << "Cached Philox run: " << resultCache->hits()
+                  << " hit, " << resultCache->misses() << " miss, "
+                  << "difference from uncached run: "
+                  << std::scientific << cachedValue - philoxValue
+                  << std::fixed << std::endl;
+
+        // Deep out-of-the-money put: with importance sampling, paths
+        // are drawn around the strike and reweighted
+        VanillaOption deepPut(
+            ext::shared_ptr<StrikedTypePayoff>(
+                                  new PlainVanillaPayoff(Option::Put, 20.0)),
+            europeanExercise);
+        deepPut.setPricingEngine(
+            MakeMCEuropeanEngine_2<PseudoRandom>(bsmProcess)
+                .withSteps(1)
+                .withSamples(32768)
+                .withSeed(42));
+        Real crudeValue = deepPut.NPV(), crudeError = deepPut.errorEstimate();
+        deepPut.setPricingEngine(
+            MakeMCEuropeanEngine_2<PseudoRandom>(bsmProcess)
+                .withSteps(1)
+                .withSamples(32768)
+                .withSeed(42)
+                .withImportanceSampling());
+        std::cout << "Put struck at 20, 32768 paths: crude " << crudeValue
+                  << " +/- " << crudeError << ", importance sampling "
+                  << deepPut.NPV() << " +/- " << deepPut.errorEstimate()
+                  << " (variance reduced "
+                  << deepPut.result<Real>(
+                                   "importanceSampling.varianceReduction")
+                  << " times)" << std::endl;
+
+        // Monte Carlo Method: MC (Longstaff Schwartz); the stock
+        // engine counts antithetic pairs, the _2 engine paths, so
+        // that both simulate 4096 calibration and 32768 pricing paths
+        Size lsmSteps = 100, lsmSeed = 42;
+        Size lsmPaths = 4096 + 32768;
+        std::string lsmMethods[] = {
+            "MC (Longstaff Schwartz)",
+            "MC (Longstaff Schwartz) _2",
+            "MC (Longstaff Schwartz) _2, regenerated"
+        };
+        ext::shared_ptr<PricingEngine> lsmEngines[] = {
+            MakeMCAmericanEngine<PseudoRandom>(bsmProcess)
+                .withSteps(lsmSteps)
+                .withAntitheticVariate()
+                .withCalibrationSamples(2048)
+                .withSamples(16384)
+                .withSeed(lsmSeed),
+            MakeMCAmericanEngine_2<PseudoRandom>(bsmProcess)
+                .withSteps(lsmSteps)
+                .withAntitheticVariate()
+                .withCalibrationSamples(4096)
+                .withSamples(32768)
+                .withSeed(lsmSeed),
+            MakeMCAmericanEngine_2<PseudoRandom>(bsmProcess)
+                .withSteps(lsmSteps)
+                .withAntitheticVariate()
+                .withCalibrationSamples(4096)
+                .withSamples(32768)
+                .withSeed(lsmSeed)
+                .withPathRegeneration()
+        };
+        MonteCarloRun lsmRuns[3];
+        Real lsmPathMemory[3];
+        for (Size i=0; i<3; ++i) {
+            lsmRuns[i] = monteCarloRun(americanOption, lsmEngines[i]);
+            // the stock engine keeps all its calibration paths, i.e.,
+            // both paths of its 2048 antithetic samples at every step
+            lsmPathMemory[i] = (i == 0 ?
+                Real(2*2048*(lsmSteps+1)*sizeof(Real)) :
+                americanOption.result<Real>("pathMemory"));
+            std::cout << std::setw(widths[0]) << std::left << lsmMethods[i]
+                      << std::fixed
+                      << std::setw(widths[1]) << std::left << "N/A"
+                      << std::setw(widths[2]) << std::left << "N/A"
+                      << std::setw(widths[3]) << std::left << lsmRuns[i].value
+                      << std::endl;
+        }
+        std::cout << std::endl
+                  << std::setw(widths[0]) << std::left << "Method"
+                  << std::setw(widths[1]) << std::left << "Time (s)"
+                  << std::setw(widths[2]) << std::left << "Paths/s"
+                  << std::setw(widths[3]) << std::left << "Path mem (kB)";
+        #if defined(QL_ENABLE_ENGINE_INSTRUMENTATION)
+        std::cout << std::setw(widths[3]) << std::left << "Peak heap (kB)";
+        #endif
+        std::cout << std::endl;
+        for (Size i=0; i<3; ++i) {
+            std::cout << std::setw(widths[0]) << std::left << lsmMethods[i]
+                      << std::setw(widths[1]) << std::left
+                      << lsmRuns[i].seconds
+                      << std::setw(widths[2]) << std::left << std::setprecision(0)
+                      << lsmPaths/lsmRuns[i].seconds
+                      << std::setw(widths[3]) << std::left
+                      << lsmPathMemory[i]/1024;
+            #if defined(QL_ENABLE_ENGINE_INSTRUMENTATION)
+            std::cout << std::setw(widths[3]) << std::left
+                      << lsmRuns[i].memory/1024;
+            #endif
+            std::cout << std::setprecision(6) << std::endl;
+        }
+
+        // the Philox LSM pricing on 1 thread, on 64 threads and split
+        // in 16 ranges of paths, as 16 processes would run it; the
+        // block sums are added in block order in all cases, so that
+        // the values and error estimates are the same bit by bit
+        MakeMCAmericanEngine_2<PhiloxRandom> philoxLsm =
+            MakeMCAmericanEngine_2<PhiloxRandom>(bsmProcess)
+                .withSteps(lsmSteps)
+                .withAntitheticVariate()
+                .withCalibrationSamples(4096)
+                .withSamples(32768)
+                .withSeed(lsmSeed);
+        Real threadValues[2], threadErrors[2];
+        Size threadCounts[] = { 1, 64 };
+        for (Size k=0; k<2; ++k) {
+            americanOption.setPricingEngine(
+                MakeMCAmericanEngine_2<PhiloxRandom>(philoxLsm)
+                    .withThreads(threadCounts[k]));
+            threadValues[k] = americanOption.NPV();
+            threadErrors[k] = americanOption.errorEstimate();
+        }
+        Size lsmRanges = 16, lsmRangeSamples = 32768/lsmRanges;
+        BlockStatistics lsmStatistics;
+        for (Size k=0; k<lsmRanges; ++k) {
+            americanOption.setPricingEngine(
+                MakeMCAmericanEngine_2<PhiloxRandom>(philoxLsm)
+                    .withSamples(lsmRangeSamples)
+                    .withFirstPath(k*lsmRangeSamples));
+            lsmStatistics.append(americanOption.result<BlockStatistics>(
+                                                        "blockStatistics"));
+        }
+        bool sameBits = threadValues[1] == threadValues[0] &&
+                        threadErrors[1] == threadErrors[0] &&
+                        lsmStatistics.mean() == threadValues[0] &&
+                        lsmStatistics.errorEstimate() == threadErrors[0];
+        std::cout << "Philox LSM on 1 thread, 64 threads and "
+                  << lsmRanges << " path ranges: " << threadValues[0]
+                  << " +/- " << threadErrors[0] << ", same bits: "
+                  << (sameBits ? "yes" : "no") << std::endl;
+
+        // Heston Monte Carlo, quadratic-exponential against Euler, on
+        // a strongly skewed case; the bias is measured against the
+        // semi-analytic engine
+        ext::shared_ptr<HestonProcess> hestonProcess(
+            new HestonProcess(flatTermStructure, flatDividendTS,
+                              underlyingH, volatility*volatility,
+                              0.5, volatility*volatility, 1.0, -0.9));
+        ext::shared_ptr<HestonModel> hestonModel(
+                                              new HestonModel(hestonProcess));
+        europeanOption.setPricingEngine(ext::shared_ptr<PricingEngine>(
+                                     new AnalyticHestonEngine(hestonModel)));
+        Real hestonValue = europeanOption.NPV();
+        std::cout << std::endl
+                  << std::setw(widths[0]) << std::left << "Heston method"
+                  << std::setw(widths[1]) << std::left << "European"
+                  << std::setw(widths[2]) << std::left << "Bias"
+                  << std::setw(widths[3]) << std::left << "Time (s)"
+                  << std::endl
+                  << std::setw(widths[0]) << std::left
+                  << "Heston semi-analytic"
+                  << std::setw(widths[1]) << std::left << hestonValue
+                  << std::setw(widths[2]) << std::left << "N/A"
+                  << std::setw(widths[3]) << std::left << "N/A"
+                  << std::endl;
+        HestonProcess::Discretization hestonSchemes[] = {
+            HestonProcess::QuadraticExponentialMartingale,
+            HestonProcess::FullTruncation
+        };
+        std::string hestonNames[] = { "MC Heston QE", "MC Heston Euler" };
+        Real qeBias = Null<Real>(), qeError = Null<Real>();
+        Size eulerSteps = Null<Size>();
+        for (Size k=0; k<2; ++k) {
+            for (Size steps=1; steps<=256; steps*=4) {
+                europeanOption.setPricingEngine(
+                    MakeMCHestonEngine_2<PseudoRandom>(hestonProcess)
+                    .withStepsPerYear(steps)
+                    .withSamples(262144)
+                    .withAntitheticVariate()
+                    .withSeed(42)
+                    .withDiscretization(hestonSchemes[k]));
+                boost::chrono::steady_clock::time_point start =
+                    boost::chrono::steady_clock::now();
+                Real value = europeanOption.NPV();
+                double seconds = boost::chrono::duration<double>(
+                         boost::chrono::steady_clock::now() - start).count();
+                Real bias = value - hestonValue;
+                if (k == 0 && steps == 4) {
+                    qeBias = bias;
+                    qeError = europeanOption.errorEstimate();
+                }
+                if (k == 1 && eulerSteps == Null<Size>() &&
+                    std::fabs(bias) <= std::fabs(qeBias) + 2.0*qeError)
+                    eulerSteps = steps;
+                std::ostringstream name;
+                name << hestonNames[k] << " (" << steps << " steps/year)";
+                std::cout << std::setw(widths[0]) << std::left << name.str()
+                          << std::setw(widths[1]) << std::left << value
+                          << std::setw(widths[2]) << std::left << bias
+                          << std::setw(widths[3]) << std::left << seconds
+                          << std::endl;
+            }
+        }
+        std::cout << "Euler steps/year matching the QE error at 4: ";
+        if (eulerSteps != Null<Size>())
+            std::cout << eulerSteps << std::endl;
+        else
+            std::cout << "more than 256" << std::endl;
+
+        // A ladder of American puts at equal accuracy: the trees price
+        // one strike at a time, the batched pricer all of them in one
+        // sweep.  Steps are doubled until the largest error against a
+        // fine Leisen-Reimer tree is below the tolerance.
+        std::vector<ext::shared_ptr<VanillaOption> > ladder;
+        for (Real ladderStrike=30.0; ladderStrike<=50.0; ladderStrike+=1.0)
+            ladder.push_back(ext::shared_ptr<VanillaOption>(
+                new VanillaOption(ext::shared_ptr<StrikedTypePayoff>(
+                          new PlainVanillaPayoff(Option::Put, ladderStrike)),
+                                  americanExercise)));
+        std::vector<Real> ladderValues(ladder.size());
+        for (Size i=0; i<ladder.size(); ++i) {
+            ladder[i]->setPricingEngine(ext::shared_ptr<PricingEngine>(
+                new BinomialVanillaEngine_2<ExtendedLeisenReimer>(bsmProcess,
+                                                                  10001)));
+            ladderValues[i] = ladder[i]->NPV();
+        }
+        Real ladderTolerance = 1.0e-3;
+        std::cout << std::endl
+                  << std::setw(widths[0]) << std::left
+                  << "American ladder (21 strikes)"
+                  << std::setw(widths[1]) << std::left << "Steps"
+                  << std::setw(widths[2]) << std::left << "Max error"
+                  << std::setw(widths[3]) << std::left << "Time (s)"
+                  << std::endl;
+        std::string ladderNames[] = { "Extended Binomial Cox-Ross-Rubinstein",
+                                      "Extended Binomial Leisen-Reimer",
+                                      "Batched Crank-Nicolson" };
+        for (Size k=0; k<3; ++k) {
+            Size steps = 25;
+            Real maxError = 0.0;
+            double seconds = 0.0;
+            for (; steps<=12800; steps*=2) {
+                boost::chrono::steady_clock::time_point start =
+                    boost::chrono::steady_clock::now();
+                std::vector<Real> values(ladder.size());
+                if (k == 2) {
+                    std::vector<CrankNicolsonBatchResult> results =
+                        CrankNicolsonBatchPricer(bsmProcess, steps, steps,
+                                                 2).price(ladder);
+                    for (Size i=0; i<ladder.size(); ++i)
+                        values[i] = results[i].value;
+                } else {
+                    ext::shared_ptr<PricingEngine> engine;
+                    if (k == 0)
+                        engine = ext::shared_ptr<PricingEngine>(
+                            new BinomialVanillaEngine_2<
+                                ExtendedCoxRossRubinstein>(bsmProcess, steps));
+                    else
+                        engine = ext::shared_ptr<PricingEngine>(
+                            new BinomialVanillaEngine_2<
+                                ExtendedLeisenReimer>(bsmProcess, steps));
+                    for (Size i=0; i<ladder.size(); ++i) {
+                        ladder[i]->setPricingEngine(engine);
+                        values[i] = ladder[i]->NPV();
+                    }
+                }
+                seconds = boost::chrono::duration<double>(
+                         boost::chrono::steady_clock::now() - start).count();
+                maxError = 0.0;
+                for (Size i=0; i<ladder.size(); ++i)
+                    maxError = std::max(maxError,
+                                        std::fabs(values[i] - ladderValues[i]));
+                if (maxError <= ladderTolerance)
+                    break;
+            }
+            std::cout << std::setw(widths[0]) << std::left << ladderNames[k]
+                      << std::setw(widths[1]) << std::left
+                      << std::min<Size>(steps, 12800)
+                      << std::setw(widths[2]) << std::left << maxError
+                      << std::setw(widths[3]) << std::left << seconds
+                      << std::endl;
+        }
+
+        // Puts at several strikes and maturities, with the fixed 5000
+        // steps used above against steps chosen for a 1e-3 tolerance
+        std::vector<ext::shared_ptr<VanillaOption> > mixedBook;
+        for (Size m=1; m<=4; ++m) {
+            ext::shared_ptr<Exercise> mixedExercise(new AmericanExercise(
+                settlementDate, settlementDate + Integer(3*m)*Months));
+            for (Real mixedStrike=30.0; mixedStrike<=50.0; mixedStrike+=4.0)
+                mixedBook.push_back(ext::shared_ptr<VanillaOption>(
+                    new VanillaOption(ext::shared_ptr<StrikedTypePayoff>(
+                          new PlainVanillaPayoff(Option::Put, mixedStrike)),
+                                      mixedExercise)));
+        }
+        ext::shared_ptr<PricingEngine> fixedEngine(
+            new BinomialVanillaEngine_2<ExtendedCoxRossRubinstein>(bsmProcess,
+                                                                  timeSteps));
+        ext::shared_ptr<PricingEngine> adaptiveEngine(
+            new AdaptiveBinomialVanillaEngine_2<ExtendedCoxRossRubinstein>(
+                                                         bsmProcess, 1.0e-3));
+        Real mixedDifference = 0.0;
+        Size mixedSteps = 0;
+        double fixedSeconds = 0.0, adaptiveSeconds = 0.0;
+        for (Size i=0; i<mixedBook.size(); ++i) {
+            boost::chrono::steady_clock::time_point start =
+                boost::chrono::steady_clock::now();
+            mixedBook[i]->setPricingEngine(fixedEngine);
+            Real fixedValue = mixedBook[i]->NPV();
+            boost::chrono::steady_clock::time_point middle =
+                boost::chrono::steady_clock::now();
+            mixedBook[i]->setPricingEngine(adaptiveEngine);
+            Real adaptiveValue = mixedBook[i]->NPV();
+            boost::chrono::steady_clock::time_point end =
+                boost::chrono::steady_clock::now();
+            fixedSeconds +=
+                boost::chrono::duration<double>(middle - start).count();
+            adaptiveSeconds +=
+                boost::chrono::duration<double>(end - middle).count();
+            mixedDifference = std::max(mixedDifference,
+                                       std::fabs(adaptiveValue - fixedValue));
+            mixedSteps += mixedBook[i]->result<Size>("timeSteps");
+        }
+        std::cout << "Adaptive steps on " << mixedBook.size()
+                  << " options: " << mixedSteps/mixedBook.size()
+                  << " steps on average, " << adaptiveSeconds
+                  << " s against " << fixedSeconds << " s with "
+                  << timeSteps << " steps (max difference "
+                  << mixedDifference << ")" << std::endl;
+
+        // Portfolio of American options priced on all available cores
+        std::cout << std::endl;
+        Size bookSize = 2000;
+        ext::shared_ptr<PortfolioEngineFactory> bookEngines[] = {
+            ext::shared_ptr<PortfolioEngineFactory>(new BinomialEngineFactory<
+                BinomialVanillaEngine_2<ExtendedCoxRossRubinstein> >(
+                                                         bsmProcess, 250)),
+            ext::shared_ptr<PortfolioEngineFactory>(new BinomialEngineFactory<
+                BinomialVanillaEngine_2<ExtendedCoxRossRubinstein> >(
+                                                         bsmProcess, 500)),
+            ext::shared_ptr<PortfolioEngineFactory>(new BinomialEngineFactory<
+                BinomialVanillaEngine_2<ExtendedCoxRossRubinstein> >(
+                                                         bsmProcess, 1000))
+        };
+        std::vector<PortfolioJob> book;
+        for (Size i=0; i<bookSize; ++i) {
+            Option::Type bookType = (i % 2 == 0 ? Option::Put : Option::Call);
+            Real bookStrike = 30.0 + (i % 21);
+            Date bookMaturity =
+                settlementDate + Integer(3*(1 + i % 8))*Months;
+            ext::shared_ptr<VanillaOption> bookOption(new VanillaOption(
+                ext::shared_ptr<StrikedTypePayoff>(
+                               new PlainVanillaPayoff(bookType, bookStrike)),
+                ext::shared_ptr<Exercise>(
+                        new AmericanExercise(settlementDate, bookMaturity))));
+            book.push_back(PortfolioJob(bookOption, bookEngines[i % 3]));
+        }
+
+        PortfolioPricer pricer;
+        boost::chrono::steady_clock::time_point bookStart =
+            boost::chrono::steady_clock::now();
+        std::vector<PortfolioResult> bookResults = pricer.price(book);
+        double bookSeconds = boost::chrono::duration<double>(
+                      boost::chrono::steady_clock::now() - bookStart).count();
+
+        Real bookValue = 0.0, bookDelta = 0.0;
+        double jobSeconds = 0.0;
+        Size failures = 0;
+        for (Size i=0; i<bookResults.size(); ++i) {
+            const PortfolioResult& r = bookResults[i];
+            jobSeconds += r.seconds;
+            if (!r.error.empty()) {
+                ++failures;
+                continue;
+            }
+            bookValue += r.value;
+            bookDelta += r.delta;
+        }
+        std::cout << "Portfolio of " << bookSize << " American options on "
+                  << pricer.threads() << " threads" << std::endl;
+        std::cout << "Value = " << bookValue << ", delta = " << bookDelta
+                  << ", failures = " << failures << std::endl;
+        std::cout << "Priced in " << bookSeconds << " s ("
+                  << jobSeconds << " s of pricing time)" << std::endl;
+
+        // The same book priced asynchronously, along with a long Monte
+        // Carlo run stopped by its deadline and one cancelled by the
+        // caller; this thread only submits and collects
+        std::cout << std::endl;
+        ext::shared_ptr<PortfolioEngineFactory> longMonteCarlo(
+            new MonteCarloEngineFactory<MCEuropeanEngine_2<PseudoRandom> >(
+                                                bsmProcess, 1, 100000000, 42));
+        boost::chrono::steady_clock::time_point asyncStart =
+            boost::chrono::steady_clock::now();
+        // the deadline puts the long run ahead of the book
+        std::vector<PricingTicket> tickets;
+        Size reports = 0;
+        {
+            AsyncPricer asyncPricer;
+            for (Size i=0; i<book.size(); ++i)
+                tickets.push_back(
+                    asyncPricer.priceAsync(book[i].option, book[i].engine));
+            ext::shared_ptr<VanillaOption> longOption(
+                              new VanillaOption(payoff, europeanExercise));
+            PricingTicket expiring = asyncPricer.priceAsync(
+                longOption, longMonteCarlo,
+                asyncStart + boost::chrono::seconds(2),
+                boost::bind(&countProgress, boost::ref(reports), _1, _2));
+            PricingTicket cancelled =
+                asyncPricer.priceAsync(longOption, longMonteCarlo);
+            std::cout << "Submitted " << tickets.size() + 2
+                      << " pricings to " << asyncPricer.threads()
+                      << " threads in "
+                      << boost::chrono::duration<double>(
+                             boost::chrono::steady_clock::now() - asyncStart)
+                         .count()
+                      << " s" << std::endl;
+            cancelled.cancel();
+            std::cout << "Monte Carlo with deadline: "
+                      << expiring.result().get().error
+                      << " after " << reports << " progress reports"
+                      << std::endl;
+            std::cout << "Cancelled Monte Carlo: "
+                      << cancelled.result().get().error << std::endl;
+            // pending pricings would be cancelled with the pricer
+            for (Size i=0; i<tickets.size(); ++i)
+                tickets[i].result().wait();
+        }
+        Real asyncValue = 0.0;
+        Size asyncFailures = 0;
+        for (Size i=0; i<tickets.size(); ++i) {
+            const PortfolioResult& r = tickets[i].result().get();
+            if (!r.error.empty())
+                ++asyncFailures;
+            else
+                asyncValue += r.value;
+        }
+        std::cout << "Asynchronous book value = " << asyncValue
+                  << ", failures = " << asyncFailures << ", in "
+                  << boost::chrono::duration<double>(
+                         boost::chrono::steady_clock::now() - asyncStart)
+                     .count()
+                  << " s" << std::endl;
 
         // End test
         double seconds = timer.elapsed();
@@ -0,0 +1,221 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+#include "portfoliopricer.hpp"
+#include "../project3/routingengine.hpp"
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/chrono.hpp>
+#include <algorithm>
+#include <deque>
+#include <map>
+
+namespace QuantLib {
+
+    namespace {
+
+        struct WorkQueue {
+            boost::mutex mutex;
+            std::deque<Size> jobs;
+        };
+
+        class CostGreater {
+          public:
+            explicit CostGreater(const std::vector<Real>& costs)
+            : costs_(costs) {}
+            bool operator()(Size i, Size j) const {
+                return costs_[i] > costs_[j];
+            }
+          private:
+            const std::vector<Real>& costs_;
+        };
+
+        typedef std::map<const PortfolioEngineFactory*,
+                         ext::shared_ptr<PricingEngine> > EngineMap;
+
+        class PortfolioWorker {
+          public:
+            PortfolioWorker(Size index,
+                            const std::vector<PortfolioJob>& jobs,
+                            std::vector<ext::shared_ptr<WorkQueue> >& queues,
+                            std::vector<PortfolioResult>& results,
+                            EngineMap& engines,
+                            boost::mutex& registration)
+            : index_(index), jobs_(jobs), queues_(queues),
+              results_(results), engines_(engines),
+              registration_(registration) {}
+            void operator()() {
+                Size job;
+                while (next(job))
+                    price(job);
+            }
+          private:
+            bool next(Size& job) {
+                // own queue first, most expensive job
+                {
+                    WorkQueue& own = *queues_[index_];
+                    boost::mutex::scoped_lock lock(own.mutex);
+                    if (!own.jobs.empty()) {
+                        job = own.jobs.front();
+                        own.jobs.pop_front();
+                        return true;
+                    }
+                }
+                // then steal the cheapest job of another worker
+                Size n = queues_.size();
+                for (Size k=1; k<n; ++k) {
+                    WorkQueue& other = *queues_[(index_+k) % n];
+                    boost::mutex::scoped_lock lock(other.mutex);
+                    if (!other.jobs.empty()) {
+                        job = other.jobs.back();
+                        other.jobs.pop_back();
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            const ext::shared_ptr<PricingEngine>& engine(
+                                     const PortfolioEngineFactory* factory) {
+                ext::shared_ptr<PricingEngine>& engine = engines_[factory];
+                if (!engine) {
+                    // engines register with the process as observers,
+                    // which is not a thread-safe operation
+                    boost::mutex::scoped_lock lock(registration_);
+                    engine = factory->create();
+                }
+                return engine;
+            }
+
+            void price(Size i) {
+                typedef boost::chrono::steady_clock clock;
+                const PortfolioJob& job = jobs_[i];
+                PortfolioResult& result = results_[i];
+                result.worker = index_;
+                clock::time_point start = clock::now();
+                try {
+                    QL_REQUIRE(job.option, "no option given");
+                    QL_REQUIRE(job.engine, "no engine given");
+                    const ext::shared_ptr<PricingEngine>& e =
+                        engine(job.engine.get());
+                    e->reset();
+                    job.option->setupArguments(e->getArguments());
+                    e->getArguments()->validate();
+                    e->calculate();
+
+                    const OneAssetOption::results* r =
+                        dynamic_cast<const OneAssetOption::results*>(
+                                                          e->getResults());
+                    QL_ENSURE(r != 0, "no results returned from engine");
+                    result.value = r->value;
+                    result.errorEstimate = r->errorEstimate;
+                    result.delta = r->delta;
+                    result.gamma = r->gamma;
+                    result.theta = r->theta;
+                    result.vega = r->vega;
+                    result.rho = r->rho;
+                    result.dividendRho = r->dividendRho;
+                } catch (std::exception& e) {
+                    result.error = e.what();
+                } catch (...) {
+                    result.error = "unknown error";
+                }
+                result.seconds =
+                    boost::chrono::duration<double>(clock::now()-start)
+                    .count();
+            }
+
+            Size index_;
+            const std::vector<PortfolioJob>& jobs_;
+            std::vector<ext::shared_ptr<WorkQueue> >& queues_;
+            std::vector<PortfolioResult>& results_;
+            EngineMap& engines_;
+            boost::mutex& registration_;
+        };
+
+    }
+
+
+    RoutingEngineFactory::RoutingEngineFactory(
+             const ext::shared_ptr<PortfolioEngineFactory>& engine,
+             const ext::shared_ptr<GeneralizedBlackScholesProcess>& process)
+    : engine_(engine), process_(process) {
+        QL_REQUIRE(engine_, "no engine configuration given");
+    }
+
+    ext::shared_ptr<PricingEngine> RoutingEngineFactory::create() const {
+        return ext::shared_ptr<PricingEngine>(
+                 new RoutingVanillaEngine_2(engine_->create(), process_));
+    }
+
+
+    PortfolioResult::PortfolioResult()
+    : value(Null<Real>()), errorEstimate(Null<Real>()),
+      delta(Null<Real>()), gamma(Null<Real>()), theta(Null<Real>()),
+      vega(Null<Real>()), rho(Null<Real>()), dividendRho(Null<Real>()),
+      seconds(0.0), worker(Null<Size>()) {}
+
+
+    PortfolioPricer::PortfolioPricer(Size threads)
+    : threads_(threads) {
+        if (threads_ == 0)
+            threads_ = std::max<Size>(boost::thread::hardware_concurrency(),
+                                      1);
+    }
+
+    std::vector<PortfolioResult> PortfolioPricer::price(
+                                const std::vector<PortfolioJob>& jobs) const {
+
+        std::vector<PortfolioResult> results(jobs.size());
+        if (jobs.empty())
+            return results;
+
+        // sort by decreasing cost and deal the jobs to the workers, so
+        // that each queue starts with its most expensive job
+        std::vector<Real> costs(jobs.size(), 0.0);
+        std::vector<Size> order(jobs.size());
+        for (Size i=0; i<jobs.size(); ++i) {
+            if (jobs[i].engine)
+                costs[i] = jobs[i].engine->cost();
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(), CostGreater(costs));
+
+        Size n = std::min(threads_, jobs.size());
+        std::vector<ext::shared_ptr<WorkQueue> > queues(n);
+        for (Size k=0; k<n; ++k)
+            queues[k] = ext::shared_ptr<WorkQueue>(new WorkQueue);
+        for (Size i=0; i<order.size(); ++i)
+            queues[i % n]->jobs.push_back(order[i]);
+
+        // the engines outlive the threads, so that they are also
+        // unregistered from their processes on this thread
+        std::vector<EngineMap> engines(n);
+        boost::mutex registration;
+
+        boost::thread_group workers;
+        for (Size k=1; k<n; ++k)
+            workers.create_thread(PortfolioWorker(k, jobs, queues, results,
+                                                  engines[k], registration));
+        PortfolioWorker(0, jobs, queues, results,
+                        engines[0], registration)();
+        workers.join_all();
+
+        return results;
+    }
+
+}
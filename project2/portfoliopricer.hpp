@@ -0,0 +1,181 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file portfoliopricer.hpp
+    \brief Multi-threaded pricing of a portfolio of vanilla options
+*/
+
+#ifndef portfolio_pricer_hpp
+#define portfolio_pricer_hpp
+
+#include <ql/instruments/vanillaoption.hpp>
+#include <ql/processes/blackscholesprocess.hpp>
+#include <ql/utilities/null.hpp>
+#include <string>
+#include <vector>
+
+namespace QuantLib {
+
+    //! Engine configuration for a portfolio job
+    /*! Each worker of the PortfolioPricer builds its own engines
+        from the configuration, so that tree and lattice workspaces
+        are never shared between threads.
+    */
+    class PortfolioEngineFactory {
+      public:
+        virtual ~PortfolioEngineFactory() {}
+        //! returns a new engine
+        virtual ext::shared_ptr<PricingEngine> create() const = 0;
+        //! estimated cost of a single pricing, in arbitrary units
+        virtual Real cost() const = 0;
+    };
+
+
+    //! Binomial engine configuration
+    /*! The engine must be constructible from a process and a number
+        of time steps, as BinomialVanillaEngine is; the cost of a
+        pricing is estimated as the square of the number of steps.
+    */
+    template <class Engine>
+    class BinomialEngineFactory : public PortfolioEngineFactory {
+      public:
+        BinomialEngineFactory(
+             const ext::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             Size timeSteps)
+        : process_(process), timeSteps_(timeSteps) {}
+        ext::shared_ptr<PricingEngine> create() const {
+            return ext::shared_ptr<PricingEngine>(
+                                         new Engine(process_, timeSteps_));
+        }
+        Real cost() const { return Real(timeSteps_)*timeSteps_; }
+      private:
+        ext::shared_ptr<GeneralizedBlackScholesProcess> process_;
+        Size timeSteps_;
+    };
+
+
+    //! Monte Carlo engine configuration
+    /*! The engine must have the constructor signature of
+        MCEuropeanEngine; the cost of a pricing is estimated as the
+        number of samples times the number of time steps.
+    */
+    template <class Engine>
+    class MonteCarloEngineFactory : public PortfolioEngineFactory {
+      public:
+        MonteCarloEngineFactory(
+             const ext::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             Size timeSteps,
+             Size samples,
+             BigNatural seed,
+             bool antitheticVariate = false)
+        : process_(process), timeSteps_(timeSteps), samples_(samples),
+          seed_(seed), antitheticVariate_(antitheticVariate) {}
+        ext::shared_ptr<PricingEngine> create() const {
+            return ext::shared_ptr<PricingEngine>(
+                new Engine(process_, timeSteps_, Null<Size>(), false,
+                           antitheticVariate_, samples_, Null<Real>(),
+                           Null<Size>(), seed_));
+        }
+        Real cost() const { return Real(samples_)*timeSteps_; }
+      private:
+        ext::shared_ptr<GeneralizedBlackScholesProcess> process_;
+        Size timeSteps_, samples_;
+        BigNatural seed_;
+        bool antitheticVariate_;
+    };
+
+
+    //! Configuration sending options with a closed form around the tree
+    /*! The engines of the given configuration are wrapped in a
+        RoutingVanillaEngine_2, so that European options and calls
+        whose early exercise is never optimal are priced
+        analytically.  The estimated cost is the one of the given
+        configuration, and thus an upper bound.
+    */
+    class RoutingEngineFactory : public PortfolioEngineFactory {
+      public:
+        RoutingEngineFactory(
+             const ext::shared_ptr<PortfolioEngineFactory>& engine,
+             const ext::shared_ptr<GeneralizedBlackScholesProcess>& process);
+        ext::shared_ptr<PricingEngine> create() const;
+        Real cost() const { return engine_->cost(); }
+      private:
+        ext::shared_ptr<PortfolioEngineFactory> engine_;
+        ext::shared_ptr<GeneralizedBlackScholesProcess> process_;
+    };
+
+
+    //! Option to be priced with a given engine configuration
+    struct PortfolioJob {
+        PortfolioJob() {}
+        PortfolioJob(const ext::shared_ptr<VanillaOption>& option,
+                     const ext::shared_ptr<PortfolioEngineFactory>& engine)
+        : option(option), engine(engine) {}
+        ext::shared_ptr<VanillaOption> option;
+        ext::shared_ptr<PortfolioEngineFactory> engine;
+    };
+
+
+    //! Results of a portfolio job
+    /*! Greeks not provided by the engine are set to Null<Real>();
+        if the pricing failed, error holds the message of the
+        exception and all values are null.
+    */
+    struct PortfolioResult {
+        PortfolioResult();
+        Real value, errorEstimate;
+        Real delta, gamma, theta, vega, rho, dividendRho;
+        //! wall-clock time spent on the job, in seconds
+        double seconds;
+        //! index of the worker that priced the job
+        Size worker;
+        std::string error;
+    };
+
+
+    //! Multi-threaded pricer for a portfolio of vanilla options
+    /*! Jobs are sorted by decreasing estimated cost and dealt to the
+        queues of the workers, which price the most expensive ones
+        first; a worker whose queue is empty steals the cheapest
+        remaining job from the other queues.
+
+        Each worker builds its own engines, one per engine
+        configuration it encounters; the options are not modified,
+        since the arguments are passed directly to the engines.
+
+        \warning market data must not change during the pricing, and
+                 lazy term structures should be calculated beforehand
+                 (e.g., by pricing one option on the calling thread)
+                 since they are read concurrently by the workers.
+    */
+    class PortfolioPricer {
+      public:
+        /*! if no number of threads is given, the available hardware
+            concurrency is used.
+        */
+        explicit PortfolioPricer(Size threads = 0);
+        std::vector<PortfolioResult> price(
+                                const std::vector<PortfolioJob>& jobs) const;
+        Size threads() const { return threads_; }
+      private:
+        Size threads_;
+    };
+
+}
+
+
+#endif
@@ -0,0 +1,286 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+#include "pricingservice.hpp"
+#include "../project3/binomialengine.hpp"
+#include "../project3/binomialtree.hpp"
+#include <ql/instruments/vanillaoption.hpp>
+#include <ql/settings.hpp>
+#include <ql/termstructures/yield/flatforward.hpp>
+#include <ql/termstructures/volatility/equityfx/blackconstantvol.hpp>
+#include <ql/time/calendars/nullcalendar.hpp>
+#include <ql/time/daycounters/actual365fixed.hpp>
+#include <cstdlib>
+#include <sstream>
+
+namespace QuantLib {
+
+    namespace {
+
+        std::vector<std::string> split(const std::string& line) {
+            std::vector<std::string> fields;
+            std::istringstream in(line);
+            std::string field;
+            while (in >> field)
+                fields.push_back(field);
+            return fields;
+        }
+
+        Real toReal(const std::string& field) {
+            char* end;
+            Real x = std::strtod(field.c_str(), &end);
+            QL_REQUIRE(!field.empty() && *end == '\0',
+                       "invalid number: " << field);
+            return x;
+        }
+
+        Integer toInteger(const std::string& field) {
+            char* end;
+            long n = std::strtol(field.c_str(), &end, 10);
+            QL_REQUIRE(!field.empty() && *end == '\0',
+                       "invalid integer: " << field);
+            return Integer(n);
+        }
+
+        template <class T>
+        ext::shared_ptr<PricingEngine> binomialEngine(
+             const ext::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             Size steps) {
+            return ext::shared_ptr<PricingEngine>(
+                       new BinomialVanillaEngine_2<T>(process, steps, true));
+        }
+
+    }
+
+
+    PricingService::PricingService(Size maxSteps,
+                                   Size enginesPerUnderlying)
+    : maxSteps_(maxSteps), enginesPerUnderlying_(enginesPerUnderlying) {
+        QL_REQUIRE(maxSteps > 0, "positive maximum number of steps required");
+        QL_REQUIRE(enginesPerUnderlying > 0,
+                   "positive number of engines required");
+    }
+
+    std::vector<std::string> PricingService::process(
+                                const std::vector<std::string>& requests) {
+        std::vector<std::string> replies(requests.size());
+        std::vector<Fields> fields(requests.size());
+        // PRICE requests by underlying, since the last MARKET request
+        std::map<std::string, std::vector<Size> > groups;
+
+        for (Size i=0; i<requests.size(); ++i) {
+            fields[i] = split(requests[i]);
+            if (fields[i].empty()) {
+                replies[i] = "ERROR empty request";
+            } else if (fields[i][0] == "PRICE") {
+                std::string underlying =
+                    fields[i].size() > 2 ? fields[i][2] : std::string();
+                groups[underlying].push_back(i);
+            } else if (fields[i][0] == "MARKET") {
+                priceGroups(fields, groups, replies);
+                try {
+                    replies[i] = market(fields[i]);
+                } catch (std::exception& e) {
+                    replies[i] = std::string("ERROR ") + e.what();
+                }
+            } else {
+                replies[i] = "ERROR unknown request " + fields[i][0];
+            }
+        }
+        priceGroups(fields, groups, replies);
+
+        return replies;
+    }
+
+    void PricingService::priceGroups(
+                    const std::vector<Fields>& requests,
+                    std::map<std::string, std::vector<Size> >& groups,
+                    std::vector<std::string>& replies) {
+        for (std::map<std::string, std::vector<Size> >::const_iterator g =
+                 groups.begin(); g != groups.end(); ++g) {
+            std::map<std::string, PricingSnapshot>::iterator snapshot =
+                snapshots_.find(g->first);
+            for (Size k=0; k<g->second.size(); ++k) {
+                Size i = g->second[k];
+                const Fields& fields = requests[i];
+                std::string id = fields.size() > 1 ? fields[1] : "?";
+                try {
+                    QL_REQUIRE(snapshot != snapshots_.end(),
+                               "unknown underlying " << g->first);
+                    replies[i] = id + " OK " +
+                                 price(fields, snapshot->second);
+                } catch (std::exception& e) {
+                    replies[i] = id + " ERROR " + e.what();
+                }
+            }
+        }
+        groups.clear();
+    }
+
+    std::string PricingService::market(const Fields& fields) {
+        QL_REQUIRE(fields.size() == 6,
+                   "usage: MARKET <underlying> <spot> <rate> <dividend> "
+                   "<volatility>");
+        Real spot = toReal(fields[2]);
+        Rate rate = toReal(fields[3]);
+        Rate dividend = toReal(fields[4]);
+        Volatility volatility = toReal(fields[5]);
+        QL_REQUIRE(spot > 0.0, "positive spot required");
+        QL_REQUIRE(volatility > 0.0, "positive volatility required");
+
+        std::map<std::string, PricingSnapshot>::iterator i =
+            snapshots_.find(fields[1]);
+        if (i != snapshots_.end()) {
+            PricingSnapshot& snapshot = i->second;
+            snapshot.spot->setValue(spot);
+            snapshot.rate->setValue(rate);
+            snapshot.dividend->setValue(dividend);
+            snapshot.volatility->setValue(volatility);
+        } else {
+            PricingSnapshot& snapshot = snapshots_[fields[1]];
+            snapshot.spot =
+                ext::shared_ptr<SimpleQuote>(new SimpleQuote(spot));
+            snapshot.rate =
+                ext::shared_ptr<SimpleQuote>(new SimpleQuote(rate));
+            snapshot.dividend =
+                ext::shared_ptr<SimpleQuote>(new SimpleQuote(dividend));
+            snapshot.volatility =
+                ext::shared_ptr<SimpleQuote>(new SimpleQuote(volatility));
+
+            DayCounter dayCounter = Actual365Fixed();
+            Handle<YieldTermStructure> riskFree(
+                ext::shared_ptr<YieldTermStructure>(
+                    new FlatForward(0, NullCalendar(),
+                                    Handle<Quote>(snapshot.rate),
+                                    dayCounter)));
+            Handle<YieldTermStructure> dividends(
+                ext::shared_ptr<YieldTermStructure>(
+                    new FlatForward(0, NullCalendar(),
+                                    Handle<Quote>(snapshot.dividend),
+                                    dayCounter)));
+            Handle<BlackVolTermStructure> vol(
+                ext::shared_ptr<BlackVolTermStructure>(
+                    new BlackConstantVol(0, NullCalendar(),
+                                         Handle<Quote>(snapshot.volatility),
+                                         dayCounter)));
+            snapshot.process =
+                ext::shared_ptr<GeneralizedBlackScholesProcess>(
+                    new BlackScholesMertonProcess(
+                                           Handle<Quote>(snapshot.spot),
+                                           dividends, riskFree, vol));
+        }
+        return "OK MARKET " + fields[1];
+    }
+
+    std::string PricingService::price(const Fields& fields,
+                                      PricingSnapshot& snapshot) {
+        QL_REQUIRE(fields.size() == 9,
+                   "usage: PRICE <id> <underlying> <call|put> <strike> "
+                   "<days> <european|american> <model> <steps>");
+        Option::Type type;
+        if (fields[3] == "call")
+            type = Option::Call;
+        else if (fields[3] == "put")
+            type = Option::Put;
+        else
+            QL_FAIL("unknown option type " << fields[3]);
+        Real strike = toReal(fields[4]);
+        Integer days = toInteger(fields[5]);
+        QL_REQUIRE(days > 0, "positive maturity required");
+        Integer steps = toInteger(fields[8]);
+        QL_REQUIRE(steps > 0, "positive number of steps required");
+        QL_REQUIRE(Size(steps) <= maxSteps_,
+                   steps << " steps requested, at most "
+                   << maxSteps_ << " allowed");
+
+        Date today = Settings::instance().evaluationDate();
+        Date maturity = today + days;
+        ext::shared_ptr<Exercise> exercise;
+        if (fields[6] == "european")
+            exercise = ext::shared_ptr<Exercise>(
+                                          new EuropeanExercise(maturity));
+        else if (fields[6] == "american")
+            exercise = ext::shared_ptr<Exercise>(
+                                   new AmericanExercise(today, maturity));
+        else
+            QL_FAIL("unknown exercise " << fields[6]);
+
+        VanillaOption option(ext::shared_ptr<StrikedTypePayoff>(
+                                     new PlainVanillaPayoff(type, strike)),
+                             exercise);
+        const ext::shared_ptr<PricingEngine>& e =
+            engine(snapshot, fields[7], steps);
+        e->reset();
+        option.setupArguments(e->getArguments());
+        e->getArguments()->validate();
+        e->calculate();
+        const OneAssetOption::results* r =
+            dynamic_cast<const OneAssetOption::results*>(e->getResults());
+        QL_ENSURE(r != 0, "no results returned from engine");
+
+        std::ostringstream out;
+        out.precision(10);
+        out << r->value << " " << r->delta << " " << r->gamma << " "
+            << r->theta << " " << r->vega << " " << r->rho;
+        return out.str();
+    }
+
+    const ext::shared_ptr<PricingEngine>& PricingService::engine(
+                                              PricingSnapshot& snapshot,
+                                              const std::string& model,
+                                              Size steps) {
+        std::ostringstream key;
+        key << model << ":" << steps;
+        std::map<std::string,
+                 PricingSnapshot::engine_list::iterator>::iterator i =
+            snapshot.index.find(key.str());
+        if (i != snapshot.index.end()) {
+            snapshot.engines.splice(snapshot.engines.begin(),
+                                    snapshot.engines, i->second);
+            return i->second->second;
+        }
+
+        // the engine is stored only once built, so that a failed
+        // construction leaves no null entry behind
+        const ext::shared_ptr<GeneralizedBlackScholesProcess>& p =
+            snapshot.process;
+        ext::shared_ptr<PricingEngine> engine;
+        if (model == "jr")
+            engine = binomialEngine<JarrowRudd_2>(p, steps);
+        else if (model == "crr")
+            engine = binomialEngine<CoxRossRubinstein_2>(p, steps);
+        else if (model == "eqp")
+            engine = binomialEngine<AdditiveEQPBinomialTree_2>(p, steps);
+        else if (model == "trigeorgis")
+            engine = binomialEngine<Trigeorgis_2>(p, steps);
+        else if (model == "tian")
+            engine = binomialEngine<Tian_2>(p, steps);
+        else if (model == "lr")
+            engine = binomialEngine<LeisenReimer_2>(p, steps);
+        else if (model == "joshi")
+            engine = binomialEngine<Joshi4_2>(p, steps);
+        QL_REQUIRE(engine, "unknown model " << model);
+        snapshot.engines.push_front(std::make_pair(key.str(), engine));
+        snapshot.index[key.str()] = snapshot.engines.begin();
+        while (snapshot.engines.size() > enginesPerUnderlying_) {
+            snapshot.index.erase(snapshot.engines.back().first);
+            snapshot.engines.pop_back();
+        }
+        return snapshot.engines.front().second;
+    }
+
+}
@@ -0,0 +1,111 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file pricingservice.hpp
+    \brief Resident pricing of vanilla options on in-memory market data
+*/
+
+#ifndef pricing_service_hpp
+#define pricing_service_hpp
+
+#include <ql/pricingengine.hpp>
+#include <ql/processes/blackscholesprocess.hpp>
+#include <ql/quotes/simplequote.hpp>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace QuantLib {
+
+    //! Market data of an underlying kept by the PricingService
+    /*! The curves are flat and move with the evaluation date; updates
+        are applied to the quotes, so that the process and the cached
+        engines are kept.
+    */
+    struct PricingSnapshot {
+        ext::shared_ptr<SimpleQuote> spot, rate, dividend, volatility;
+        ext::shared_ptr<GeneralizedBlackScholesProcess> process;
+        typedef std::list<std::pair<std::string,
+                                    ext::shared_ptr<PricingEngine> > >
+            engine_list;
+        //! engines by model and number of steps, most recently used first
+        engine_list engines;
+        std::map<std::string, engine_list::iterator> index;
+    };
+
+
+    //! Line-protocol pricing of vanilla options
+    /*! Each request is a line of whitespace-separated fields and
+        gets exactly one reply line:
+
+        \code
+        MARKET <underlying> <spot> <rate> <dividend> <volatility>
+          -> OK MARKET <underlying>
+        PRICE <id> <underlying> <call|put> <strike> <days>
+              <european|american> <model> <steps>
+          -> <id> OK <npv> <delta> <gamma> <theta> <vega> <rho>
+        \endcode
+
+        Rates, yields and volatilities are continuously compounded
+        and annual; maturities are given in calendar days from the
+        evaluation date.  Models are jr, crr, eqp, trigeorgis, tian,
+        lr and joshi, and options are priced by
+        BinomialVanillaEngine_2 with adjoint greeks.  Failed requests
+        get <tt>ERROR <message></tt>, prefixed by the id for PRICE
+        requests.
+
+        Requests are processed in batches: MARKET requests are
+        applied in order, and the PRICE requests between them are
+        grouped by underlying, so that each group reuses the
+        snapshot and engines of its underlying.
+
+        Requests for more than the given maximum number of steps are
+        rejected, and each underlying keeps at most the given number
+        of engines, evicting the least recently used one; this bounds
+        both the time of a request and the memory of the service.
+    */
+    class PricingService {
+      public:
+        explicit PricingService(Size maxSteps = 10000,
+                                Size enginesPerUnderlying = 8);
+        //! processes a batch of requests and returns the replies
+        std::vector<std::string> process(
+                              const std::vector<std::string>& requests);
+        //! number of underlyings in memory
+        Size underlyings() const { return snapshots_.size(); }
+        Size maxSteps() const { return maxSteps_; }
+        Size enginesPerUnderlying() const { return enginesPerUnderlying_; }
+      private:
+        typedef std::vector<std::string> Fields;
+        std::string market(const Fields& fields);
+        std::string price(const Fields& fields, PricingSnapshot& snapshot);
+        void priceGroups(const std::vector<Fields>& requests,
+                         std::map<std::string, std::vector<Size> >& groups,
+                         std::vector<std::string>& replies);
+        const ext::shared_ptr<PricingEngine>& engine(
+                                              PricingSnapshot& snapshot,
+                                              const std::string& model,
+                                              Size steps);
+        Size maxSteps_, enginesPerUnderlying_;
+        std::map<std::string, PricingSnapshot> snapshots_;
+    };
+
+}
+
+
+#endif
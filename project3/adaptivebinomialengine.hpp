@@ -0,0 +1,161 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file adaptivebinomialengine.hpp
+    \brief Binomial engine choosing its number of steps from a tolerance
+*/
+
+#ifndef adaptive_binomial_engine_hpp
+#define adaptive_binomial_engine_hpp
+
+#include "binomialengine.hpp"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace QuantLib {
+
+    //! Binomial engine refining its tree up to a given tolerance
+    /*! The option is priced by BinomialVanillaEngine_2 with
+        n_0, 2n_0+1, 4n_0+3... steps; odd numbers are kept throughout,
+        so that trees requiring them (such as LeisenReimer_2 and
+        Joshi4_2) use the requested steps.  From the third level on,
+        the discretization error of the last value is estimated from
+        the differences d_k between successive values as the largest
+        of |d_k| and |d_{k-1}|/2, i.e., the error of a first-order
+        method; the second term guards against a difference vanishing
+        by chance, as it does for trees whose convergence oscillates
+        (e.g., CoxRossRubinstein_2).  The estimate is conservative for
+        second-order trees such as LeisenReimer_2, but the values of
+        oscillating trees can still stall over a few levels and have
+        an error somewhat above the tolerance.
+
+        Refinement stops when the estimate is within the tolerance;
+        the value and greeks of the last tree are returned, with the
+        estimate as the error estimate and the number of steps as the
+        "timeSteps" additional result.  An exception is raised if
+        the tolerance is not reached within the maximum number of
+        steps.
+
+        The engines of each level are kept, so that repeated
+        calculations reuse their workspaces.
+    */
+    template <class T>
+    class AdaptiveBinomialVanillaEngine_2 : public VanillaOption::engine {
+      public:
+        AdaptiveBinomialVanillaEngine_2(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             Real tolerance,
+             Size initialSteps = 31,
+             Size maxSteps = 16383,
+             bool adjointGreeks = false,
+             Real truncation = Null<Real>(),
+             bool blackScholesSmoothing = false,
+             const DividendSchedule& dividends = DividendSchedule())
+        : process_(process), tolerance_(tolerance),
+          initialSteps_(initialSteps % 2 ? initialSteps : initialSteps+1),
+          maxSteps_(maxSteps), adjointGreeks_(adjointGreeks),
+          truncation_(truncation), smoothing_(blackScholesSmoothing),
+          dividends_(dividends) {
+            QL_REQUIRE(tolerance > 0.0,
+                       "positive tolerance required, "
+                       << tolerance << " provided");
+            QL_REQUIRE(initialSteps >= 3,
+                       "at least 3 initial steps required, "
+                       << initialSteps << " provided");
+            QL_REQUIRE(maxSteps >= 4*initialSteps_ + 3,
+                       "at least three levels required below "
+                       << maxSteps << " steps");
+            registerWith(process_);
+        }
+        void calculate() const;
+      private:
+        const boost::shared_ptr<PricingEngine>& engine(Size level) const;
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process_;
+        Real tolerance_;
+        Size initialSteps_, maxSteps_;
+        bool adjointGreeks_;
+        Real truncation_;
+        bool smoothing_;
+        DividendSchedule dividends_;
+        mutable std::vector<boost::shared_ptr<PricingEngine> > engines_;
+    };
+
+
+    // template definitions
+
+    template <class T>
+    const boost::shared_ptr<PricingEngine>&
+    AdaptiveBinomialVanillaEngine_2<T>::engine(Size level) const {
+        while (engines_.size() <= level) {
+            Size steps = initialSteps_;
+            for (Size k=0; k<engines_.size(); ++k)
+                steps = 2*steps + 1;
+            engines_.push_back(boost::shared_ptr<PricingEngine>(
+                new BinomialVanillaEngine_2<T>(process_, steps,
+                                               adjointGreeks_, truncation_,
+                                               smoothing_, dividends_)));
+        }
+        return engines_[level];
+    }
+
+    template <class T>
+    void AdaptiveBinomialVanillaEngine_2<T>::calculate() const {
+        Real previous = Null<Real>(), difference = Null<Real>();
+        Real errorEstimate = Null<Real>();
+        Size steps = initialSteps_;
+        for (Size level=0; ; ++level, steps = 2*steps + 1) {
+            QL_REQUIRE(steps <= maxSteps_,
+                       "max number of steps (" << maxSteps_
+                       << ") reached, while error (" << errorEstimate
+                       << ") is still above tolerance ("
+                       << tolerance_ << ")");
+            const boost::shared_ptr<PricingEngine>& e = engine(level);
+            e->reset();
+            VanillaOption::arguments* arguments =
+                dynamic_cast<VanillaOption::arguments*>(e->getArguments());
+            QL_REQUIRE(arguments, "wrong engine type");
+            *arguments = arguments_;
+            arguments->validate();
+            e->calculate();
+            const VanillaOption::results* results =
+                dynamic_cast<const VanillaOption::results*>(e->getResults());
+            QL_ENSURE(results != 0, "no results returned from engine");
+            Real value = results->value;
+
+            if (previous != Null<Real>()) {
+                Real d = std::fabs(value - previous);
+                if (difference != Null<Real>())
+                    errorEstimate = std::max(d, 0.5*difference);
+                difference = d;
+            }
+            previous = value;
+
+            if (errorEstimate != Null<Real>() &&
+                errorEstimate <= tolerance_) {
+                results_ = *results;
+                results_.errorEstimate = errorEstimate;
+                results_.additionalResults["timeSteps"] = steps;
+                return;
+            }
+        }
+    }
+
+}
+
+
+#endif
@@ -0,0 +1,255 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file binomialadjoint.hpp
+    \brief Reverse-mode sensitivities of the binomial rollback
+*/
+
+#ifndef binomial_adjoint_hpp
+#define binomial_adjoint_hpp
+
+#include "binomialrollback.hpp"
+#include <boost/shared_ptr.hpp>
+
+namespace QuantLib {
+
+    //! Reverse-mode sensitivities of the binomial rollback
+    /*! The forward rollback stores the node values every
+        \f$ \sqrt{N} \f$ steps; the reverse sweep recomputes each
+        segment from its checkpoint and propagates the adjoints of the
+        node values from the root back to maturity.  This yields the
+        derivatives of the price with respect to the node prices
+        \f$ S_{ij} \f$, the up probabilities \f$ p_i \f$ and the
+        discount factor.
+
+        For every tree in this library and in QuantLib, the node
+        prices at step \f$ i \f$ are \f$ S_{ij} = \exp(L_i + j B_i) \f$
+        for some \f$ L_i \f$ and \f$ B_i \f$; the node adjoints are thus
+        collapsed into per-step adjoints of \f$ L_i \f$, \f$ B_i \f$ and
+        \f$ p_i \f$.  Their tangents with respect to the underlying,
+        rates and volatility only involve the \f$ O(N) \f$ tree
+        coefficients and are taken by central differences on the tree
+        construction, so that the total cost stays a small multiple
+        of one pricing regardless of the number of sensitivities.
+
+        \warning the adjoint is taken on the plain rollback performed
+                 by binomialRollbackStep_2.
+    */
+    template <class T>
+    class BinomialAdjoint_2 {
+      public:
+        struct Sensitivities {
+            Real delta, vega, rho, dividendRho;
+        };
+        BinomialAdjoint_2()
+        : bumpedProcess_(new FlatBinomialProcess_2), steps_(0), interval_(1) {}
+        //! prepares the checkpoint storage for a tree with the given steps
+        void reset(Size steps, BinomialArena_2& arena);
+        bool isCheckpoint(Size i) const {
+            return i % interval_ == 0 || i == steps_;
+        }
+        //! stores the node values at step i, if it's a checkpoint
+        void store(Size i, Size nodes, const Real* values);
+        /*! runs the reverse sweep on the tree used for the forward
+            rollback; exercise[i] tells whether early exercise was
+            checked at step i.
+        */
+        Sensitivities calculate(const T& tree,
+                                const BinomialParameters_2& parameters,
+                                const PlainVanillaPayoff& payoff,
+                                const std::vector<bool>& exercise,
+                                DiscountFactor discount,
+                                BinomialArena_2& arena) const;
+      private:
+        Real coefficients(const BinomialParameters_2& parameters,
+                          Real strike,
+                          const Real* gL,
+                          const Real* gB,
+                          const Real* gP) const;
+        boost::shared_ptr<FlatBinomialProcess_2> bumpedProcess_;
+        Size steps_, interval_;
+        std::vector<Real*> checkpoints_;
+    };
+
+
+    // template definitions
+
+    template <class T>
+    void BinomialAdjoint_2<T>::reset(Size steps, BinomialArena_2& arena) {
+        steps_ = steps;
+        interval_ = std::max<Size>(
+                        1, Size(std::ceil(std::sqrt(Real(steps)))));
+        checkpoints_.assign(steps+1, static_cast<Real*>(0));
+        for (Size i=0; i<=steps; ++i) {
+            if (isCheckpoint(i))
+                checkpoints_[i] = arena.allocate(i+1);
+        }
+    }
+
+    template <class T>
+    void BinomialAdjoint_2<T>::store(Size i, Size nodes,
+                                     const Real* values) {
+        if (isCheckpoint(i))
+            std::copy(values, values+nodes, checkpoints_[i]);
+    }
+
+    template <class T>
+    typename BinomialAdjoint_2<T>::Sensitivities
+    BinomialAdjoint_2<T>::calculate(const T& tree,
+                                    const BinomialParameters_2& parameters,
+                                    const PlainVanillaPayoff& payoff,
+                                    const std::vector<bool>& exercise,
+                                    DiscountFactor discount,
+                                    BinomialArena_2& arena) const {
+
+        Size n = steps_;
+        Real strike = payoff.strike();
+        Real omega = (payoff.optionType() == Option::Call ? 1.0 : -1.0);
+
+        // per-step adjoints of L_i, B_i and p_i
+        Real* gL = arena.allocate(n+1);
+        Real* gB = arena.allocate(n+1);
+        Real* gP = arena.allocate(n+1);
+        std::fill(gL, gL+n+1, 0.0);
+        std::fill(gB, gB+n+1, 0.0);
+        std::fill(gP, gP+n+1, 0.0);
+        Real gDiscount = 0.0;
+
+        // node adjoints at the current and at the next step
+        Real* adjoint = arena.allocate(n+1);
+        Real* nextAdjoint = arena.allocate(n+1);
+        adjoint[0] = 1.0;
+
+        // values recomputed between two checkpoints
+        Real* segment = arena.allocate(interval_*(n+1));
+        std::vector<const Real*> levels(interval_+1);
+
+        for (Size a=0; a<n; a+=interval_) {
+            Size b = std::min(a+interval_, n);
+
+            // recompute the values at steps a+1...b
+            levels[b-a] = checkpoints_[b];
+            for (Size l=b-1; l>a; --l) {
+                Real* values = segment + (l-a-1)*(n+1);
+                binomialRollbackStep_2(tree, l, discount, payoff,
+                                       exercise[l], levels[l+1-a], values);
+                levels[l-a] = values;
+            }
+
+            for (Size i=a; i<b; ++i) {
+                const Real* next = levels[i+1-a];
+                Real pd = tree.probability(i, 0, 0);
+                Real pu = tree.probability(i, 0, 1);
+                Size nodes = tree.size(i);
+                std::fill(nextAdjoint, nextAdjoint+nodes+1, 0.0);
+                for (Size j=0; j<nodes; ++j) {
+                    Real continuation = discount*(pd*next[j] + pu*next[j+1]);
+                    if (exercise[i]) {
+                        Real s = tree.underlying(i, j);
+                        if (payoff(s) > continuation) {
+                            // exercised: the value only depends on s
+                            Real adjS = adjoint[j]*omega*s;
+                            gL[i] += adjS;
+                            gB[i] += adjS*j;
+                            continue;
+                        }
+                    }
+                    nextAdjoint[j] += adjoint[j]*discount*pd;
+                    nextAdjoint[j+1] += adjoint[j]*discount*pu;
+                    gP[i] += adjoint[j]*discount*(next[j+1]-next[j]);
+                    gDiscount += adjoint[j]*continuation/discount;
+                }
+                std::swap(adjoint, nextAdjoint);
+            }
+        }
+
+        // payoff at maturity
+        for (Size j=0; j<tree.size(n); ++j) {
+            Real s = tree.underlying(n, j);
+            if (omega*(s-strike) > 0.0) {
+                Real adjS = adjoint[j]*omega*s;
+                gL[n] += adjS;
+                gB[n] += adjS*j;
+            }
+        }
+
+        // chain the per-step adjoints to the model parameters
+        Sensitivities results;
+        Time dt = parameters.maturity/n;
+        BinomialParameters_2 up = parameters, down = parameters;
+
+        Real h = 1.0e-4*parameters.underlying;
+        up.underlying += h;
+        down.underlying -= h;
+        results.delta = (coefficients(up, strike, gL, gB, gP) -
+                         coefficients(down, strike, gL, gB, gP))/(2.0*h);
+        up.underlying = down.underlying = parameters.underlying;
+
+        h = 1.0e-5;
+        up.volatility += h;
+        down.volatility -= h;
+        results.vega = (coefficients(up, strike, gL, gB, gP) -
+                        coefficients(down, strike, gL, gB, gP))/(2.0*h);
+        up.volatility = down.volatility = parameters.volatility;
+
+        up.riskFreeRate += h;
+        down.riskFreeRate -= h;
+        results.rho = (coefficients(up, strike, gL, gB, gP) -
+                       coefficients(down, strike, gL, gB, gP))/(2.0*h)
+            - gDiscount*dt*discount;
+        up.riskFreeRate = down.riskFreeRate = parameters.riskFreeRate;
+
+        up.dividendYield += h;
+        down.dividendYield -= h;
+        results.dividendRho =
+            (coefficients(up, strike, gL, gB, gP) -
+             coefficients(down, strike, gL, gB, gP))/(2.0*h);
+
+        return results;
+    }
+
+    /* Returns the sum over the steps of the per-step adjoints times
+       the coefficients of the tree built on the given parameters. */
+    template <class T>
+    Real BinomialAdjoint_2<T>::coefficients(
+                                      const BinomialParameters_2& parameters,
+                                      Real strike,
+                                      const Real* gL,
+                                      const Real* gB,
+                                      const Real* gP) const {
+        bumpedProcess_->reset(parameters);
+        T tree(bumpedProcess_, parameters.maturity, parameters.timeSteps,
+               strike);
+        QL_REQUIRE(tree.columns() == steps_+1,
+                   "bumped tree has " << tree.columns()-1
+                   << " steps instead of " << steps_);
+        Real sum = 0.0;
+        for (Size i=0; i<=steps_; ++i) {
+            Real s0 = tree.underlying(i, 0);
+            sum += gL[i]*std::log(s0);
+            if (i > 0)
+                sum += gB[i]*std::log(tree.underlying(i, 1)/s0);
+            if (i < steps_)
+                sum += gP[i]*tree.probability(i, 0, 1);
+        }
+        return sum;
+    }
+
+}
+
+
+#endif
@@ -28,19 +28,62 @@
 #define binomial_engine_hpp
 
 #include <ql/methods/lattices/binomialtree.hpp>
-#include <ql/methods/lattices/bsmlattice.hpp>
-#include <ql/math/distributions/normaldistribution.hpp>
-#include <ql/pricingengines/vanilla/discretizedvanillaoption.hpp>
+#include <ql/instruments/vanillaoption.hpp>
+#include <ql/instruments/dividendschedule.hpp>
 #include <ql/pricingengines/greeks.hpp>
+#include <ql/pricingengines/blackformula.hpp>
 #include <ql/processes/blackscholesprocess.hpp>
-#include <ql/termstructures/yield/flatforward.hpp>
-#include <ql/termstructures/volatility/equityfx/blackconstantvol.hpp>
+#include "binomialadjoint.hpp"
+#include "../common/engineinstrumentation.hpp"
+#include "../common/pricingmonitor.hpp"
 
 namespace QuantLib {
 
     //! Pricing engine for vanilla options using binomial trees
     /*! \ingroup vanillaengines
 
+        The process is flattened at the option maturity and the tree
+        is built directly from the resulting BinomialParameters_2;
+        the rollback runs in place on memory taken from a per-engine
+        arena, so that repeated calculations don't allocate.
+
+        At exercise steps, the rollback tracks the early-exercise
+        region and writes the intrinsic value directly on the nodes
+        deep into it (see binomialExerciseStep_2).  The critical
+        underlying price at each step is returned as the
+        "exerciseBoundary" additional result, together with the
+        corresponding "exerciseBoundaryTimes"; the fraction of the
+        nodes rolled back whose value was written directly is
+        returned as "deepExerciseFraction".
+
+        When a truncation is given, only the nodes within that number
+        of standard deviations are rolled back and the nodes at the
+        edge of the band take an asymptotic value; see
+        BinomialTruncation_2.
+
+        When Black-Scholes smoothing is enabled, the last step of the
+        tree is replaced by the closed-form Black-Scholes values at
+        the nodes before maturity (floored by the intrinsic value if
+        exercise is allowed there); this removes the oscillations
+        caused by the kink of the payoff at the strike.
+
+        Discrete cash dividends are modeled by escrowing: the tree is
+        built on the underlying net of the present value of the
+        dividends to be paid until maturity, and that present value
+        is added back to the node prices at each step when the payoff
+        is evaluated.  The tree stays recombining and the per-step
+        shifts are computed once per calculation.
+
+        If QL_ENABLE_ENGINE_INSTRUMENTATION is defined, the time
+        spent in each phase of the calculation and the number of
+        nodes, node-price evaluations and heap allocations are
+        returned as "instrumentation.*" additional results and added
+        to EngineStatistics.
+
+        If a PricingMonitor is set, it is told of the steps rolled
+        back every 256 steps, and the calculation is cancelled as
+        soon as the monitor asks for it.
+
         \test the correctness of the returned values is tested by
               checking it against analytic results.
 
@@ -51,124 +94,375 @@ namespace QuantLib {
               estimating partial derivatives.
     */
     template <class T>
-    class BinomialVanillaEngine_2 : public VanillaOption::engine {
+    class BinomialVanillaEngine_2 : public VanillaOption::engine,
+                                    public MonitoredEngine {
       public:
+        /*! When \c adjointGreeks is true, delta, vega, rho and
+            dividend rho are obtained by reverse-mode differentiation
+            of the rollback; see BinomialAdjoint_2.
+        */
         BinomialVanillaEngine_2(
              const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
-             Size timeSteps)
-        : process_(process), timeSteps_(timeSteps) {
+             Size timeSteps,
+             bool adjointGreeks = false,
+             Real truncation = Null<Real>(),
+             bool blackScholesSmoothing = false,
+             const DividendSchedule& dividends = DividendSchedule())
+        : process_(process), timeSteps_(timeSteps),
+          adjointGreeks_(adjointGreeks), truncation_(truncation),
+          smoothing_(blackScholesSmoothing), dividends_(dividends),
+          flatProcess_(new FlatBinomialProcess_2) {
             QL_REQUIRE(timeSteps >= 2,
                        "at least 2 time steps required, "
                        << timeSteps << " provided");
+            QL_REQUIRE(!blackScholesSmoothing || timeSteps >= 3,
+                       "at least 3 time steps required for smoothing, "
+                       << timeSteps << " provided");
+            QL_REQUIRE(!adjointGreeks || !blackScholesSmoothing,
+                       "adjoint greeks not available with smoothing");
+            QL_REQUIRE(!adjointGreeks || dividends.empty(),
+                       "adjoint greeks not available with dividends");
+            QL_REQUIRE(truncation == Null<Real>() || truncation > 0.0,
+                       "positive truncation required, "
+                       << truncation << " provided");
+            QL_REQUIRE(!adjointGreeks || truncation == Null<Real>(),
+                       "adjoint greeks not available on truncated trees");
             registerWith(process_);
         }
         void calculate() const;
       private:
+        #if defined(QL_ENABLE_ENGINE_INSTRUMENTATION)
+        typedef InstrumentedTree<T> tree_type;
+        #else
+        typedef T tree_type;
+        #endif
+        BinomialParameters_2 flatParameters(Time maturity) const;
+        void setExerciseSteps(Size steps, Time dt) const;
+        Real escrowedDividends(Time t, Time maturity, Rate r) const;
         boost::shared_ptr<GeneralizedBlackScholesProcess> process_;
         Size timeSteps_;
+        bool adjointGreeks_;
+        Real truncation_;
+        bool smoothing_;
+        DividendSchedule dividends_;
+        boost::shared_ptr<FlatBinomialProcess_2> flatProcess_;
+        mutable BinomialArena_2 arena_;
+        mutable std::vector<bool> exercise_;
+        mutable std::vector<Real> shift_;
+        mutable BinomialAdjoint_2<T> adjoint_;
+        #if defined(QL_ENABLE_ENGINE_INSTRUMENTATION)
+        mutable EngineInstrumentation instrumentation_;
+        #endif
     };
 
 
     // template definitions
 
+    template <class T>
+    BinomialParameters_2
+    BinomialVanillaEngine_2<T>::flatParameters(Time maturity) const {
+
+        BinomialParameters_2 parameters = flatBinomialParameters_2(
+            *process_, arguments_.exercise->lastDate(), maturity,
+            timeSteps_);
+
+        // the tree models the underlying net of escrowed dividends
+        parameters.underlying -=
+            escrowedDividends(0.0, maturity, parameters.riskFreeRate);
+        QL_REQUIRE(parameters.underlying > 0.0,
+                   "dividends exceed the underlying value");
+        return parameters;
+    }
+
+    /* Present value at t of the dividends paid in (t, maturity]. */
+    template <class T>
+    Real BinomialVanillaEngine_2<T>::escrowedDividends(Time t,
+                                                       Time maturity,
+                                                       Rate r) const {
+        Real result = 0.0;
+        for (Size k=0; k<dividends_.size(); ++k) {
+            Time paymentTime = process_->time(dividends_[k]->date());
+            if (paymentTime > t && paymentTime <= maturity)
+                result += dividends_[k]->amount() *
+                    std::exp(-r*(paymentTime - t));
+        }
+        return result;
+    }
+
+    /* Flags the steps at which exercise is checked; the exercise
+       times are snapped to the closest step as in
+       DiscretizedVanillaOption. */
+    template <class T>
+    void BinomialVanillaEngine_2<T>::setExerciseSteps(Size n,
+                                                      Time dt) const {
+        exercise_.assign(n+1, false);
+        switch (arguments_.exercise->type()) {
+          case Exercise::American: {
+              Time t0 = process_->time(arguments_.exercise->date(0));
+              Size first = std::min<Size>(
+                  n, Size(std::max<Real>(0.0, t0/dt + 0.5)));
+              std::fill(exercise_.begin()+first, exercise_.end(), true);
+            }
+            break;
+          case Exercise::Bermudan:
+            for (Size k=0; k<arguments_.exercise->dates().size(); ++k) {
+                Time t = process_->time(arguments_.exercise->date(k));
+                if (t >= 0.0)
+                    exercise_[std::min<Size>(n, Size(t/dt + 0.5))] = true;
+            }
+            break;
+          case Exercise::European:
+            break;
+          default:
+            QL_FAIL("invalid exercise type");
+        }
+    }
+
     template <class T>
     void BinomialVanillaEngine_2<T>::calculate() const {
 
-        DayCounter rfdc  = process_->riskFreeRate()->dayCounter();
-        DayCounter divdc = process_->dividendYield()->dayCounter();
-        DayCounter voldc = process_->blackVolatility()->dayCounter();
-        Calendar volcal = process_->blackVolatility()->calendar();
-
-        Real s0 = process_->stateVariable()->value();
-        QL_REQUIRE(s0 > 0.0, "negative or null underlying given");
-        Volatility v = process_->blackVolatility()->blackVol(
-            arguments_.exercise->lastDate(), s0);
-        Date maturityDate = arguments_.exercise->lastDate();
-        Rate r = process_->riskFreeRate()->zeroRate(maturityDate,
-            rfdc, Continuous, NoFrequency);
-        Rate q = process_->dividendYield()->zeroRate(maturityDate,
-            divdc, Continuous, NoFrequency);
-        Date referenceDate = process_->riskFreeRate()->referenceDate();
-
-        // binomial trees with constant coefficient
-        Handle<YieldTermStructure> flatRiskFree(
-            boost::shared_ptr<YieldTermStructure>(
-                new FlatForward(referenceDate, r, rfdc)));
-        Handle<YieldTermStructure> flatDividends(
-            boost::shared_ptr<YieldTermStructure>(
-                new FlatForward(referenceDate, q, divdc)));
-        Handle<BlackVolTermStructure> flatVol(
-            boost::shared_ptr<BlackVolTermStructure>(
-                new BlackConstantVol(referenceDate, volcal, v, voldc)));
+        QL_ENGINE_START(instrumentation_);
+        QL_ENGINE_PHASE(instrumentation_, "setup");
 
         boost::shared_ptr<PlainVanillaPayoff> payoff =
             boost::dynamic_pointer_cast<PlainVanillaPayoff>(arguments_.payoff);
         QL_REQUIRE(payoff, "non-plain payoff given");
 
-        Time maturity = rfdc.yearFraction(referenceDate, maturityDate);
-
-        boost::shared_ptr<StochasticProcess1D> bs(
-                         new GeneralizedBlackScholesProcess(
-                                      process_->stateVariable(),
-                                      flatDividends, flatRiskFree, flatVol));
-
-        TimeGrid grid(maturity, timeSteps_);
-
-        boost::shared_ptr<T> tree(new T(bs, maturity, timeSteps_,
-                                        payoff->strike()));
-
-        boost::shared_ptr<BlackScholesLattice<T> > lattice(
-            new BlackScholesLattice<T>(tree, r, maturity, timeSteps_));
-
-        DiscretizedVanillaOption option(arguments_, *process_, grid);
+        Time maturity = process_->time(arguments_.exercise->lastDate());
+        BinomialParameters_2 parameters = flatParameters(maturity);
+
+        // binomial trees with constant coefficient, built on the
+        // engine-owned process and memory
+        flatProcess_->reset(parameters);
+        arena_.reset();
+        tree_type tree(flatProcess_, maturity, timeSteps_, payoff->strike());
+
+        // the tree might have adjusted the number of steps
+        Size n = tree.columns()-1;
+        Time dt = maturity/n;
+        DiscountFactor discount = std::exp(-parameters.riskFreeRate*dt);
+
+        setExerciseSteps(n, dt);
+        shift_.assign(n+1, 0.0);
+        if (!dividends_.empty()) {
+            for (Size i=0; i<=n; ++i)
+                shift_[i] = escrowedDividends(i*dt, maturity,
+                                              parameters.riskFreeRate);
+        }
+        if (adjointGreeks_)
+            adjoint_.reset(n, arena_);
+
+        // optional truncation of the tree
+        bool truncated = (truncation_ != Null<Real>());
+        BinomialTruncation_2 truncation(
+                      parameters, *payoff, truncated ? truncation_ : 1.0,
+                      arguments_.exercise->type() != Exercise::European);
+
+        bool call = (payoff->optionType() == Option::Call);
+
+        QL_ENGINE_PHASE(instrumentation_, "payoff");
+
+        // values on the nodes [begin,end) of the last step of the
+        // rollback, i.e., at maturity or, with smoothing, one step
+        // before; exercised counts the nodes on the intrinsic value
+        Size m = (smoothing_ ? n-1 : n);
+        Real* values = arena_.allocate(tree.size(n)+1);
+        Size begin = 0, end = tree.size(m);
+        if (truncated)
+            truncation.band(tree, m, begin, end);
+        Size exercised = 0;
+        if (!smoothing_) {
+            for (Size j=begin; j<end; ++j) {
+                values[j] = (*payoff)(tree.underlying(n, j) + shift_[n]);
+                if (values[j] > 0.0)
+                    ++exercised;
+            }
+        } else {
+            Real growth = std::exp((parameters.riskFreeRate -
+                                    parameters.dividendYield)*dt);
+            Real stdDev = parameters.volatility*std::sqrt(dt);
+            for (Size j=begin; j<end; ++j) {
+                Real s = tree.underlying(m, j);
+                values[j] = blackFormula(payoff->optionType(),
+                                         payoff->strike(), s*growth,
+                                         stdDev, discount);
+                if (exercise_[m])
+                    values[j] = std::max(values[j],
+                                         (*payoff)(s + shift_[m]));
+            }
+            if (exercise_[m]) {
+                // the exercise region is contiguous from the side of
+                // the lowest (put) or highest (call) node
+                Size j = (call ? end-1 : begin);
+                while (exercised < end-begin) {
+                    Real intrinsic =
+                        (*payoff)(tree.underlying(m, j) + shift_[m]);
+                    if (intrinsic <= 0.0 || values[j] != intrinsic)
+                        break;
+                    ++exercised;
+                    j = (call ? j-1 : j+1);
+                }
+            }
+        }
+        if (adjointGreeks_)
+            adjoint_.store(n, tree.size(n), values);
 
-        option.initialize(lattice, maturity);
+        // early-exercise boundary
+        Real* boundary = arena_.allocate(n+1);
+        std::fill(boundary, boundary+n+1, Real(Null<Real>()));
+        if (exercised > 0)
+            boundary[m] = tree.underlying(m,
+                call ? end-exercised : begin+exercised-1) + shift_[m];
+        bool earlyExercise = (smoothing_ && exercise_[m]);
 
         // Partial derivatives calculated from various points in the
-        // binomial tree 
+        // binomial tree
         // (see J.C.Hull, "Options, Futures and other derivatives", 6th edition, pp 397/398)
+        Real p2u = 0.0, p2m = 0.0, p2d = 0.0, p1u = 0.0, p1d = 0.0;
+        if (m == 2) {
+            p2u = values[2];
+            p2m = values[1];
+            p2d = values[0];
+        }
 
-        // Rollback to third-last step, and get underlying prices (s2) &
-        // option values (p2) at this point
-        option.rollback(grid[2]);
-        Array va2(option.values());
-        QL_ENSURE(va2.size() == 3, "Expect 3 nodes in grid at second step");
-        Real p2u = va2[2]; // up
-        Real p2m = va2[1]; // mid
-        Real p2d = va2[0]; // down (low)
-        Real s2u = lattice->underlying(2, 2); // up price
-        Real s2m = lattice->underlying(2, 1); // middle price
-        Real s2d = lattice->underlying(2, 0); // down (low) price
+        // nodes rolled back, and written directly in the deep
+        // exercise region
+        Size rolled = 0, skipped = 0;
+        for (Size i=m; i>0; --i) {
+            Size k = i-1;
+            if ((n-i) % 256 == 0)
+                checkpoint(n-i, n);
+            QL_ENGINE_PHASE(instrumentation_, exercise_[k] ?
+                                              "rollback.exercise" :
+                                              "rollback.continuation");
+
+            // nodes [lo,hi) rolled back at this step; their successors
+            // outside [begin,end) take the asymptotic value
+            Size lo = 0, hi = tree.size(k);
+            if (truncated && k > 2)
+                truncation.band(tree, k, lo, hi);
+            for (Size j=lo; j<begin; ++j)
+                values[j] = truncation.value(tree.underlying(i, j), i*dt,
+                                             shift_[i]);
+            for (Size j=end; j<=hi; ++j)
+                values[j] = truncation.value(tree.underlying(i, j), i*dt,
+                                             shift_[i]);
+
+            if (exercise_[k]) {
+                // exercised successors, counted on [lo,hi]
+                if (!call) {
+                    if (lo < begin) {
+                        Size run = 0;
+                        while (lo+run < begin &&
+                               values[lo+run] ==
+                                    (*payoff)(tree.underlying(i, lo+run) +
+                                              shift_[i]))
+                            ++run;
+                        exercised = (run == begin-lo ?
+                                     run + exercised : run);
+                    } else {
+                        exercised -= std::min(exercised, lo-begin);
+                    }
+                } else {
+                    if (hi+1 > end) {
+                        Size run = 0;
+                        while (hi-run >= end &&
+                               values[hi-run] ==
+                                    (*payoff)(tree.underlying(i, hi-run) +
+                                              shift_[i]))
+                            ++run;
+                        exercised = (run == hi+1-end ?
+                                     run + exercised : run);
+                    } else {
+                        exercised -= std::min(exercised, end-(hi+1));
+                    }
+                }
+                exercised = std::min(exercised, hi+1-lo);
+                // only nodes outside the deep exercise region are rolled
+                Size deep = 0;
+                exercised = binomialExerciseStep_2(tree, k, discount,
+                                                   *payoff, lo, hi,
+                                                   exercised, values,
+                                                   boundary[k], shift_[k],
+                                                   shift_[i], &deep);
+                skipped += deep;
+                earlyExercise = true;
+            } else {
+                binomialRollbackStep_2(tree, k, discount, *payoff, false,
+                                       lo, hi, values, values);
+                exercised = 0;
+            }
+            begin = lo;
+            end = hi;
+            rolled += hi-lo;
+            QL_ENGINE_COUNT(instrumentation_, "nodes", hi-lo);
+            if (adjointGreeks_)
+                adjoint_.store(k, tree.size(k), values);
+
+            if (k == 2) {
+                p2u = values[2]; // up
+                p2m = values[1]; // mid
+                p2d = values[0]; // down (low)
+            } else if (k == 1) {
+                p1u = values[1];
+                p1d = values[0];
+            }
+        }
+        Real p0 = values[0];
+
+        QL_ENGINE_PHASE(instrumentation_, "greeks");
+
+        // option values (p2) and underlying prices (s2) at the
+        // third-last step
+        Real s2u = tree.underlying(2, 2); // up price
+        Real s2m = tree.underlying(2, 1); // middle price
+        Real s2d = tree.underlying(2, 0); // down (low) price
 
         // calculate gamma by taking the first derivate of the two deltas
         Real delta2u = (p2u - p2m)/(s2u-s2m);
         Real delta2d = (p2m-p2d)/(s2m-s2d);
         Real gamma = (delta2u - delta2d) / ((s2u-s2d)/2);
 
-        // Rollback to second-last step, and get option values (p1) at
-        // this point
-        option.rollback(grid[1]);
-        Array va(option.values());
-        QL_ENSURE(va.size() == 2, "Expect 2 nodes in grid at first step");
-        Real p1u = va[1];
-        Real p1d = va[0];
-        Real s1u = lattice->underlying(1, 1); // up (high) price
-        Real s1d = lattice->underlying(1, 0); // down (low) price
+        // option values (p1) at the second-last step
+        Real s1u = tree.underlying(1, 1); // up (high) price
+        Real s1d = tree.underlying(1, 0); // down (low) price
 
         Real delta = (p1u - p1d) / (s1u - s1d);
 
-        // Finally, rollback to t=0
-        option.rollback(0.0);
-        Real p0 = option.presentValue();
-
         // Store results
         results_.value = p0;
         results_.delta = delta;
         results_.gamma = gamma;
+        if (adjointGreeks_) {
+            QL_ENGINE_PHASE(instrumentation_, "adjoint");
+            typename BinomialAdjoint_2<T>::Sensitivities greeks =
+                adjoint_.calculate(tree, parameters, *payoff, exercise_,
+                                   discount, arena_);
+            results_.delta = greeks.delta;
+            results_.vega = greeks.vega;
+            results_.rho = greeks.rho;
+            results_.dividendRho = greeks.dividendRho;
+        }
         results_.theta = blackScholesTheta(process_,
                                            results_.value,
                                            results_.delta,
                                            results_.gamma);
+        if (earlyExercise) {
+            // critical price at each step, Null<Real>() where no
+            // node is exercised
+            std::vector<Time> times(n+1);
+            for (Size i=0; i<=n; ++i)
+                times[i] = i*dt;
+            results_.additionalResults["exerciseBoundaryTimes"] = times;
+            results_.additionalResults["exerciseBoundary"] =
+                std::vector<Real>(boundary, boundary+n+1);
+            results_.additionalResults["deepExerciseFraction"] =
+                Real(skipped)/rolled;
+        }
+
+        QL_ENGINE_COUNT(instrumentation_, "underlyingCalls", tree.calls());
+        QL_ENGINE_FINISH(instrumentation_, "BinomialVanillaEngine_2",
+                         results_.additionalResults);
     }
 
 }
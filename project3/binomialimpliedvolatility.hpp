@@ -0,0 +1,351 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file binomialimpliedvolatility.hpp
+    \brief Batch implied volatilities of vanilla options on binomial trees
+*/
+
+#ifndef binomial_implied_volatility_hpp
+#define binomial_implied_volatility_hpp
+
+#include "binomialengine.hpp"
+#include <ql/quotes/simplequote.hpp>
+#include <ql/termstructures/volatility/equityfx/blackconstantvol.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <string>
+#include <vector>
+
+namespace QuantLib {
+
+    //! Option and quoted price to be inverted
+    struct BinomialImpliedVolatilityQuote_2 {
+        BinomialImpliedVolatilityQuote_2() : price(Null<Real>()) {}
+        BinomialImpliedVolatilityQuote_2(
+                             const boost::shared_ptr<VanillaOption>& option,
+                             Real price)
+        : option(option), price(price) {}
+        boost::shared_ptr<VanillaOption> option;
+        Real price;
+    };
+
+    //! Implied volatility of a quote
+    /*! If the inversion failed, error holds the reason and
+        volatility is null.
+    */
+    struct BinomialImpliedVolatilityResult_2 {
+        BinomialImpliedVolatilityResult_2()
+        : volatility(Null<Real>()), guess(Null<Real>()),
+          residual(Null<Real>()), iterations(0) {}
+        Volatility volatility;
+        //! Black-Scholes European implied volatility used as a start
+        Volatility guess;
+        //! difference between the tree and the quoted price
+        Real residual;
+        //! number of tree evaluations
+        Size iterations;
+        std::string error;
+    };
+
+
+    //! Batch implied-volatility solver on binomial trees
+    /*! Each quote is inverted by a Newton iteration using the vega
+        obtained from the adjoint of the rollback (see
+        BinomialAdjoint_2), so that each iteration costs a single
+        tree evaluation.  The iteration starts from the
+        Black-Scholes implied volatility of the quoted price taken as
+        the price of the European option, which is usually within a
+        few percent of the solution; Newton steps leaving the current
+        bracket of the solution are replaced by bisection.  Quoted
+        prices above the spot (for calls) or the strike (for puts) or,
+        for American options, below the intrinsic value are rejected
+        without evaluating the tree.
+
+        The quotes are shared among the given number of threads;
+        each thread owns a BinomialVanillaEngine_2, whose tree
+        workspaces are reused across iterations and quotes, and a
+        process differing from the given one only by a constant
+        volatility.
+
+        \warning as for the PortfolioPricer, market data must not
+                 change during the inversion and lazy term
+                 structures should be calculated beforehand.
+    */
+    template <class T>
+    class BinomialImpliedVolatility_2 {
+      public:
+        /*! \c accuracy is the tolerance on the price; if no number of
+            threads is given, the available hardware concurrency is
+            used.
+        */
+        BinomialImpliedVolatility_2(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             Size timeSteps,
+             Real accuracy = 1.0e-6,
+             Size maxIterations = 20,
+             Volatility minVol = 1.0e-4,
+             Volatility maxVol = 4.0,
+             Size threads = 0);
+        std::vector<BinomialImpliedVolatilityResult_2> solve(
+            const std::vector<BinomialImpliedVolatilityQuote_2>& quotes) const;
+      private:
+        class Worker;
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process_;
+        Size timeSteps_;
+        Real accuracy_;
+        Size maxIterations_;
+        Volatility minVol_, maxVol_;
+        Size threads_;
+    };
+
+
+    // template definitions
+
+    template <class T>
+    class BinomialImpliedVolatility_2<T>::Worker {
+      public:
+        Worker(const BinomialImpliedVolatility_2<T>& solver,
+               const std::vector<BinomialImpliedVolatilityQuote_2>& quotes,
+               std::vector<BinomialImpliedVolatilityResult_2>& results,
+               Size& next,
+               boost::mutex& mutex)
+        : solver_(solver), quotes_(quotes), results_(results),
+          next_(next), mutex_(mutex),
+          volatility_(new SimpleQuote(0.2)) {
+            const boost::shared_ptr<GeneralizedBlackScholesProcess>& p =
+                solver.process_;
+            Handle<BlackVolTermStructure> volTS(
+                boost::shared_ptr<BlackVolTermStructure>(
+                    new BlackConstantVol(
+                             p->blackVolatility()->referenceDate(),
+                             p->blackVolatility()->calendar(),
+                             Handle<Quote>(volatility_),
+                             p->blackVolatility()->dayCounter())));
+            process_ = boost::shared_ptr<GeneralizedBlackScholesProcess>(
+                new GeneralizedBlackScholesProcess(p->stateVariable(),
+                                                   p->dividendYield(),
+                                                   p->riskFreeRate(),
+                                                   volTS));
+            engine_ = boost::shared_ptr<PricingEngine>(
+                new BinomialVanillaEngine_2<T>(process_, solver.timeSteps_,
+                                               true));
+        }
+        void operator()() {
+            for (;;) {
+                Size i;
+                {
+                    boost::mutex::scoped_lock lock(mutex_);
+                    if (next_ == quotes_.size())
+                        return;
+                    i = next_++;
+                }
+                try {
+                    solve(quotes_[i], results_[i]);
+                } catch (std::exception& e) {
+                    results_[i].volatility = Null<Real>();
+                    results_[i].error = e.what();
+                } catch (...) {
+                    results_[i].volatility = Null<Real>();
+                    results_[i].error = "unknown error";
+                }
+            }
+        }
+      private:
+        void solve(const BinomialImpliedVolatilityQuote_2& quote,
+                   BinomialImpliedVolatilityResult_2& result) {
+            QL_REQUIRE(quote.option, "no option given");
+            QL_REQUIRE(quote.price != Null<Real>(), "no price given");
+
+            boost::shared_ptr<PlainVanillaPayoff> payoff =
+                boost::dynamic_pointer_cast<PlainVanillaPayoff>(
+                                                   quote.option->payoff());
+            QL_REQUIRE(payoff, "non-plain payoff given");
+            const boost::shared_ptr<Exercise>& exercise =
+                quote.option->exercise();
+            Real spot = process_->x0();
+            Real strike = payoff->strike();
+            Real price = quote.price;
+            bool call = (payoff->optionType() == Option::Call);
+
+            // no-arbitrage bounds; the upper one assumes non-negative
+            // rates and yields.  The European lower bound is not
+            // checked, since the tree price at low volatilities can be
+            // slightly below it.
+            if (exercise->type() == Exercise::American) {
+                Real intrinsic =
+                    std::max(call ? spot-strike : strike-spot, 0.0);
+                QL_REQUIRE(price >= intrinsic - solver_.accuracy_,
+                           "price (" << price << ") below intrinsic value ("
+                           << intrinsic << ")");
+            }
+            Real upper = (call ? spot : strike);
+            QL_REQUIRE(price < upper,
+                       "price (" << price << ") above upper bound ("
+                       << upper << ")");
+
+            quote.option->setupArguments(engine_->getArguments());
+            engine_->getArguments()->validate();
+            const OneAssetOption::results* r =
+                dynamic_cast<const OneAssetOption::results*>(
+                                                     engine_->getResults());
+            QL_REQUIRE(r != 0, "no results returned from engine");
+
+            Time maturity = process_->time(exercise->lastDate());
+            DiscountFactor discount =
+                process_->riskFreeRate()->discount(maturity);
+            Real forward = spot *
+                process_->dividendYield()->discount(maturity) / discount;
+            Volatility sigma =
+                guess(*payoff, price, maturity, forward, discount);
+            result.guess = sigma;
+            Volatility lo = solver_.minVol_, hi = solver_.maxVol_;
+            for (Size k=1; k<=solver_.maxIterations_; ++k) {
+                result.iterations = k;
+                volatility_->setValue(sigma);
+                engine_->reset();
+                try {
+                    engine_->calculate();
+                } catch (std::exception& e) {
+                    QL_FAIL("tree evaluation failed at volatility "
+                            << sigma << ": " << e.what());
+                }
+                Real difference = r->value - price;
+                result.residual = difference;
+                if (std::fabs(difference) <= solver_.accuracy_) {
+                    result.volatility = sigma;
+                    return;
+                }
+                // the price increases with the volatility
+                if (difference > 0.0) {
+                    QL_REQUIRE(sigma > solver_.minVol_,
+                               "price below the value at minimum "
+                               "volatility (" << r->value << ")");
+                    hi = sigma;
+                } else {
+                    QL_REQUIRE(sigma < solver_.maxVol_,
+                               "price above the value at maximum "
+                               "volatility (" << r->value << ")");
+                    lo = sigma;
+                }
+                Volatility next = Null<Real>();
+                if (r->vega > 0.0)
+                    next = sigma - difference/r->vega;
+                if (next == Null<Real>() || next <= lo || next >= hi) {
+                    // bisection; the bounds are evaluated if needed
+                    if (difference > 0.0 && lo == solver_.minVol_)
+                        next = std::max(0.5*sigma, lo);
+                    else if (difference < 0.0 && hi == solver_.maxVol_)
+                        next = std::min(2.0*sigma, hi);
+                    else
+                        next = 0.5*(lo+hi);
+                }
+                sigma = next;
+            }
+            QL_FAIL("maximum number of iterations ("
+                    << solver_.maxIterations_ << ") reached; residual "
+                    << result.residual);
+        }
+
+        Volatility guess(const PlainVanillaPayoff& payoff, Real price,
+                         Time maturity, Real forward,
+                         DiscountFactor discount) const {
+            Volatility sigma = 0.2;
+            if (maturity > 0.0) {
+                try {
+                    sigma = blackFormulaImpliedStdDev(
+                        payoff.optionType(), payoff.strike(), forward,
+                        price, discount) / std::sqrt(maturity);
+                } catch (std::exception&) {
+                    // the early-exercise premium might put the price
+                    // above the European upper bound
+                    sigma = blackFormulaImpliedStdDevApproximation(
+                        payoff.optionType(), payoff.strike(), forward,
+                        price, discount) / std::sqrt(maturity);
+                }
+            }
+            return std::min(std::max(sigma, solver_.minVol_),
+                            solver_.maxVol_);
+        }
+
+        const BinomialImpliedVolatility_2<T>& solver_;
+        const std::vector<BinomialImpliedVolatilityQuote_2>& quotes_;
+        std::vector<BinomialImpliedVolatilityResult_2>& results_;
+        Size& next_;
+        boost::mutex& mutex_;
+        boost::shared_ptr<SimpleQuote> volatility_;
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process_;
+        boost::shared_ptr<PricingEngine> engine_;
+    };
+
+
+    template <class T>
+    BinomialImpliedVolatility_2<T>::BinomialImpliedVolatility_2(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             Size timeSteps,
+             Real accuracy,
+             Size maxIterations,
+             Volatility minVol,
+             Volatility maxVol,
+             Size threads)
+    : process_(process), timeSteps_(timeSteps), accuracy_(accuracy),
+      maxIterations_(maxIterations), minVol_(minVol), maxVol_(maxVol),
+      threads_(threads) {
+        QL_REQUIRE(accuracy > 0.0,
+                   "positive accuracy required, " << accuracy
+                   << " provided");
+        QL_REQUIRE(maxIterations > 0, "null maximum iterations given");
+        QL_REQUIRE(minVol > 0.0 && minVol < maxVol,
+                   "invalid volatility range [" << minVol << ", "
+                   << maxVol << "]");
+        if (threads_ == 0)
+            threads_ = std::max<Size>(boost::thread::hardware_concurrency(),
+                                      1);
+    }
+
+    template <class T>
+    std::vector<BinomialImpliedVolatilityResult_2>
+    BinomialImpliedVolatility_2<T>::solve(
+           const std::vector<BinomialImpliedVolatilityQuote_2>& quotes) const {
+
+        std::vector<BinomialImpliedVolatilityResult_2> results(quotes.size());
+        if (quotes.empty())
+            return results;
+
+        Size n = std::min(threads_, quotes.size());
+        Size next = 0;
+        boost::mutex mutex;
+
+        // workers are built on this thread, since processes and
+        // engines register as observers with the shared market data
+        std::vector<boost::shared_ptr<Worker> > workers(n);
+        for (Size k=0; k<n; ++k)
+            workers[k] = boost::shared_ptr<Worker>(
+                              new Worker(*this, quotes, results, next, mutex));
+
+        boost::thread_group threads;
+        for (Size k=1; k<n; ++k)
+            threads.create_thread(boost::ref(*workers[k]));
+        (*workers[0])();
+        threads.join_all();
+
+        return results;
+    }
+
+}
+
+
+#endif
@@ -0,0 +1,380 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file binomialrollback.hpp
+    \brief Building blocks of the binomial rollback
+*/
+
+#ifndef binomial_rollback_hpp
+#define binomial_rollback_hpp
+
+#include <ql/instruments/payoffs.hpp>
+#include <ql/processes/blackscholesprocess.hpp>
+#include <ql/stochasticprocess.hpp>
+#include <ql/utilities/null.hpp>
+#include <list>
+#include <vector>
+
+namespace QuantLib {
+
+    //! Flat Black-Scholes inputs to the binomial trees
+    /*! These are the only quantities a constant-coefficient tree
+        needs; they are extracted once per calculation instead of
+        being wrapped into term structures and a process.
+    */
+    struct BinomialParameters_2 {
+        Real underlying;
+        Rate riskFreeRate;
+        Rate dividendYield;
+        Volatility volatility;
+        Time maturity;
+        Size timeSteps;
+    };
+
+    //! Flattens a Black-Scholes process at the given maturity
+    /*! Rates are the continuous zero rates and the volatility is the
+        Black volatility at the maturity date.
+    */
+    inline BinomialParameters_2 flatBinomialParameters_2(
+                           const GeneralizedBlackScholesProcess& process,
+                           const Date& maturityDate,
+                           Time maturity,
+                           Size timeSteps) {
+        DayCounter rfdc  = process.riskFreeRate()->dayCounter();
+        DayCounter divdc = process.dividendYield()->dayCounter();
+
+        Real s0 = process.stateVariable()->value();
+        QL_REQUIRE(s0 > 0.0, "negative or null underlying given");
+
+        BinomialParameters_2 parameters;
+        parameters.underlying = s0;
+        parameters.riskFreeRate = process.riskFreeRate()->zeroRate(
+            maturityDate, rfdc, Continuous, NoFrequency);
+        parameters.dividendYield = process.dividendYield()->zeroRate(
+            maturityDate, divdc, Continuous, NoFrequency);
+        parameters.volatility = process.blackVolatility()->blackVol(
+            maturityDate, s0);
+        parameters.maturity = maturity;
+        parameters.timeSteps = timeSteps;
+        return parameters;
+    }
+
+
+    //! Constant-coefficient process built on binomial parameters
+    /*! The trees only query the initial value, the drift and the
+        variance of the process; this class answers those queries
+        from a plain BinomialParameters_2 instance which can be
+        replaced in place, so that the engine can reuse the same
+        object across calculations.
+    */
+    class FlatBinomialProcess_2 : public StochasticProcess1D {
+      public:
+        FlatBinomialProcess_2() {}
+        void reset(const BinomialParameters_2& parameters) {
+            parameters_ = parameters;
+        }
+        const BinomialParameters_2& parameters() const {
+            return parameters_;
+        }
+        Real x0() const { return parameters_.underlying; }
+        Real drift(Time, Real) const {
+            Volatility v = parameters_.volatility;
+            return parameters_.riskFreeRate - parameters_.dividendYield
+                - 0.5*v*v;
+        }
+        Real diffusion(Time, Real) const { return parameters_.volatility; }
+        Real expectation(Time t0, Real x0, Time dt) const {
+            return apply(x0, drift(t0, x0)*dt);
+        }
+        Real stdDeviation(Time, Real, Time dt) const {
+            return parameters_.volatility*std::sqrt(dt);
+        }
+        Real variance(Time, Real, Time dt) const {
+            Volatility v = parameters_.volatility;
+            return v*v*dt;
+        }
+        Real apply(Real x0, Real dx) const { return x0*std::exp(dx); }
+      private:
+        BinomialParameters_2 parameters_;
+    };
+
+
+    //! Scratch memory for the binomial rollback
+    /*! Memory is handed out sequentially and given back all at once
+        by reset().  When a calculation needs more than the arena
+        holds, the extra blocks are merged at the next reset so that
+        later calculations of the same size don't allocate.
+    */
+    class BinomialArena_2 {
+      public:
+        BinomialArena_2() : used_(0) {}
+        Real* allocate(Size n) {
+            n = std::max<Size>(n, 1);
+            if (used_ + n <= block_.size()) {
+                Real* p = &block_[used_];
+                used_ += n;
+                return p;
+            }
+            overflow_.push_back(std::vector<Real>(n));
+            return &overflow_.back()[0];
+        }
+        void reset() {
+            if (!overflow_.empty()) {
+                Size total = block_.size();
+                for (std::list<std::vector<Real> >::const_iterator i =
+                         overflow_.begin(); i != overflow_.end(); ++i)
+                    total += i->size();
+                overflow_.clear();
+                std::vector<Real>(total).swap(block_);
+            }
+            used_ = 0;
+        }
+      private:
+        std::vector<Real> block_;
+        std::list<std::vector<Real> > overflow_;
+        Size used_;
+    };
+
+
+
+    //! Rolls the node values of a binomial tree back by one step
+    /*! Values at step \f$ i+1 \f$ are read from \c from and values at
+        step \f$ i \f$ are written to \c to for the nodes in
+        \f$ [begin, end) \f$; the two buffers can be the same.  When
+        \c exercise is true, the continuation value is compared with
+        the immediate exercise.
+    */
+    template <class T>
+    inline void binomialRollbackStep_2(const T& tree,
+                                       Size i,
+                                       DiscountFactor discount,
+                                       const Payoff& payoff,
+                                       bool exercise,
+                                       Size begin,
+                                       Size end,
+                                       const Real* from,
+                                       Real* to) {
+        Real pd = tree.probability(i, 0, 0);
+        Real pu = tree.probability(i, 0, 1);
+        for (Size j=begin; j<end; ++j)
+            to[j] = discount*(pd*from[j] + pu*from[j+1]);
+        if (exercise) {
+            for (Size j=begin; j<end; ++j)
+                to[j] = std::max(to[j], payoff(tree.underlying(i, j)));
+        }
+    }
+
+    //! Rolls all the node values of a binomial tree back by one step
+    template <class T>
+    inline void binomialRollbackStep_2(const T& tree,
+                                       Size i,
+                                       DiscountFactor discount,
+                                       const Payoff& payoff,
+                                       bool exercise,
+                                       const Real* from,
+                                       Real* to) {
+        binomialRollbackStep_2(tree, i, discount, payoff, exercise,
+                               0, tree.size(i), from, to);
+    }
+
+
+    //! Rolls back one exercise step skipping the deep exercise region
+    /*! Same as binomialRollbackStep_2 in place with the exercise check,
+        for a plain-vanilla payoff and the nodes in \f$ [begin, end) \f$.
+        \c exercised is the number of successor nodes whose value is
+        the intrinsic one, contiguous from \c begin for puts and up to
+        \c end (included) for calls.  A node whose successors are both
+        exercised has a continuation value \f$ \omega D (M S - K) \f$,
+        with \f$ D \f$ the discount and \f$ M \f$ the expected one-step
+        growth; when the intrinsic value exceeds it, which is monotone
+        in \f$ S \f$, the intrinsic value is written directly and the
+        node price is obtained by a multiplication instead of a call
+        to the tree.
+
+        Returns the number of exercised nodes at step \f$ i \f$, counted
+        in the same way, and sets \c boundary to the exercised price
+        closest to the money, or to Null<Real>() if no node is
+        exercised.
+
+        When the tree models the underlying net of escrowed dividends,
+        \c shift and \c nextShift are the present values of the
+        dividends still to be paid at steps \f$ i \f$ and \f$ i+1 \f$;
+        they are added to the node prices before the payoff is taken.
+
+        If \c deep is given, the number of nodes of the deep region,
+        whose values were written without rolling back, is stored
+        there.
+    */
+    template <class T>
+    inline Size binomialExerciseStep_2(const T& tree,
+                                       Size i,
+                                       DiscountFactor discount,
+                                       const PlainVanillaPayoff& payoff,
+                                       Size begin,
+                                       Size end,
+                                       Size exercised,
+                                       Real* values,
+                                       Real& boundary,
+                                       Real shift = 0.0,
+                                       Real nextShift = 0.0,
+                                       Size* deep = 0) {
+        Real pd = tree.probability(i, 0, 0);
+        Real pu = tree.probability(i, 0, 1);
+        Real strike = payoff.strike();
+        bool call = (payoff.optionType() == Option::Call);
+
+        // deep region: nodes [begin,deepEnd) for puts,
+        // [deepBegin,end) for calls
+        Size deepEnd = begin, deepBegin = end;
+        Real ratio = 1.0;
+        if (tree.size(i) > 1) {
+            Real s0 = tree.underlying(i, 0);
+            ratio = tree.underlying(i, 1)/s0;
+            Real growth = (pd*tree.underlying(i+1, 0) +
+                           pu*tree.underlying(i+1, 1))/s0;
+            // exercise is optimal where A*S >= B
+            Real A = 1.0 - discount*growth,
+                 B = strike*(1.0 - discount) - shift + discount*nextShift;
+            if (!call) {
+                Size candidates = begin + (exercised > 1 ? exercised-1 : 0);
+                Real s = tree.underlying(i, begin);
+                while (deepEnd < candidates && s*A <= B) {
+                    values[deepEnd++] = strike - s - shift;
+                    s *= ratio;
+                }
+            } else if (end > begin) {
+                Size first = (exercised < end+1-begin ?
+                              end+1-exercised : begin);
+                Real s = tree.underlying(i, end-1);
+                while (deepBegin > first && s*A >= B) {
+                    --deepBegin;
+                    s /= ratio;
+                }
+            }
+        }
+
+        // remaining nodes
+        Size lastExercised = deepEnd, lastContinued = deepEnd;
+        bool run = true;
+        for (Size j=deepEnd; j<deepBegin; ++j) {
+            Real continuation = discount*(pd*values[j] + pu*values[j+1]);
+            Real intrinsic = payoff(tree.underlying(i, j) + shift);
+            if (intrinsic > continuation) {
+                values[j] = intrinsic;
+                if (run)
+                    lastExercised = j+1;
+            } else {
+                values[j] = continuation;
+                run = false;
+                lastContinued = j+1;
+            }
+        }
+
+        if (call && deepBegin < end) {
+            Real s = tree.underlying(i, deepBegin);
+            for (Size j=deepBegin; j<end; ++j) {
+                values[j] = s + shift - strike;
+                s *= ratio;
+            }
+        }
+
+        if (deep)
+            *deep = (call ? end - deepBegin : deepEnd - begin);
+        Size count = (call ? end - lastContinued : lastExercised - begin);
+        if (count == 0)
+            boundary = Null<Real>();
+        else
+            boundary = tree.underlying(i, call ? end-count : begin+count-1)
+                + shift;
+        return count;
+    }
+
+
+    //! Truncation of a binomial tree to a band of standard deviations
+    /*! At each step, only the nodes whose log-price lies within a
+        given number of standard deviations from the mean of the
+        log-price at that time are rolled back.  Nodes just outside
+        the band are given an asymptotic value: the discounted forward
+        payoff floored at zero or, if exercise is possible, the larger
+        of that and the intrinsic value.  This reduces the number of
+        nodes from \f$ O(N^2) \f$ to \f$ O(N^{3/2}) \f$.
+    */
+    class BinomialTruncation_2 {
+      public:
+        BinomialTruncation_2(const BinomialParameters_2& parameters,
+                             const PlainVanillaPayoff& payoff,
+                             Real stdDevs,
+                             bool earlyExercise)
+        : parameters_(parameters), payoff_(payoff), stdDevs_(stdDevs),
+          earlyExercise_(earlyExercise) {
+            QL_REQUIRE(stdDevs > 0.0,
+                       "positive number of standard deviations required");
+        }
+        //! nodes \f$ [begin, end) \f$ of step i within the band
+        template <class T>
+        void band(const T& tree, Size i, Size& begin, Size& end) const;
+        /*! asymptotic value at the given time and underlying price;
+            \c shift is the present value of the escrowed dividends
+            to be added to the price for the exercise check.
+        */
+        Real value(Real underlying, Time t, Real shift = 0.0) const {
+            Time tau = parameters_.maturity - t;
+            Real forward = underlying*
+                std::exp(-parameters_.dividendYield*tau);
+            Real strike = payoff_.strike()*
+                std::exp(-parameters_.riskFreeRate*tau);
+            Real result = (payoff_.optionType() == Option::Call ?
+                           forward - strike : strike - forward);
+            result = std::max(result, 0.0);
+            if (earlyExercise_)
+                result = std::max(result, payoff_(underlying + shift));
+            return result;
+        }
+      private:
+        BinomialParameters_2 parameters_;
+        PlainVanillaPayoff payoff_;
+        Real stdDevs_;
+        bool earlyExercise_;
+    };
+
+    template <class T>
+    void BinomialTruncation_2::band(const T& tree, Size i,
+                                    Size& begin, Size& end) const {
+        begin = 0;
+        end = tree.size(i);
+        if (end < 2)
+            return;
+        Real logS0 = std::log(tree.underlying(i, 0));
+        Real dx = std::log(tree.underlying(i, 1)) - logS0;
+        Time t = i*parameters_.maturity/(tree.columns()-1);
+        Volatility v = parameters_.volatility;
+        Real mean = std::log(parameters_.underlying) +
+            (parameters_.riskFreeRate - parameters_.dividendYield
+             - 0.5*v*v)*t;
+        Real width = stdDevs_*v*std::sqrt(t);
+        Real lower = std::ceil((mean - width - logS0)/dx);
+        Real upper = std::floor((mean + width - logS0)/dx) + 1.0;
+        if (lower > 0.0)
+            begin = std::min(Size(lower), end-1);
+        if (upper < Real(end))
+            end = std::max(Size(std::max(upper, 0.0)), begin+1);
+    }
+
+}
+
+
+#endif
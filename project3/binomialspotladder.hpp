@@ -0,0 +1,214 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file binomialspotladder.hpp
+    \brief Spot-shock scenarios of vanilla options from a single rollback
+*/
+
+#ifndef binomial_spot_ladder_hpp
+#define binomial_spot_ladder_hpp
+
+#include "binomialengine.hpp"
+#include "binomialtree.hpp"
+#include <boost/static_assert.hpp>
+#include <boost/type_traits/is_base_of.hpp>
+#include <vector>
+
+namespace QuantLib {
+
+    //! Value and greeks of an option under a spot shock
+    struct BinomialScenarioResult_2 {
+        BinomialScenarioResult_2()
+        : shift(Null<Real>()), underlying(Null<Real>()),
+          value(Null<Real>()), delta(Null<Real>()), gamma(Null<Real>()) {}
+        //! relative shift of the spot
+        Real shift;
+        //! shocked spot
+        Real underlying;
+        Real value, delta, gamma;
+    };
+
+
+    //! Spot ladder of a vanilla option on an equal-jumps binomial tree
+    /*! The nodes of an equal-jumps tree lie at
+        \f$ S_0 e^{j \Delta x} \f$ and, with the flat parameters used
+        by BinomialVanillaEngine_2, the subtree starting from any node
+        is the tree that the engine would build for the price at that
+        node.  The ladder thus builds a single tree starting
+        \f$ 2m \f$ steps before the evaluation date and rolls it back
+        down to step \f$ 2m \f$, whose \f$ 2m+1 \f$ nodes give the
+        option values for spots \f$ S_0 e^{2k \Delta x} \f$,
+        \f$ k = -m \dots m \f$; \f$ m \f$ is chosen so that the nodes
+        cover the largest shifts.
+
+        The value, delta and gamma for each shift are taken from the
+        quadratic through the three nodes closest to the shocked spot,
+        in the same way as the gamma of the engine.  At shifts falling
+        on a node, the value is the one of a tree built on the shocked
+        spot.
+
+        The parameters are flattened at the unshifted spot, i.e., the
+        volatility is not moved along the smile.  Truncation,
+        smoothing and dividends are not supported.
+
+        \warning market data must not change during the calculation,
+                 and the ladder must not be used by several threads
+                 at once.
+    */
+    template <class T>
+    class BinomialSpotLadder_2 {
+        BOOST_STATIC_ASSERT((boost::is_base_of<EqualJumpsBinomialTree_2<T>,
+                                               T>::value));
+      public:
+        BinomialSpotLadder_2(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             Size timeSteps);
+        /*! \c shifts are relative to the current spot, e.g., -0.2 for
+            a 20% fall, and must be greater than -1.
+        */
+        std::vector<BinomialScenarioResult_2> calculate(
+                                    const VanillaOption& option,
+                                    const std::vector<Real>& shifts) const;
+        //! number of nodes on each side of the spot after the last call
+        Size levels() const { return levels_; }
+      private:
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process_;
+        Size timeSteps_;
+        boost::shared_ptr<FlatBinomialProcess_2> flatProcess_;
+        mutable BinomialArena_2 arena_;
+        mutable std::vector<bool> exercise_;
+        mutable Size levels_;
+    };
+
+
+    // template definitions
+
+    template <class T>
+    BinomialSpotLadder_2<T>::BinomialSpotLadder_2(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             Size timeSteps)
+    : process_(process), timeSteps_(timeSteps),
+      flatProcess_(new FlatBinomialProcess_2), levels_(0) {
+        QL_REQUIRE(process_, "no process given");
+        QL_REQUIRE(timeSteps >= 2,
+                   "at least 2 time steps required, "
+                   << timeSteps << " provided");
+    }
+
+    template <class T>
+    std::vector<BinomialScenarioResult_2> BinomialSpotLadder_2<T>::calculate(
+                                   const VanillaOption& option,
+                                   const std::vector<Real>& shifts) const {
+
+        boost::shared_ptr<PlainVanillaPayoff> payoff =
+            boost::dynamic_pointer_cast<PlainVanillaPayoff>(option.payoff());
+        QL_REQUIRE(payoff, "non-plain payoff given");
+        const boost::shared_ptr<Exercise>& exercise = option.exercise();
+        QL_REQUIRE(exercise, "no exercise given");
+        QL_REQUIRE(!shifts.empty(), "no shifts given");
+        Real lowest = 0.0, highest = 0.0;
+        for (Size k=0; k<shifts.size(); ++k) {
+            QL_REQUIRE(shifts[k] > -1.0,
+                       "shift (" << shifts[k] << ") not greater than -1");
+            lowest = std::min(lowest, std::log(1.0+shifts[k]));
+            highest = std::max(highest, std::log(1.0+shifts[k]));
+        }
+
+        Time maturity = process_->time(exercise->lastDate());
+        QL_REQUIRE(maturity > 0.0, "expired option");
+        BinomialParameters_2 parameters = flatBinomialParameters_2(
+            *process_, exercise->lastDate(), maturity, timeSteps_);
+        flatProcess_->reset(parameters);
+        Size n = timeSteps_;
+        Time dt = maturity/n;
+
+        // the jump is at least sigma*sqrt(dt); one more level on each
+        // side keeps the extreme shifts inside the quadratics
+        Real spacing = 2.0*parameters.volatility*std::sqrt(dt);
+        QL_REQUIRE(spacing > 0.0, "null volatility given");
+        Size m = Size(std::ceil(std::max(-lowest, highest)/spacing)) + 1;
+        Size L = 2*m, N = n + L;
+        T tree(flatProcess_, N*dt, N, payoff->strike());
+        QL_ENSURE(tree.columns() == N+1,
+                  "the tree changed the number of steps");
+        QL_ENSURE(tree.underlying(L, 0) < parameters.underlying*
+                                          std::exp(lowest) &&
+                  tree.underlying(L, L) > parameters.underlying*
+                                          std::exp(highest),
+                  "the tree does not cover the given shifts");
+        levels_ = m;
+
+        // exercise steps, counted from the evaluation date as in
+        // BinomialVanillaEngine_2
+        exercise_.assign(n+1, false);
+        switch (exercise->type()) {
+          case Exercise::American: {
+              Time t0 = process_->time(exercise->date(0));
+              Size first = std::min<Size>(
+                  n, Size(std::max<Real>(0.0, t0/dt + 0.5)));
+              std::fill(exercise_.begin()+first, exercise_.end(), true);
+            }
+            break;
+          case Exercise::Bermudan:
+            for (Size k=0; k<exercise->dates().size(); ++k) {
+                Time t = process_->time(exercise->date(k));
+                if (t >= 0.0)
+                    exercise_[std::min<Size>(n, Size(t/dt + 0.5))] = true;
+            }
+            break;
+          case Exercise::European:
+            break;
+          default:
+            QL_FAIL("invalid exercise type");
+        }
+
+        DiscountFactor discount = std::exp(-parameters.riskFreeRate*dt);
+        arena_.reset();
+        Real* values = arena_.allocate(tree.size(N));
+        for (Size j=0; j<tree.size(N); ++j)
+            values[j] = (*payoff)(tree.underlying(N, j));
+        for (Size i=N; i>L; --i)
+            binomialRollbackStep_2(tree, i-1, discount, *payoff,
+                                   exercise_[i-1-L], values, values);
+
+        std::vector<BinomialScenarioResult_2> results(shifts.size());
+        Real dx = std::log(tree.underlying(L, 1)/tree.underlying(L, 0));
+        for (Size k=0; k<shifts.size(); ++k) {
+            BinomialScenarioResult_2& r = results[k];
+            r.shift = shifts[k];
+            r.underlying = parameters.underlying*(1.0+shifts[k]);
+
+            // nodes j-1, j, j+1 around the closest node j
+            Real x = std::log(r.underlying/tree.underlying(L, 0))/dx;
+            Size j = std::min<Size>(std::max<Real>(1.0, x+0.5), L-1);
+            Real a = tree.underlying(L, j-1), b = tree.underlying(L, j),
+                 c = tree.underlying(L, j+1);
+            Real ab = (values[j] - values[j-1])/(b-a);
+            Real bc = (values[j+1] - values[j])/(c-b);
+            Real abc = (bc - ab)/(c-a);
+            Real s = r.underlying;
+            r.value = values[j-1] + ab*(s-a) + abc*(s-a)*(s-b);
+            r.delta = ab + abc*(2.0*s-a-b);
+            r.gamma = 2.0*abc;
+        }
+        return results;
+    }
+
+}
+
+
+#endif
@@ -0,0 +1,347 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+#include "cachingengine.hpp"
+#include <ql/settings.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <typeinfo>
+
+namespace QuantLib {
+
+    namespace {
+
+        // number of times at which the curves enter the key
+        const Size curveSamples = 32;
+
+        Real readField(std::istream& in) {
+            std::string field;
+            QL_REQUIRE(in >> field, "missing field");
+            if (field == "null")
+                return Null<Real>();
+            char* end;
+            Real x = std::strtod(field.c_str(), &end);
+            QL_REQUIRE(*end == '\0', "invalid number: " << field);
+            return x;
+        }
+
+        bool hasWhitespace(const std::string& s) {
+            return s.empty() ||
+                s.find_first_of(" \t\r\n") != std::string::npos;
+        }
+
+        // the persisted results, in file order
+        std::vector<Real*> fields(OneAssetOption::results& r) {
+            std::vector<Real*> result;
+            result.push_back(&r.value);
+            result.push_back(&r.errorEstimate);
+            result.push_back(&r.delta);
+            result.push_back(&r.gamma);
+            result.push_back(&r.theta);
+            result.push_back(&r.vega);
+            result.push_back(&r.rho);
+            result.push_back(&r.dividendRho);
+            result.push_back(&r.itmCashProbability);
+            result.push_back(&r.deltaForward);
+            result.push_back(&r.elasticity);
+            result.push_back(&r.thetaPerDay);
+            result.push_back(&r.strikeSensitivity);
+            return result;
+        }
+
+    }
+
+    std::string cacheKeyField(Real x) {
+        if (x == Null<Real>())
+            return "null";
+        // hexadecimal floating point is exact and round-trips
+        // through strtod
+        char buffer[64];
+        std::snprintf(buffer, sizeof(buffer), "%a", x);
+        return buffer;
+    }
+
+
+    PricingResultCache::PricingResultCache(Size capacity,
+                                           const std::string& file)
+    : capacity_(capacity), file_(file), hits_(0), misses_(0),
+      evictions_(0) {
+        QL_REQUIRE(capacity > 0, "positive capacity required");
+        if (!file_.empty())
+            load(file_);
+    }
+
+    PricingResultCache::~PricingResultCache() {
+        if (!file_.empty()) {
+            try {
+                save(file_);
+            } catch (...) {}
+        }
+    }
+
+    bool PricingResultCache::find(const std::string& key,
+                                  OneAssetOption::results& results) {
+        boost::mutex::scoped_lock lock(mutex_);
+        boost::unordered_map<std::string, entries::iterator>::iterator i =
+            index_.find(key);
+        if (i == index_.end()) {
+            ++misses_;
+            return false;
+        }
+        ++hits_;
+        entries_.splice(entries_.begin(), entries_, i->second);
+        results = i->second->second;
+        return true;
+    }
+
+    void PricingResultCache::insert(const std::string& key,
+                                    const OneAssetOption::results& results) {
+        boost::mutex::scoped_lock lock(mutex_);
+        store(key, results);
+    }
+
+    void PricingResultCache::store(const std::string& key,
+                                   const OneAssetOption::results& results) {
+        boost::unordered_map<std::string, entries::iterator>::iterator i =
+            index_.find(key);
+        if (i != index_.end()) {
+            i->second->second = results;
+            entries_.splice(entries_.begin(), entries_, i->second);
+            return;
+        }
+        entries_.push_front(std::make_pair(key, results));
+        index_[key] = entries_.begin();
+        while (entries_.size() > capacity_) {
+            index_.erase(entries_.back().first);
+            entries_.pop_back();
+            ++evictions_;
+        }
+    }
+
+    void PricingResultCache::clear() {
+        boost::mutex::scoped_lock lock(mutex_);
+        entries_.clear();
+        index_.clear();
+    }
+
+    /* Each entry is a line with the key, the valuation date, the
+       results returned by fields(), the number of additional results
+       and, for each of them, its name, its number of values (0 for
+       a single Real) and the values.  Entries are written from the
+       least recently used, so that loading them preserves the order. */
+    void PricingResultCache::save(const std::string& file) const {
+        std::ofstream out(file.c_str());
+        QL_REQUIRE(out, "cannot open " << file << " for writing");
+        boost::mutex::scoped_lock lock(mutex_);
+        for (entries::const_reverse_iterator e = entries_.rbegin();
+             e != entries_.rend(); ++e) {
+            if (hasWhitespace(e->first))
+                continue;
+            OneAssetOption::results r = e->second;
+            out << e->first << " "
+                << (r.valuationDate == Date() ? 0 :
+                                          r.valuationDate.serialNumber());
+            std::vector<Real*> f = fields(r);
+            for (Size k=0; k<f.size(); ++k)
+                out << " " << cacheKeyField(*f[k]);
+
+            std::ostringstream additional;
+            Size n = 0;
+            for (std::map<std::string, boost::any>::const_iterator i =
+                     r.additionalResults.begin();
+                 i != r.additionalResults.end(); ++i) {
+                if (hasWhitespace(i->first))
+                    continue;
+                if (const Real* x = boost::any_cast<Real>(&i->second)) {
+                    additional << " " << i->first << " 0 "
+                               << cacheKeyField(*x);
+                    ++n;
+                } else if (const std::vector<Real>* v =
+                           boost::any_cast<std::vector<Real> >(&i->second)) {
+                    additional << " " << i->first << " " << v->size();
+                    for (Size k=0; k<v->size(); ++k)
+                        additional << " " << cacheKeyField((*v)[k]);
+                    ++n;
+                }
+            }
+            out << " " << n << additional.str() << "\n";
+        }
+        QL_REQUIRE(out, "cannot write " << file);
+    }
+
+    void PricingResultCache::load(const std::string& file) {
+        std::ifstream in(file.c_str());
+        if (!in)
+            return;
+        boost::mutex::scoped_lock lock(mutex_);
+        std::string line;
+        Size lineNumber = 0;
+        while (std::getline(in, line)) {
+            ++lineNumber;
+            if (line.empty())
+                continue;
+            std::istringstream entry(line);
+            std::string key;
+            long serial;
+            QL_REQUIRE(entry >> key >> serial,
+                       file << ":" << lineNumber << ": invalid entry");
+            OneAssetOption::results r;
+            r.reset();
+            if (serial != 0)
+                r.valuationDate = Date(serial);
+            try {
+                std::vector<Real*> f = fields(r);
+                for (Size k=0; k<f.size(); ++k)
+                    *f[k] = readField(entry);
+                Size n;
+                QL_REQUIRE(entry >> n, "missing number of results");
+                for (Size i=0; i<n; ++i) {
+                    std::string name;
+                    Size size;
+                    QL_REQUIRE(entry >> name >> size, "missing result");
+                    if (size == 0) {
+                        r.additionalResults[name] = readField(entry);
+                    } else {
+                        std::vector<Real> v(size);
+                        for (Size k=0; k<size; ++k)
+                            v[k] = readField(entry);
+                        r.additionalResults[name] = v;
+                    }
+                }
+            } catch (std::exception& e) {
+                QL_FAIL(file << ":" << lineNumber << ": " << e.what());
+            }
+            store(key, r);
+        }
+    }
+
+    Size PricingResultCache::size() const {
+        boost::mutex::scoped_lock lock(mutex_);
+        return entries_.size();
+    }
+
+    Size PricingResultCache::hits() const {
+        boost::mutex::scoped_lock lock(mutex_);
+        return hits_;
+    }
+
+    Size PricingResultCache::misses() const {
+        boost::mutex::scoped_lock lock(mutex_);
+        return misses_;
+    }
+
+    Size PricingResultCache::evictions() const {
+        boost::mutex::scoped_lock lock(mutex_);
+        return evictions_;
+    }
+
+    Real PricingResultCache::hitRate() const {
+        boost::mutex::scoped_lock lock(mutex_);
+        Size lookups = hits_ + misses_;
+        return lookups == 0 ? 0.0 : Real(hits_)/lookups;
+    }
+
+
+    CachingVanillaEngine_2::CachingVanillaEngine_2(
+             const boost::shared_ptr<PricingEngine>& engine,
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             const std::string& configuration,
+             const boost::shared_ptr<PricingResultCache>& cache)
+    : engine_(engine), process_(process), configuration_(configuration),
+      cache_(cache) {
+        QL_REQUIRE(engine_, "no engine given");
+        QL_REQUIRE(process_, "no process given");
+        QL_REQUIRE(cache_, "no cache given");
+        QL_REQUIRE(!hasWhitespace(configuration_),
+                   "empty or blank-containing configuration given");
+        registerWith(process_);
+        registerWith(engine_);
+    }
+
+    std::string CachingVanillaEngine_2::key() const {
+        boost::shared_ptr<StrikedTypePayoff> payoff =
+            boost::dynamic_pointer_cast<StrikedTypePayoff>(arguments_.payoff);
+        QL_REQUIRE(payoff, "non-striked payoff given");
+        const Exercise& exercise = *arguments_.exercise;
+
+        std::ostringstream key;
+        key << configuration_
+            << "|" << Settings::instance().evaluationDate().serialNumber()
+            << "|" << typeid(*payoff).name()
+            << "," << Integer(payoff->optionType())
+            << "," << cacheKeyField(payoff->strike())
+            << "|" << Integer(exercise.type());
+        for (Size k=0; k<exercise.dates().size(); ++k)
+            key << "," << exercise.date(k).serialNumber();
+
+        // the market data, sampled at the exercise times and on a
+        // regular grid up to maturity
+        Real strike = payoff->strike();
+        Time maturity = process_->time(exercise.lastDate());
+        std::vector<Time> times;
+        for (Size k=0; k<exercise.dates().size(); ++k) {
+            Time t = process_->time(exercise.date(k));
+            if (t > 0.0)
+                times.push_back(t);
+        }
+        for (Size i=1; i<=curveSamples; ++i)
+            times.push_back(maturity*i/curveSamples);
+
+        // the volatility is sampled at the spot as well, since trees
+        // are flattened at the money and Monte Carlo paths start there
+        Real x0 = process_->x0();
+        const Handle<BlackVolTermStructure>& volatility =
+            process_->blackVolatility();
+        key << "|" << cacheKeyField(x0);
+        for (Size i=0; i<times.size(); ++i) {
+            if (times[i] <= 0.0)
+                continue;
+            key << "|" << cacheKeyField(
+                       process_->riskFreeRate()->discount(times[i]))
+                << "," << cacheKeyField(
+                       process_->dividendYield()->discount(times[i]))
+                << "," << cacheKeyField(
+                       volatility->blackVariance(times[i], strike))
+                << "," << cacheKeyField(
+                       volatility->blackVariance(times[i], x0));
+        }
+        return key.str();
+    }
+
+    void CachingVanillaEngine_2::calculate() const {
+        std::string k = key();
+        if (cache_->find(k, results_))
+            return;
+
+        engine_->reset();
+        VanillaOption::arguments* arguments =
+            dynamic_cast<VanillaOption::arguments*>(engine_->getArguments());
+        QL_REQUIRE(arguments, "wrong engine type");
+        *arguments = arguments_;
+        arguments->validate();
+        engine_->calculate();
+        const VanillaOption::results* results =
+            dynamic_cast<const VanillaOption::results*>(
+                                                    engine_->getResults());
+        QL_ENSURE(results != 0, "no results returned from engine");
+        results_ = *results;
+        cache_->insert(k, results_);
+    }
+
+}
@@ -0,0 +1,141 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file cachingengine.hpp
+    \brief Result cache in front of vanilla option engines
+*/
+
+#ifndef caching_engine_hpp
+#define caching_engine_hpp
+
+#include <ql/instruments/vanillaoption.hpp>
+#include <ql/processes/blackscholesprocess.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include <list>
+#include <sstream>
+#include <string>
+#include <typeinfo>
+
+namespace QuantLib {
+
+    //! Bounded cache of vanilla-option results
+    /*! Results are stored by key and evicted in least-recently-used
+        order when the capacity is exceeded.  The cache can be shared
+        by engines running on different threads.
+
+        If a file is given, the cache is loaded from it on
+        construction, when it exists, and saved to it on destruction.
+        Only the results of type Real and std::vector<Real> among the
+        additional results are persisted.
+    */
+    class PricingResultCache {
+      public:
+        explicit PricingResultCache(Size capacity,
+                                    const std::string& file = "");
+        ~PricingResultCache();
+        //! copies the stored results, if any, and returns whether found
+        bool find(const std::string& key, OneAssetOption::results& results);
+        void insert(const std::string& key,
+                    const OneAssetOption::results& results);
+        void clear();
+        //! \name persistence
+        //@{
+        //! adds the entries stored in the file, if it exists
+        void load(const std::string& file);
+        void save(const std::string& file) const;
+        //@}
+        //! \name statistics
+        //@{
+        Size size() const;
+        Size capacity() const { return capacity_; }
+        Size hits() const;
+        Size misses() const;
+        Size evictions() const;
+        //! hits over lookups, or 0 if there were no lookups
+        Real hitRate() const;
+        //@}
+      private:
+        typedef std::list<std::pair<std::string, OneAssetOption::results> >
+            entries;
+        void store(const std::string& key,
+                   const OneAssetOption::results& results);
+        Size capacity_;
+        std::string file_;
+        // most recently used first
+        entries entries_;
+        boost::unordered_map<std::string, entries::iterator> index_;
+        Size hits_, misses_, evictions_;
+        mutable boost::mutex mutex_;
+    };
+
+
+    //! Engine returning cached results for repeated inputs
+    /*! The cache key is built from:
+        - the configuration of the wrapped engine, as given;
+        - the evaluation date;
+        - the payoff type, option type and strike;
+        - the exercise type and dates;
+        - the spot, and the risk-free and dividend discount factors
+          and the Black variance at the strike and at the spot at the
+          exercise dates and on a grid of 32 times up to maturity.
+
+        The key is thus a fingerprint of the market rather than its
+        full state.  Numbers enter it with their exact binary value.
+        The configuration must list every parameter of the wrapped
+        engine affecting its results, including the random seed of
+        Monte Carlo engines; MakeBinomialVanillaEngine_2 builds it
+        through withCache, while other engines are wrapped by the
+        caller.
+
+        On a miss, the arguments are passed to the wrapped engine and
+        its results are stored; failed calculations are not cached,
+        so that rerunning a partially failed batch only prices the
+        options that failed.
+
+        \warning term structures differing only between the sampled
+                 times, or volatility surfaces differing only away
+                 from the strike and the spot, give the same key;
+                 engines reading the surface elsewhere, such as Monte
+                 Carlo engines on a local-volatility process, should
+                 not be cached on such surfaces.
+    */
+    class CachingVanillaEngine_2 : public VanillaOption::engine {
+      public:
+        CachingVanillaEngine_2(
+             const boost::shared_ptr<PricingEngine>& engine,
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             const std::string& configuration,
+             const boost::shared_ptr<PricingResultCache>& cache);
+        void calculate() const;
+        //! key of the current arguments
+        std::string key() const;
+      private:
+        boost::shared_ptr<PricingEngine> engine_;
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process_;
+        std::string configuration_;
+        boost::shared_ptr<PricingResultCache> cache_;
+    };
+
+
+    //! exact, whitespace-free representation of a number for cache keys
+    std::string cacheKeyField(Real x);
+
+}
+
+
+#endif
@@ -1,17 +1,670 @@
 
 #include "binomialtree.hpp"
 #include "binomialengine.hpp"
+#include "makebinomialengine.hpp"
+#include "staticbinomialengine.hpp"
+#include "binomialimpliedvolatility.hpp"
+#include "binomialspotladder.hpp"
 #include <ql/methods/lattices/binomialtree.hpp>
+#include <ql/experimental/lattices/extendedbinomialtree.hpp>
 #include <ql/pricingengines/vanilla/binomialengine.hpp>
+#include <ql/instruments/vanillaoption.hpp>
+#include <ql/instruments/impliedvolatility.hpp>
+#include <ql/pricingengines/blackformula.hpp>
+#include <ql/quotes/simplequote.hpp>
+#include <ql/cashflows/dividend.hpp>
+#include <ql/settings.hpp>
+#include <ql/termstructures/yield/flatforward.hpp>
+#include <ql/termstructures/volatility/equityfx/blackconstantvol.hpp>
+#include <ql/termstructures/volatility/equityfx/blackvariancesurface.hpp>
+#include <ql/time/calendars/target.hpp>
+#include <ql/time/daycounters/actual365fixed.hpp>
 #include <iostream>
+#include <iomanip>
+#include <ctime>
 
 using namespace QuantLib;
 
+namespace {
+
+    struct Market {
+        boost::shared_ptr<SimpleQuote> spot, rate, dividend, vol;
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process;
+    };
+
+    Market makeMarket(const Date& today, Real s0, Rate r, Rate q,
+                      Volatility v) {
+        DayCounter dayCounter = Actual365Fixed();
+        Market m;
+        m.spot = boost::shared_ptr<SimpleQuote>(new SimpleQuote(s0));
+        m.rate = boost::shared_ptr<SimpleQuote>(new SimpleQuote(r));
+        m.dividend = boost::shared_ptr<SimpleQuote>(new SimpleQuote(q));
+        m.vol = boost::shared_ptr<SimpleQuote>(new SimpleQuote(v));
+        Handle<YieldTermStructure> riskFree(
+            boost::shared_ptr<YieldTermStructure>(
+                new FlatForward(today, Handle<Quote>(m.rate), dayCounter)));
+        Handle<YieldTermStructure> dividends(
+            boost::shared_ptr<YieldTermStructure>(
+                new FlatForward(today, Handle<Quote>(m.dividend),
+                                dayCounter)));
+        Handle<BlackVolTermStructure> volatility(
+            boost::shared_ptr<BlackVolTermStructure>(
+                new BlackConstantVol(today, TARGET(), Handle<Quote>(m.vol),
+                                     dayCounter)));
+        m.process = boost::shared_ptr<GeneralizedBlackScholesProcess>(
+            new BlackScholesMertonProcess(Handle<Quote>(m.spot), dividends,
+                                          riskFree, volatility));
+        return m;
+    }
+
+    // central difference of the option value under a quote bump
+    Real bumped(VanillaOption& option, SimpleQuote& quote, Real h) {
+        Real x = quote.value();
+        quote.setValue(x + h);
+        Real up = option.NPV();
+        quote.setValue(x - h);
+        Real down = option.NPV();
+        quote.setValue(x);
+        return (up - down)/(2.0*h);
+    }
+
+    void printGreek(const std::string& name, Real adjoint, Real bumped) {
+        std::cout << std::setw(14) << std::left << name
+                  << std::setw(14) << std::left << adjoint
+                  << std::setw(14) << std::left << bumped
+                  << std::setw(14) << std::left << adjoint - bumped
+                  << std::endl;
+    }
+
+    // adjoint greeks against bump-and-reprice on the same tree
+    template <class T>
+    void checkAdjointGreeks(const std::string& method, Market& m,
+                            VanillaOption& option, Size timeSteps) {
+        option.setPricingEngine(boost::shared_ptr<PricingEngine>(
+                  new BinomialVanillaEngine_2<T>(m.process, timeSteps, true)));
+        Real value = option.NPV();
+        Real delta = option.delta(), vega = option.vega();
+        Real rho = option.rho(), dividendRho = option.dividendRho();
+
+        option.setPricingEngine(boost::shared_ptr<PricingEngine>(
+                  new BinomialVanillaEngine_2<T>(m.process, timeSteps)));
+        std::cout << method << ": " << value << std::endl;
+        printGreek("delta", delta, bumped(option, *m.spot, 1.0e-2));
+        printGreek("vega", vega, bumped(option, *m.vol, 1.0e-4));
+        printGreek("rho", rho, bumped(option, *m.rate, 1.0e-4));
+        printGreek("dividend rho", dividendRho,
+                   bumped(option, *m.dividend, 1.0e-4));
+    }
+
+    // truncated lattice against the full tree
+    template <class T>
+    void checkTruncation(const std::string& method, Market& m,
+                         VanillaOption& option, Size timeSteps,
+                         Size stdDevs) {
+        option.setPricingEngine(
+            MakeBinomialVanillaEngine_2<T>(m.process)
+            .withSteps(timeSteps));
+        std::clock_t start = std::clock();
+        Real full = option.NPV();
+        double fullTime = double(std::clock()-start)/CLOCKS_PER_SEC;
+
+        option.setPricingEngine(
+            MakeBinomialVanillaEngine_2<T>(m.process)
+            .withSteps(timeSteps)
+            .withTruncation(stdDevs));
+        start = std::clock();
+        Real truncated = option.NPV();
+        double truncatedTime = double(std::clock()-start)/CLOCKS_PER_SEC;
+
+        std::cout << std::setw(28) << std::left << method
+                  << std::setw(14) << std::left << full
+                  << std::setw(14) << std::left << truncated
+                  << std::setw(14) << std::left << truncated - full
+                  << std::setw(10) << std::left << fullTime
+                  << std::setw(10) << std::left << truncatedTime
+                  << std::endl;
+    }
+
+    // convergence of the plain and smoothed trees against time
+    /* in-place engine, skipping the deep exercise region, against
+       the static rollback, which rolls back every node, on the same
+       tree.  The boundary one step before maturity is checked
+       against its limit at maturity, K min(1, r/q) for a put. */
+    template <class T>
+    void checkDeepExercise(const std::string& method, Market& m,
+                           VanillaOption& option, Size timeSteps) {
+        option.setPricingEngine(boost::shared_ptr<PricingEngine>(
+            new StaticBinomialVanillaEngine_2<T>(m.process, timeSteps)));
+        Real value = option.NPV(), delta = option.delta(),
+             gamma = option.gamma();
+
+        option.setPricingEngine(boost::shared_ptr<PricingEngine>(
+            new BinomialVanillaEngine_2<T>(m.process, timeSteps)));
+        Real skipped = option.result<Real>("deepExerciseFraction");
+        std::vector<Real> boundary =
+            option.result<std::vector<Real> >("exerciseBoundary");
+        Real critical = boundary[boundary.size()-2];
+        boost::shared_ptr<StrikedTypePayoff> payoff =
+            boost::dynamic_pointer_cast<StrikedTypePayoff>(option.payoff());
+        Real r = m.rate->value(), q = m.dividend->value();
+        Real limit = payoff->strike()*(q > r ? r/q : 1.0);
+
+        std::cout << std::setw(28) << std::left << method
+                  << std::setw(14) << std::left << option.NPV() - value
+                  << std::setw(14) << std::left << option.delta() - delta
+                  << std::setw(14) << std::left << option.gamma() - gamma
+                  << std::setw(10) << std::left << skipped
+                  << std::setw(10) << std::left << critical
+                  << std::setw(10) << std::left << limit
+                  << (critical != Null<Real>() && critical <= limit &&
+                      critical >= 0.98*limit ? "ok" : "failed")
+                  << std::endl;
+    }
+
+    template <class T>
+    void checkSmoothing(const std::string& method, Market& m,
+                        VanillaOption& option, Real reference) {
+        std::cout << method << std::endl;
+        Size steps[] = { 25, 50, 100, 200, 400, 800 };
+        for (Size i=0; i<6; ++i) {
+            option.setPricingEngine(
+                MakeBinomialVanillaEngine_2<T>(m.process)
+                .withSteps(steps[i]));
+            std::clock_t start = std::clock();
+            Real plain = option.NPV();
+            double plainTime = double(std::clock()-start)/CLOCKS_PER_SEC;
+
+            option.setPricingEngine(
+                MakeBinomialVanillaEngine_2<T>(m.process)
+                .withSteps(steps[i])
+                .withBlackScholesSmoothing());
+            start = std::clock();
+            Real smoothed = option.NPV();
+            double smoothedTime = double(std::clock()-start)/CLOCKS_PER_SEC;
+
+            std::cout << std::setw(10) << std::left << steps[i]
+                      << std::setw(14) << std::left << plain - reference
+                      << std::setw(10) << std::left << plainTime
+                      << std::setw(14) << std::left << smoothed - reference
+                      << std::setw(10) << std::left << smoothedTime
+                      << std::endl;
+        }
+    }
+
+    // escrowed discrete dividends against the dividend-free tree
+    template <class T>
+    void checkDividends(const std::string& method, Market& m,
+                        VanillaOption& option, Size timeSteps,
+                        const DividendSchedule& dividends) {
+        option.setPricingEngine(
+            MakeBinomialVanillaEngine_2<T>(m.process)
+            .withSteps(timeSteps));
+        std::clock_t start = std::clock();
+        Real plain = option.NPV();
+        double plainTime = double(std::clock()-start)/CLOCKS_PER_SEC;
+
+        option.setPricingEngine(
+            MakeBinomialVanillaEngine_2<T>(m.process)
+            .withSteps(timeSteps)
+            .withDividends(dividends));
+        start = std::clock();
+        Real withDividends = option.NPV();
+        double dividendTime = double(std::clock()-start)/CLOCKS_PER_SEC;
+
+        std::cout << std::setw(28) << std::left << method
+                  << std::setw(14) << std::left << plain
+                  << std::setw(10) << std::left << plainTime
+                  << std::setw(14) << std::left << withDividends
+                  << std::setw(10) << std::left << dividendTime
+                  << std::endl;
+    }
+
+    // time per pricing of the given engine
+    double timing(VanillaOption& option,
+                  const boost::shared_ptr<PricingEngine>& engine,
+                  Real& value) {
+        option.setPricingEngine(engine);
+        std::clock_t start = std::clock();
+        value = option.NPV();
+        return double(std::clock()-start)/CLOCKS_PER_SEC;
+    }
+
+    // static rollback against the lattice-based and in-place engines
+    template <class T>
+    void checkStaticRollback(const std::string& method, Market& m,
+                             VanillaOption& option, Size timeSteps) {
+        Real lattice, inPlace, inlined;
+        double latticeTime = timing(option,
+            boost::shared_ptr<PricingEngine>(
+                new BinomialVanillaEngine<T>(m.process, timeSteps)),
+            lattice);
+        double inPlaceTime = timing(option,
+            boost::shared_ptr<PricingEngine>(
+                new BinomialVanillaEngine_2<T>(m.process, timeSteps)),
+            inPlace);
+        double inlinedTime = timing(option,
+            boost::shared_ptr<PricingEngine>(
+                new StaticBinomialVanillaEngine_2<T>(m.process, timeSteps)),
+            inlined);
+
+        std::cout << std::setw(28) << std::left << method
+                  << std::setw(14) << std::left << inlined - lattice
+                  << std::setw(10) << std::left << latticeTime
+                  << std::setw(10) << std::left << inPlaceTime
+                  << std::setw(10) << std::left << inlinedTime
+                  << std::setw(10) << std::left
+                  << latticeTime/std::max(inlinedTime, 1.0e-6)
+                  << std::endl;
+    }
+
+    // counts the notifications sent by an engine, i.e., the changes
+    // of its market data
+    class NotificationCounter : public Observer {
+      public:
+        explicit NotificationCounter(
+                           const boost::shared_ptr<Observable>& observable)
+        : count(0) {
+            registerWith(observable);
+        }
+        void update() { ++count; }
+        Size count;
+    };
+
+    // batch solver against Brent root-finding on the same engine
+    template <class T>
+    void checkImpliedVolatility(const std::string& method,
+                                const Date& today, const Date& maturity,
+                                Size timeSteps) {
+        Market m = makeMarket(today, 36.0, 0.06, 0.02, 0.20);
+        boost::shared_ptr<PricingEngine> engine(
+                         new BinomialVanillaEngine_2<T>(m.process, timeSteps));
+        boost::shared_ptr<Exercise> exercise(
+                                   new AmericanExercise(today, maturity));
+
+        // quotes generated by the tree at known volatilities
+        std::vector<BinomialImpliedVolatilityQuote_2> quotes;
+        std::vector<Volatility> volatilities;
+        for (Integer i=0; i<20; ++i) {
+            Option::Type type = (i%2 == 0 ? Option::Put : Option::Call);
+            Volatility vol = 0.15 + 0.05*(i%5);
+            boost::shared_ptr<VanillaOption> option(new VanillaOption(
+                boost::shared_ptr<StrikedTypePayoff>(
+                    new PlainVanillaPayoff(type, 30.0 + 1.5*i)),
+                exercise));
+            m.vol->setValue(vol);
+            option->setPricingEngine(engine);
+            quotes.push_back(
+                BinomialImpliedVolatilityQuote_2(option, option->NPV()));
+            volatilities.push_back(vol);
+        }
+
+        Real accuracy = 1.0e-6;
+        NotificationCounter counter(engine);
+        std::clock_t start = std::clock();
+        Real brentError = 0.0;
+        for (Size i=0; i<quotes.size(); ++i) {
+            Volatility vol = detail::ImpliedVolatilityHelper::calculate(
+                *quotes[i].option, *engine, *m.vol, quotes[i].price,
+                accuracy, 100, 1.0e-4, 4.0);
+            brentError = std::max(brentError,
+                                  std::fabs(vol - volatilities[i]));
+        }
+        double brentTime = double(std::clock()-start)/CLOCKS_PER_SEC;
+
+        BinomialImpliedVolatility_2<T> solver(m.process, timeSteps,
+                                              accuracy);
+        start = std::clock();
+        std::vector<BinomialImpliedVolatilityResult_2> results =
+            solver.solve(quotes);
+        double newtonTime = double(std::clock()-start)/CLOCKS_PER_SEC;
+        Size iterations = 0, failures = 0;
+        Real newtonError = 0.0;
+        for (Size i=0; i<results.size(); ++i) {
+            iterations += results[i].iterations;
+            if (results[i].volatility == Null<Real>())
+                ++failures;
+            else
+                newtonError = std::max(newtonError,
+                    std::fabs(results[i].volatility - volatilities[i]));
+        }
+
+        std::cout << std::setw(28) << std::left << method
+                  << std::setw(10) << std::left
+                  << Real(counter.count)/quotes.size()
+                  << std::setw(14) << std::left << brentError
+                  << std::setw(10) << std::left << brentTime
+                  << std::setw(10) << std::left
+                  << Real(iterations)/quotes.size()
+                  << std::setw(14) << std::left << newtonError
+                  << std::setw(10) << std::left << newtonTime
+                  << std::setw(10) << std::left << failures
+                  << std::endl;
+    }
+
+
+    // spot ladder against a fresh tree for each shocked spot
+    template <class T>
+    void checkSpotLadder(const std::string& method, Market& m,
+                         VanillaOption& option, Size timeSteps) {
+        std::vector<Real> shifts;
+        for (Integer i=-20; i<=20; ++i)
+            shifts.push_back(0.01*i);
+
+        Real spot = m.spot->value();
+        option.setPricingEngine(boost::shared_ptr<PricingEngine>(
+                    new BinomialVanillaEngine_2<T>(m.process, timeSteps)));
+        std::vector<Real> values, deltas;
+        std::clock_t start = std::clock();
+        for (Size i=0; i<shifts.size(); ++i) {
+            m.spot->setValue(spot*(1.0+shifts[i]));
+            values.push_back(option.NPV());
+            deltas.push_back(option.delta());
+        }
+        double freshTime = double(std::clock()-start)/CLOCKS_PER_SEC;
+        m.spot->setValue(spot);
+
+        BinomialSpotLadder_2<T> ladder(m.process, timeSteps);
+        start = std::clock();
+        std::vector<BinomialScenarioResult_2> results =
+            ladder.calculate(option, shifts);
+        double ladderTime = double(std::clock()-start)/CLOCKS_PER_SEC;
+        Real valueError = 0.0, deltaError = 0.0;
+        for (Size i=0; i<shifts.size(); ++i) {
+            valueError = std::max(valueError,
+                                  std::fabs(results[i].value - values[i]));
+            deltaError = std::max(deltaError,
+                                  std::fabs(results[i].delta - deltas[i]));
+        }
+
+        std::cout << std::setw(28) << std::left << method
+                  << std::setw(14) << std::left << valueError
+                  << std::setw(14) << std::left << deltaError
+                  << std::setw(10) << std::left << freshTime
+                  << std::setw(10) << std::left << ladderTime
+                  << std::setw(10) << std::left << ladder.levels()
+                  << std::endl;
+    }
+
+
+    // cached results on a smile moving only at the spot; the tree is
+    // flattened at the money, so the move must miss the cache
+    template <class T>
+    void checkCacheKey(const std::string& method, Market& m,
+                       const Date& today, const Date& maturity,
+                       VanillaOption& option, Size timeSteps) {
+        std::vector<Date> dates(1, maturity + 1*Years);
+        std::vector<Real> strikes;
+        for (Integer i=0; i<=10; ++i)
+            strikes.push_back(26.0 + 2.0*i);
+        Matrix flat(strikes.size(), dates.size(), 0.20);
+        Matrix moved = flat;
+        for (Size i=0; i<strikes.size(); ++i) {
+            if (strikes[i] == m.spot->value())
+                moved[i][0] = 0.25;
+        }
+        DayCounter dayCounter = Actual365Fixed();
+
+        RelinkableHandle<BlackVolTermStructure> smile;
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process(
+            new BlackScholesMertonProcess(Handle<Quote>(m.spot),
+                                          m.process->dividendYield(),
+                                          m.process->riskFreeRate(),
+                                          smile));
+        boost::shared_ptr<PricingResultCache> cache(
+                                               new PricingResultCache(16));
+        option.setPricingEngine(
+            MakeBinomialVanillaEngine_2<T>(process)
+            .withSteps(timeSteps)
+            .withCache(cache));
+
+        Matrix* surfaces[] = { &flat, &flat, &moved };
+        Real values[3];
+        for (Size i=0; i<3; ++i) {
+            smile.linkTo(boost::shared_ptr<BlackVolTermStructure>(
+                new BlackVarianceSurface(today, TARGET(), dates, strikes,
+                                         *surfaces[i], dayCounter)));
+            values[i] = option.NPV();
+        }
+
+        // expected: a hit on the rebuilt surface, a miss on the moved one
+        std::cout << std::setw(28) << std::left << method
+                  << std::setw(10) << std::left << cache->hits()
+                  << std::setw(10) << std::left << cache->misses()
+                  << std::setw(14) << std::left << values[1] - values[0]
+                  << std::setw(14) << std::left << values[2] - values[0]
+                  << std::endl;
+    }
+
+}
+
 int main() {
 
     try {
 
-        // add your code here
+        Date todaysDate(15, May, 1998);
+        Settings::instance().evaluationDate() = todaysDate;
+        Date maturity(17, May, 1999);
+
+        Market m = makeMarket(todaysDate, 36.0, 0.06, 0.02, 0.20);
+        boost::shared_ptr<StrikedTypePayoff> payoff(
+                                  new PlainVanillaPayoff(Option::Put, 40.0));
+        VanillaOption europeanOption(payoff, boost::shared_ptr<Exercise>(
+                                         new EuropeanExercise(maturity)));
+        VanillaOption americanOption(payoff, boost::shared_ptr<Exercise>(
+                              new AmericanExercise(todaysDate, maturity)));
+
+        Size timeSteps = 801;
+        std::cout << std::fixed << std::setprecision(6);
+        std::cout << std::setw(14) << std::left << "Greek"
+                  << std::setw(14) << std::left << "Adjoint"
+                  << std::setw(14) << std::left << "Bumped"
+                  << std::setw(14) << std::left << "Difference"
+                  << std::endl;
+
+        VanillaOption* options[] = { &europeanOption, &americanOption };
+        std::string names[] = { "European", "American" };
+        for (Size i=0; i<2; ++i) {
+            VanillaOption& option = *options[i];
+            std::cout << std::endl << names[i] << std::endl;
+            checkAdjointGreeks<JarrowRudd_2>(
+                "Jarrow-Rudd", m, option, timeSteps);
+            checkAdjointGreeks<CoxRossRubinstein_2>(
+                "Cox-Ross-Rubinstein", m, option, timeSteps);
+            checkAdjointGreeks<AdditiveEQPBinomialTree_2>(
+                "Additive equiprobabilities", m, option, timeSteps);
+            checkAdjointGreeks<Trigeorgis_2>(
+                "Trigeorgis", m, option, timeSteps);
+            checkAdjointGreeks<Tian_2>("Tian", m, option, timeSteps);
+            checkAdjointGreeks<LeisenReimer_2>(
+                "Leisen-Reimer", m, option, timeSteps);
+            checkAdjointGreeks<Joshi4_2>("Joshi", m, option, timeSteps);
+            checkAdjointGreeks<ExtendedCoxRossRubinstein>(
+                "Ext. Cox-Ross-Rubinstein", m, option, timeSteps);
+            checkAdjointGreeks<ExtendedTian>(
+                "Ext. Tian", m, option, timeSteps);
+            checkAdjointGreeks<ExtendedLeisenReimer>(
+                "Ext. Leisen-Reimer", m, option, timeSteps);
+            checkAdjointGreeks<ExtendedJoshi4>(
+                "Ext. Joshi", m, option, timeSteps);
+        }
+
+        Size truncatedSteps = 5000;
+        Size stdDevs = 8;
+        std::cout << std::endl
+                  << "Truncation at " << stdDevs << " standard deviations, "
+                  << truncatedSteps << " steps" << std::endl;
+        std::cout << std::setw(28) << std::left << "Method"
+                  << std::setw(14) << std::left << "Full"
+                  << std::setw(14) << std::left << "Truncated"
+                  << std::setw(14) << std::left << "Error"
+                  << std::setw(10) << std::left << "Time"
+                  << std::setw(10) << std::left << "Time"
+                  << std::endl;
+        for (Size i=0; i<2; ++i) {
+            VanillaOption& option = *options[i];
+            std::cout << names[i] << std::endl;
+            checkTruncation<CoxRossRubinstein_2>(
+                "Cox-Ross-Rubinstein", m, option, truncatedSteps, stdDevs);
+            checkTruncation<Tian_2>(
+                "Tian", m, option, truncatedSteps, stdDevs);
+            checkTruncation<LeisenReimer_2>(
+                "Leisen-Reimer", m, option, truncatedSteps+1, stdDevs);
+        }
+
+        // the put is in the money, so that a large part of the tree
+        // lies in the deep exercise region
+        std::cout << std::endl
+                  << "Deep exercise region, American put, "
+                  << truncatedSteps << " steps" << std::endl;
+        std::cout << std::setw(28) << std::left << "Method"
+                  << std::setw(14) << std::left << "Value diff"
+                  << std::setw(14) << std::left << "Delta diff"
+                  << std::setw(14) << std::left << "Gamma diff"
+                  << std::setw(10) << std::left << "Skipped"
+                  << std::setw(10) << std::left << "Boundary"
+                  << std::setw(10) << std::left << "Limit"
+                  << std::endl;
+        checkDeepExercise<CoxRossRubinstein_2>(
+            "Cox-Ross-Rubinstein", m, americanOption, truncatedSteps);
+        checkDeepExercise<Tian_2>(
+            "Tian", m, americanOption, truncatedSteps);
+        checkDeepExercise<LeisenReimer_2>(
+            "Leisen-Reimer", m, americanOption, truncatedSteps+1);
+
+        // Black-Scholes smoothing; the European options are checked
+        // against the closed formula, the American ones against a
+        // 10000-step tree
+        Time t = m.process->time(maturity);
+        Real europeanValue = blackFormula(
+            payoff->optionType(), payoff->strike(),
+            m.spot->value()*std::exp((m.rate->value()-m.dividend->value())*t),
+            m.vol->value()*std::sqrt(t), std::exp(-m.rate->value()*t));
+        americanOption.setPricingEngine(
+            MakeBinomialVanillaEngine_2<LeisenReimer_2>(m.process)
+            .withSteps(10001)
+            .withBlackScholesSmoothing());
+        Real americanValue = americanOption.NPV();
+        Real references[] = { europeanValue, americanValue };
+
+        std::cout << std::endl << "Black-Scholes smoothing" << std::endl;
+        std::cout << std::setw(10) << std::left << "Steps"
+                  << std::setw(14) << std::left << "Error"
+                  << std::setw(10) << std::left << "Time"
+                  << std::setw(14) << std::left << "Smoothed"
+                  << std::setw(10) << std::left << "Time"
+                  << std::endl;
+        for (Size i=0; i<2; ++i) {
+            VanillaOption& option = *options[i];
+            std::cout << names[i] << std::endl;
+            checkSmoothing<CoxRossRubinstein_2>(
+                "Cox-Ross-Rubinstein", m, option, references[i]);
+            checkSmoothing<Tian_2>("Tian", m, option, references[i]);
+            checkSmoothing<Trigeorgis_2>(
+                "Trigeorgis", m, option, references[i]);
+        }
+
+        // quarterly cash dividends
+        DividendSchedule dividends;
+        for (Integer i=1; i<=4; ++i)
+            dividends.push_back(boost::shared_ptr<Dividend>(
+                new FixedDividend(0.5, todaysDate + 3*i*Months)));
+
+        std::cout << std::endl << "Discrete dividends, "
+                  << truncatedSteps << " steps" << std::endl;
+        std::cout << std::setw(28) << std::left << "Method"
+                  << std::setw(14) << std::left << "No dividends"
+                  << std::setw(10) << std::left << "Time"
+                  << std::setw(14) << std::left << "Dividends"
+                  << std::setw(10) << std::left << "Time"
+                  << std::endl;
+        for (Size i=0; i<2; ++i) {
+            VanillaOption& option = *options[i];
+            std::cout << names[i] << std::endl;
+            checkDividends<CoxRossRubinstein_2>(
+                "Cox-Ross-Rubinstein", m, option, truncatedSteps, dividends);
+            checkDividends<LeisenReimer_2>(
+                "Leisen-Reimer", m, option, truncatedSteps+1, dividends);
+        }
+
+        std::cout << std::endl << "Static rollback, "
+                  << truncatedSteps << " steps" << std::endl;
+        std::cout << std::setw(28) << std::left << "Method"
+                  << std::setw(14) << std::left << "Difference"
+                  << std::setw(10) << std::left << "Lattice"
+                  << std::setw(10) << std::left << "In place"
+                  << std::setw(10) << std::left << "Static"
+                  << std::setw(10) << std::left << "Speedup"
+                  << std::endl;
+        for (Size i=0; i<2; ++i) {
+            VanillaOption& option = *options[i];
+            std::cout << names[i] << std::endl;
+            checkStaticRollback<CoxRossRubinstein_2>(
+                "Cox-Ross-Rubinstein", m, option, truncatedSteps);
+            checkStaticRollback<Tian_2>(
+                "Tian", m, option, truncatedSteps);
+            checkStaticRollback<LeisenReimer_2>(
+                "Leisen-Reimer", m, option, truncatedSteps+1);
+            checkStaticRollback<Joshi4_2>(
+                "Joshi", m, option, truncatedSteps+1);
+            checkStaticRollback<ExtendedCoxRossRubinstein>(
+                "Ext. Cox-Ross-Rubinstein", m, option, truncatedSteps);
+            checkStaticRollback<ExtendedTian>(
+                "Ext. Tian", m, option, truncatedSteps);
+            checkStaticRollback<ExtendedLeisenReimer>(
+                "Ext. Leisen-Reimer", m, option, truncatedSteps+1);
+            checkStaticRollback<ExtendedJoshi4>(
+                "Ext. Joshi", m, option, truncatedSteps+1);
+        }
+
+        std::cout << std::endl << "American implied volatilities, "
+                  << timeSteps << " steps" << std::endl;
+        std::cout << std::setw(28) << std::left << "Method"
+                  << std::setw(10) << std::left << "Brent"
+                  << std::setw(14) << std::left << "Error"
+                  << std::setw(10) << std::left << "Time"
+                  << std::setw(10) << std::left << "Newton"
+                  << std::setw(14) << std::left << "Error"
+                  << std::setw(10) << std::left << "Time"
+                  << std::setw(10) << std::left << "Failures"
+                  << std::endl;
+        checkImpliedVolatility<CoxRossRubinstein_2>(
+            "Cox-Ross-Rubinstein", todaysDate, maturity, timeSteps);
+        checkImpliedVolatility<LeisenReimer_2>(
+            "Leisen-Reimer", todaysDate, maturity, timeSteps);
+
+        std::cout << std::endl << "Spot ladder, -20% to +20%, "
+                  << timeSteps << " steps" << std::endl;
+        std::cout << std::setw(28) << std::left << "Method"
+                  << std::setw(14) << std::left << "Value error"
+                  << std::setw(14) << std::left << "Delta error"
+                  << std::setw(10) << std::left << "Fresh"
+                  << std::setw(10) << std::left << "Ladder"
+                  << std::setw(10) << std::left << "Levels"
+                  << std::endl;
+        for (Size i=0; i<2; ++i) {
+            VanillaOption& option = *options[i];
+            std::cout << names[i] << std::endl;
+            checkSpotLadder<CoxRossRubinstein_2>(
+                "Cox-Ross-Rubinstein", m, option, timeSteps);
+            checkSpotLadder<Trigeorgis_2>(
+                "Trigeorgis", m, option, timeSteps);
+        }
+
+        std::cout << std::endl << "Cached results on a moving smile, "
+                  << timeSteps << " steps" << std::endl;
+        std::cout << std::setw(28) << std::left << "Method"
+                  << std::setw(10) << std::left << "Hits"
+                  << std::setw(10) << std::left << "Misses"
+                  << std::setw(14) << std::left << "Rebuilt"
+                  << std::setw(14) << std::left << "Moved"
+                  << std::endl;
+        for (Size i=0; i<2; ++i) {
+            VanillaOption& option = *options[i];
+            std::cout << names[i] << std::endl;
+            checkCacheKey<CoxRossRubinstein_2>(
+                "Cox-Ross-Rubinstein", m, todaysDate, maturity, option,
+                timeSteps);
+        }
 
         return 0;
 
@@ -23,4 +676,3 @@ int main() {
         return 1;
     }
 }
-
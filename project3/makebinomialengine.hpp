@@ -0,0 +1,160 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file makebinomialengine.hpp
+    \brief Factory of binomial engines, optionally cached and routed
+*/
+
+#ifndef make_binomial_engine_hpp
+#define make_binomial_engine_hpp
+
+#include "binomialengine.hpp"
+#include "cachingengine.hpp"
+#include "routingengine.hpp"
+#include <sstream>
+#include <typeinfo>
+
+namespace QuantLib {
+
+    //! Binomial engine factory
+    template <class T>
+    class MakeBinomialVanillaEngine_2 {
+      public:
+        MakeBinomialVanillaEngine_2(
+                    const boost::shared_ptr<GeneralizedBlackScholesProcess>&);
+        // named parameters
+        MakeBinomialVanillaEngine_2& withSteps(Size steps);
+        MakeBinomialVanillaEngine_2& withAdjointGreeks(bool b = true);
+        MakeBinomialVanillaEngine_2& withTruncation(Real stdDevs);
+        MakeBinomialVanillaEngine_2& withBlackScholesSmoothing(bool b = true);
+        MakeBinomialVanillaEngine_2& withDividends(const DividendSchedule&);
+        //! wraps the engine in a CachingVanillaEngine_2
+        MakeBinomialVanillaEngine_2& withCache(
+                         const boost::shared_ptr<PricingResultCache>& cache);
+        /*! wraps the engine in a RoutingVanillaEngine_2, so that
+            options with a closed form skip the tree
+        */
+        MakeBinomialVanillaEngine_2& withRouting(bool b = true);
+        // conversion to pricing engine
+        operator boost::shared_ptr<PricingEngine>() const;
+      private:
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process_;
+        Size steps_;
+        bool adjointGreeks_;
+        Real truncation_;
+        bool smoothing_;
+        DividendSchedule dividends_;
+        boost::shared_ptr<PricingResultCache> cache_;
+        bool routing_;
+    };
+
+
+    // inline definitions
+
+    template <class T>
+    inline MakeBinomialVanillaEngine_2<T>::MakeBinomialVanillaEngine_2(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process)
+    : process_(process), steps_(Null<Size>()), adjointGreeks_(false),
+      truncation_(Null<Real>()), smoothing_(false), routing_(false) {}
+
+    template <class T>
+    inline MakeBinomialVanillaEngine_2<T>&
+    MakeBinomialVanillaEngine_2<T>::withSteps(Size steps) {
+        steps_ = steps;
+        return *this;
+    }
+
+    template <class T>
+    inline MakeBinomialVanillaEngine_2<T>&
+    MakeBinomialVanillaEngine_2<T>::withAdjointGreeks(bool b) {
+        adjointGreeks_ = b;
+        return *this;
+    }
+
+    template <class T>
+    inline MakeBinomialVanillaEngine_2<T>&
+    MakeBinomialVanillaEngine_2<T>::withTruncation(Real stdDevs) {
+        truncation_ = stdDevs;
+        return *this;
+    }
+
+    template <class T>
+    inline MakeBinomialVanillaEngine_2<T>&
+    MakeBinomialVanillaEngine_2<T>::withBlackScholesSmoothing(bool b) {
+        smoothing_ = b;
+        return *this;
+    }
+
+    template <class T>
+    inline MakeBinomialVanillaEngine_2<T>&
+    MakeBinomialVanillaEngine_2<T>::withDividends(
+                                        const DividendSchedule& dividends) {
+        dividends_ = dividends;
+        return *this;
+    }
+
+    template <class T>
+    inline MakeBinomialVanillaEngine_2<T>&
+    MakeBinomialVanillaEngine_2<T>::withCache(
+                        const boost::shared_ptr<PricingResultCache>& cache) {
+        cache_ = cache;
+        return *this;
+    }
+
+    template <class T>
+    inline MakeBinomialVanillaEngine_2<T>&
+    MakeBinomialVanillaEngine_2<T>::withRouting(bool b) {
+        routing_ = b;
+        return *this;
+    }
+
+    template <class T>
+    inline MakeBinomialVanillaEngine_2<T>::operator
+    boost::shared_ptr<PricingEngine>() const {
+        QL_REQUIRE(steps_ != Null<Size>(), "number of steps not given");
+        boost::shared_ptr<PricingEngine> engine(new
+            BinomialVanillaEngine_2<T>(process_,
+                                       steps_,
+                                       adjointGreeks_,
+                                       truncation_,
+                                       smoothing_,
+                                       dividends_));
+        if (cache_) {
+            std::ostringstream configuration;
+            configuration << "binomial:" << typeid(T).name()
+                          << "," << steps_ << "," << adjointGreeks_
+                          << "," << cacheKeyField(truncation_)
+                          << "," << smoothing_;
+            for (Size k=0; k<dividends_.size(); ++k)
+                configuration << "," << dividends_[k]->date().serialNumber()
+                              << ":" << cacheKeyField(dividends_[k]->amount());
+            engine = boost::shared_ptr<PricingEngine>(
+                new CachingVanillaEngine_2(engine, process_,
+                                           configuration.str(), cache_));
+        }
+        // the router goes in front of the cache, since analytic
+        // results are not worth caching
+        if (routing_)
+            engine = boost::shared_ptr<PricingEngine>(
+                new RoutingVanillaEngine_2(engine, process_, dividends_));
+        return engine;
+    }
+
+}
+
+
+#endif
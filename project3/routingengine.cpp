@@ -0,0 +1,103 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+#include "routingengine.hpp"
+#include <ql/exercise.hpp>
+#include <ql/pricingengines/vanilla/analyticeuropeanengine.hpp>
+
+namespace QuantLib {
+
+    namespace {
+
+        // number of times at which the curves are checked
+        const Size curveSamples = 32;
+
+    }
+
+
+    RoutingVanillaEngine_2::RoutingVanillaEngine_2(
+             const boost::shared_ptr<PricingEngine>& engine,
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             const DividendSchedule& dividends)
+    : engine_(engine), process_(process), dividends_(dividends),
+      analytic_(new AnalyticEuropeanEngine(process)) {
+        QL_REQUIRE(engine_, "no engine given");
+        QL_REQUIRE(process_, "no process given");
+        registerWith(process_);
+        registerWith(engine_);
+    }
+
+    void RoutingVanillaEngine_2::calculate() const {
+        boost::shared_ptr<StrikedTypePayoff> payoff =
+            boost::dynamic_pointer_cast<StrikedTypePayoff>(arguments_.payoff);
+        const Exercise& exercise = *arguments_.exercise;
+
+        if (!payoff || !dividends_.empty()) {
+            calculate(engine_, arguments_, "engine");
+        } else if (exercise.type() == Exercise::European) {
+            calculate(analytic_, arguments_, "analytic");
+        } else if (boost::dynamic_pointer_cast<PlainVanillaPayoff>(payoff) &&
+                   payoff->optionType() == Option::Call &&
+                   earlyExerciseNeverOptimal()) {
+            VanillaOption::arguments european = arguments_;
+            european.exercise = boost::shared_ptr<Exercise>(
+                                  new EuropeanExercise(exercise.lastDate()));
+            calculate(analytic_, european, "analytic (no early exercise)");
+        } else {
+            calculate(engine_, arguments_, "engine");
+        }
+    }
+
+    /* A call is worth at least S D_q(t,T) - K D_r(t,T) at any time t
+       before the last exercise date T, hence more than its exercise
+       value S - K if D_q(t,T) >= 1 and D_r(t,T) <= 1. */
+    bool RoutingVanillaEngine_2::earlyExerciseNeverOptimal() const {
+        Time maturity = process_->time(arguments_.exercise->lastDate());
+        if (maturity <= 0.0)
+            return false;
+        DiscountFactor dividendDiscount =
+            process_->dividendYield()->discount(maturity);
+        DiscountFactor riskFreeDiscount =
+            process_->riskFreeRate()->discount(maturity);
+        for (Size i=0; i<curveSamples; ++i) {
+            Time t = maturity*i/curveSamples;
+            if (process_->dividendYield()->discount(t) > dividendDiscount ||
+                process_->riskFreeRate()->discount(t) < riskFreeDiscount)
+                return false;
+        }
+        return true;
+    }
+
+    void RoutingVanillaEngine_2::calculate(
+                          const boost::shared_ptr<PricingEngine>& engine,
+                          const VanillaOption::arguments& arguments,
+                          const std::string& route) const {
+        engine->reset();
+        VanillaOption::arguments* engineArguments =
+            dynamic_cast<VanillaOption::arguments*>(engine->getArguments());
+        QL_REQUIRE(engineArguments, "wrong engine type");
+        *engineArguments = arguments;
+        engineArguments->validate();
+        engine->calculate();
+        const VanillaOption::results* results =
+            dynamic_cast<const VanillaOption::results*>(engine->getResults());
+        QL_ENSURE(results != 0, "no results returned from engine");
+        results_ = *results;
+        results_.additionalResults["route"] = route;
+    }
+
+}
@@ -0,0 +1,73 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file routingengine.hpp
+    \brief Engine sending options with a closed form to the analytic engine
+*/
+
+#ifndef routing_engine_hpp
+#define routing_engine_hpp
+
+#include <ql/instruments/vanillaoption.hpp>
+#include <ql/instruments/dividendschedule.hpp>
+#include <ql/processes/blackscholesprocess.hpp>
+#include <string>
+
+namespace QuantLib {
+
+    //! Engine choosing between a closed form and a configured engine
+    /*! The exercise and payoff of each option select the route:
+        - European options with a striked payoff are priced by the
+          AnalyticEuropeanEngine, which is exact for the Black-Scholes
+          process whatever its term structures;
+        - plain-vanilla calls with American or Bermudan exercise are
+          priced as European options on their last exercise date if
+          no dividends are paid before it and interest rates are not
+          negative, since early exercise is then never optimal;
+        - all other options are priced by the configured engine.
+
+        With discrete dividends, which the closed form does not
+        model, the configured engine is always used.  The route is
+        returned as the "route" additional result, namely
+        "analytic", "analytic (no early exercise)" or "engine".
+
+        \warning the dividend and interest-rate conditions of the
+                 second route are checked on a grid of 32 times up to
+                 the last exercise date.
+    */
+    class RoutingVanillaEngine_2 : public VanillaOption::engine {
+      public:
+        RoutingVanillaEngine_2(
+             const boost::shared_ptr<PricingEngine>& engine,
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             const DividendSchedule& dividends = DividendSchedule());
+        void calculate() const;
+      private:
+        bool earlyExerciseNeverOptimal() const;
+        void calculate(const boost::shared_ptr<PricingEngine>& engine,
+                       const VanillaOption::arguments& arguments,
+                       const std::string& route) const;
+        boost::shared_ptr<PricingEngine> engine_;
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process_;
+        DividendSchedule dividends_;
+        boost::shared_ptr<PricingEngine> analytic_;
+    };
+
+}
+
+
+#endif
@@ -0,0 +1,352 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file staticbinomialengine.hpp
+    \brief Binomial engine with a statically dispatched rollback
+*/
+
+#ifndef static_binomial_engine_hpp
+#define static_binomial_engine_hpp
+
+#include <ql/instruments/vanillaoption.hpp>
+#include <ql/pricingengines/greeks.hpp>
+#include <ql/processes/blackscholesprocess.hpp>
+#include "binomialrollback.hpp"
+#include "../common/pricingmonitor.hpp"
+
+namespace QuantLib {
+
+    //! Call payoff with an inlined evaluation
+    struct BinomialCallPayoff_2 {
+        explicit BinomialCallPayoff_2(Real strike) : strike(strike) {}
+        Real operator()(Real s) const { return std::max(s - strike, 0.0); }
+        Real strike;
+    };
+
+    //! Put payoff with an inlined evaluation
+    struct BinomialPutPayoff_2 {
+        explicit BinomialPutPayoff_2(Real strike) : strike(strike) {}
+        Real operator()(Real s) const { return std::max(strike - s, 0.0); }
+        Real strike;
+    };
+
+    //! No early exercise
+    struct BinomialEuropeanPolicy_2 {
+        bool operator()(Size) const { return false; }
+    };
+
+    //! Early exercise at every step from the first one given
+    struct BinomialAmericanPolicy_2 {
+        explicit BinomialAmericanPolicy_2(Size first) : first(first) {}
+        bool operator()(Size i) const { return i >= first; }
+        Size first;
+    };
+
+    //! No progress reports from the rollback
+    struct BinomialNoCheckpoint_2 {
+        void operator()(Size, Size) const {}
+    };
+
+    //! Early exercise at a given set of steps
+    struct BinomialBermudanPolicy_2 {
+        explicit BinomialBermudanPolicy_2(const std::vector<bool>& steps)
+        : steps(steps) {}
+        bool operator()(Size i) const { return steps[i]; }
+        const std::vector<bool>& steps;
+    };
+
+
+    //! Per-step parameters of a binomial tree for the static rollback
+    /*! For every tree in this library the node prices at step
+        \f$ i \f$ are \f$ S_{ij} = S_{i0} r_i^j \f$ and the branch
+        probabilities don't depend on the node, so that a step is
+        described by \f$ S_{i0} \f$, \f$ r_i \f$ and the discounted
+        probabilities \f$ p_d \f$ and \f$ p_u \f$ of its branches.
+    */
+    struct StaticBinomialSteps_2 {
+        Size steps;
+        //! first node price and node ratio at steps 0 to n
+        const Real *s0, *ratio;
+        //! discounted branch probabilities at steps 0 to n-1
+        const Real *pd, *pu;
+    };
+
+    //! Reads the per-step parameters of a tree into arena storage
+    /*! The tree is queried once per step here, so that the rollback
+        makes no call to it, virtual or not.
+    */
+    template <class T>
+    StaticBinomialSteps_2 staticBinomialSteps_2(const T& tree,
+                                                DiscountFactor discount,
+                                                BinomialArena_2& arena) {
+        Size n = tree.columns()-1;
+        Real* s0 = arena.allocate(n+1);
+        Real* ratio = arena.allocate(n+1);
+        Real* pd = arena.allocate(n);
+        Real* pu = arena.allocate(n);
+        for (Size i=0; i<=n; ++i) {
+            s0[i] = tree.underlying(i, 0);
+            ratio[i] = (i > 0 ? tree.underlying(i, 1)/s0[i] : 1.0);
+        }
+        for (Size i=0; i<n; ++i) {
+            pd[i] = discount*tree.probability(i, 0, 0);
+            pu[i] = discount*tree.probability(i, 0, 1);
+        }
+        StaticBinomialSteps_2 result = { n, s0, ratio, pd, pu };
+        return result;
+    }
+
+
+    //! Rollback of a binomial tree with compile-time exercise and payoff
+    /*! The exercise policy and the payoff are template parameters,
+        so that every call in the loops is resolved at compile time
+        and can be inlined, and the tree is given by its per-step
+        parameters read beforehand by staticBinomialSteps_2; the
+        rollback thus only reads arrays.  Node prices are obtained by
+        multiplication, and the continuation values are computed in
+        a separate loop without dependencies between iterations,
+        which the compiler can vectorize.
+
+        Every 256 steps, \c checkpoint is called with the steps
+        rolled back so far and the total number of steps; it may
+        stop the rollback by throwing.
+
+        \c values must hold n+1 elements; on exit, it holds the value
+        at the root, and \c level1 and \c level2 hold the values at
+        the first two steps.
+    */
+    template <class Exercise, class Payoff, class Checkpoint>
+    void staticBinomialRollback_2(const StaticBinomialSteps_2& tree,
+                                  const Exercise& exercise,
+                                  const Payoff& payoff,
+                                  Real* values,
+                                  Real* level1,
+                                  Real* level2,
+                                  const Checkpoint& checkpoint) {
+        Size n = tree.steps;
+
+        // payoff at maturity
+        Real s = tree.s0[n], ratio = tree.ratio[n];
+        for (Size j=0; j<=n; ++j) {
+            values[j] = payoff(s);
+            s *= ratio;
+        }
+
+        for (Size i=n; i>0; --i) {
+            if ((n-i) % 256 == 0)
+                checkpoint(n-i, n);
+            Size k = i-1, nodes = i;
+            Real pd = tree.pd[k], pu = tree.pu[k];
+            for (Size j=0; j<nodes; ++j)
+                values[j] = pd*values[j] + pu*values[j+1];
+            if (exercise(k)) {
+                s = tree.s0[k];
+                ratio = tree.ratio[k];
+                for (Size j=0; j<nodes; ++j) {
+                    values[j] = std::max(values[j], payoff(s));
+                    s *= ratio;
+                }
+            }
+            if (k == 2)
+                std::copy(values, values+3, level2);
+            else if (k == 1)
+                std::copy(values, values+2, level1);
+        }
+    }
+
+    //! Rollback without progress reports
+    template <class Exercise, class Payoff>
+    void staticBinomialRollback_2(const StaticBinomialSteps_2& tree,
+                                  const Exercise& exercise,
+                                  const Payoff& payoff,
+                                  Real* values,
+                                  Real* level1,
+                                  Real* level2) {
+        staticBinomialRollback_2(tree, exercise, payoff, values,
+                                 level1, level2, BinomialNoCheckpoint_2());
+    }
+
+
+    //! Pricing engine for vanilla options using a static rollback
+    /*! \ingroup vanillaengines
+
+        This engine prices plain-vanilla options with
+        staticBinomialRollback_2; the per-step parameters of the tree
+        are read once before the rollback, and the payoff and
+        exercise types are dispatched once per calculation to one of
+        six instantiations of the kernel, with no call to the tree
+        inside the rollback.  It
+        works with any tree having the constructor signature and the
+        interface of the trees in this library, including the
+        Extended trees.
+
+        A PricingMonitor, if set, is told of the progress and polled
+        for cancellation every 256 steps, as in
+        BinomialVanillaEngine_2.  Unlike the latter, this engine
+        doesn't provide the exercise boundary, truncation, smoothing
+        or dividends.
+
+        \test the correctness of the returned values is tested by
+              checking it against BinomialVanillaEngine_2 and
+              BinomialVanillaEngine, on both the _2 and the Extended
+              trees.
+    */
+    template <class T>
+    class StaticBinomialVanillaEngine_2 : public VanillaOption::engine,
+                                          public MonitoredEngine {
+      public:
+        StaticBinomialVanillaEngine_2(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             Size timeSteps)
+        : process_(process), timeSteps_(timeSteps),
+          flatProcess_(new FlatBinomialProcess_2) {
+            QL_REQUIRE(timeSteps >= 2,
+                       "at least 2 time steps required, "
+                       << timeSteps << " provided");
+            registerWith(process_);
+        }
+        void calculate() const;
+      private:
+        // forwards the progress of the rollback to the monitor
+        class Checkpoint {
+          public:
+            explicit Checkpoint(const StaticBinomialVanillaEngine_2& engine)
+            : engine_(engine) {}
+            void operator()(Size done, Size total) const {
+                engine_.checkpoint(done, total);
+            }
+          private:
+            const StaticBinomialVanillaEngine_2& engine_;
+        };
+        template <class Payoff>
+        void rollback(const StaticBinomialSteps_2& tree, Time dt,
+                      const Payoff& payoff, Real* values,
+                      Real* level1, Real* level2) const;
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process_;
+        Size timeSteps_;
+        boost::shared_ptr<FlatBinomialProcess_2> flatProcess_;
+        mutable BinomialArena_2 arena_;
+        mutable std::vector<bool> exercise_;
+    };
+
+
+    // template definitions
+
+    template <class T>
+    template <class Payoff>
+    void StaticBinomialVanillaEngine_2<T>::rollback(
+                                        const StaticBinomialSteps_2& tree,
+                                        Time dt,
+                                        const Payoff& payoff,
+                                               Real* values,
+                                               Real* level1,
+                                               Real* level2) const {
+        // exercise times are snapped to the closest step as in
+        // DiscretizedVanillaOption
+        Size n = tree.steps;
+        switch (arguments_.exercise->type()) {
+          case Exercise::American: {
+              Time t0 = process_->time(arguments_.exercise->date(0));
+              Size first = std::min<Size>(
+                  n, Size(std::max<Real>(0.0, t0/dt + 0.5)));
+              staticBinomialRollback_2(tree,
+                                       BinomialAmericanPolicy_2(first),
+                                       payoff, values, level1, level2,
+                                       Checkpoint(*this));
+            }
+            break;
+          case Exercise::Bermudan:
+            exercise_.assign(n+1, false);
+            for (Size k=0; k<arguments_.exercise->dates().size(); ++k) {
+                Time t = process_->time(arguments_.exercise->date(k));
+                if (t >= 0.0)
+                    exercise_[std::min<Size>(n, Size(t/dt + 0.5))] = true;
+            }
+            staticBinomialRollback_2(tree,
+                                     BinomialBermudanPolicy_2(exercise_),
+                                     payoff, values, level1, level2,
+                                     Checkpoint(*this));
+            break;
+          case Exercise::European:
+            staticBinomialRollback_2(tree,
+                                     BinomialEuropeanPolicy_2(),
+                                     payoff, values, level1, level2,
+                                     Checkpoint(*this));
+            break;
+          default:
+            QL_FAIL("invalid exercise type");
+        }
+    }
+
+    template <class T>
+    void StaticBinomialVanillaEngine_2<T>::calculate() const {
+
+        boost::shared_ptr<PlainVanillaPayoff> payoff =
+            boost::dynamic_pointer_cast<PlainVanillaPayoff>(arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+
+        Time maturity = process_->time(arguments_.exercise->lastDate());
+        BinomialParameters_2 parameters = flatBinomialParameters_2(
+            *process_, arguments_.exercise->lastDate(), maturity,
+            timeSteps_);
+
+        flatProcess_->reset(parameters);
+        arena_.reset();
+        T tree(flatProcess_, maturity, timeSteps_, payoff->strike());
+
+        Size n = tree.columns()-1;
+        Time dt = maturity/n;
+        DiscountFactor discount = std::exp(-parameters.riskFreeRate*dt);
+
+        StaticBinomialSteps_2 steps =
+            staticBinomialSteps_2(tree, discount, arena_);
+        Real* values = arena_.allocate(tree.size(n));
+        Real level1[2], level2[3];
+        if (payoff->optionType() == Option::Call)
+            rollback(steps, dt, BinomialCallPayoff_2(payoff->strike()),
+                     values, level1, level2);
+        else
+            rollback(steps, dt, BinomialPutPayoff_2(payoff->strike()),
+                     values, level1, level2);
+
+        // Partial derivatives calculated from various points in the
+        // binomial tree
+        // (see J.C.Hull, "Options, Futures and other derivatives", 6th edition, pp 397/398)
+        Real s2u = tree.underlying(2, 2);
+        Real s2m = tree.underlying(2, 1);
+        Real s2d = tree.underlying(2, 0);
+        Real delta2u = (level2[2] - level2[1])/(s2u - s2m);
+        Real delta2d = (level2[1] - level2[0])/(s2m - s2d);
+        Real gamma = (delta2u - delta2d) / ((s2u - s2d)/2);
+
+        Real s1u = tree.underlying(1, 1);
+        Real s1d = tree.underlying(1, 0);
+        Real delta = (level1[1] - level1[0]) / (s1u - s1d);
+
+        results_.value = values[0];
+        results_.delta = delta;
+        results_.gamma = gamma;
+        results_.theta = blackScholesTheta(process_,
+                                           results_.value,
+                                           results_.delta,
+                                           results_.gamma);
+    }
+
+}
+
+
+#endif
@@ -28,19 +28,112 @@
 #define binomial_engine_hpp
 
 #include <ql/methods/lattices/binomialtree.hpp>
-#include <ql/methods/lattices/bsmlattice.hpp>
-#include <ql/math/distributions/normaldistribution.hpp>
-#include <ql/pricingengines/vanilla/discretizedvanillaoption.hpp>
+#include <ql/instruments/vanillaoption.hpp>
 #include <ql/pricingengines/greeks.hpp>
 #include <ql/processes/blackscholesprocess.hpp>
-#include <ql/termstructures/yield/flatforward.hpp>
-#include <ql/termstructures/volatility/equityfx/blackconstantvol.hpp>
+#include <list>
 
 namespace QuantLib {
 
+    //! Flat Black-Scholes inputs to the binomial trees
+    /*! These are the only quantities a constant-coefficient tree
+        needs; they are extracted once per calculation instead of
+        being wrapped into term structures and a process.
+    */
+    struct BinomialParameters_2 {
+        Real underlying;
+        Rate riskFreeRate;
+        Rate dividendYield;
+        Volatility volatility;
+        Time maturity;
+        Size timeSteps;
+    };
+
+
+    //! Constant-coefficient process built on binomial parameters
+    /*! The trees only query the initial value, the drift and the
+        variance of the process; this class answers those queries
+        from a plain BinomialParameters_2 instance which can be
+        replaced in place, so that the engine can reuse the same
+        object across calculations.
+    */
+    class FlatBinomialProcess_2 : public StochasticProcess1D {
+      public:
+        FlatBinomialProcess_2() {}
+        void reset(const BinomialParameters_2& parameters) {
+            parameters_ = parameters;
+        }
+        const BinomialParameters_2& parameters() const {
+            return parameters_;
+        }
+        Real x0() const { return parameters_.underlying; }
+        Real drift(Time, Real) const {
+            Volatility v = parameters_.volatility;
+            return parameters_.riskFreeRate - parameters_.dividendYield
+                - 0.5*v*v;
+        }
+        Real diffusion(Time, Real) const { return parameters_.volatility; }
+        Real expectation(Time t0, Real x0, Time dt) const {
+            return apply(x0, drift(t0, x0)*dt);
+        }
+        Real stdDeviation(Time, Real, Time dt) const {
+            return parameters_.volatility*std::sqrt(dt);
+        }
+        Real variance(Time, Real, Time dt) const {
+            Volatility v = parameters_.volatility;
+            return v*v*dt;
+        }
+        Real apply(Real x0, Real dx) const { return x0*std::exp(dx); }
+      private:
+        BinomialParameters_2 parameters_;
+    };
+
+
+    //! Scratch memory for the binomial rollback
+    /*! Memory is handed out sequentially and given back all at once
+        by reset().  When a calculation needs more than the arena
+        holds, the extra blocks are merged at the next reset so that
+        later calculations of the same size don't allocate.
+    */
+    class BinomialArena_2 {
+      public:
+        BinomialArena_2() : used_(0) {}
+        Real* allocate(Size n) {
+            n = std::max<Size>(n, 1);
+            if (used_ + n <= block_.size()) {
+                Real* p = &block_[used_];
+                used_ += n;
+                return p;
+            }
+            overflow_.push_back(std::vector<Real>(n));
+            return &overflow_.back()[0];
+        }
+        void reset() {
+            if (!overflow_.empty()) {
+                Size total = block_.size();
+                for (std::list<std::vector<Real> >::const_iterator i =
+                         overflow_.begin(); i != overflow_.end(); ++i)
+                    total += i->size();
+                overflow_.clear();
+                std::vector<Real>(total).swap(block_);
+            }
+            used_ = 0;
+        }
+      private:
+        std::vector<Real> block_;
+        std::list<std::vector<Real> > overflow_;
+        Size used_;
+    };
+
+
     //! Pricing engine for vanilla options using binomial trees
     /*! \ingroup vanillaengines
 
+        The process is flattened at the option maturity and the tree
+        is built directly from the resulting BinomialParameters_2;
+        the rollback runs in place on memory taken from a per-engine
+        arena, so that repeated calculations don't allocate.
+
         \test the correctness of the returned values is tested by
               checking it against analytic results.
 
@@ -56,7 +149,8 @@ namespace QuantLib {
         BinomialVanillaEngine_2(
              const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
              Size timeSteps)
-        : process_(process), timeSteps_(timeSteps) {
+        : process_(process), timeSteps_(timeSteps),
+          flatProcess_(new FlatBinomialProcess_2) {
             QL_REQUIRE(timeSteps >= 2,
                        "at least 2 time steps required, "
                        << timeSteps << " provided");
@@ -64,103 +158,147 @@ namespace QuantLib {
         }
         void calculate() const;
       private:
+        BinomialParameters_2 flatParameters(Time maturity) const;
         boost::shared_ptr<GeneralizedBlackScholesProcess> process_;
         Size timeSteps_;
+        boost::shared_ptr<FlatBinomialProcess_2> flatProcess_;
+        mutable BinomialArena_2 arena_;
+        mutable std::vector<Size> exerciseSteps_;
     };
 
 
     // template definitions
 
     template <class T>
-    void BinomialVanillaEngine_2<T>::calculate() const {
+    BinomialParameters_2
+    BinomialVanillaEngine_2<T>::flatParameters(Time maturity) const {
 
         DayCounter rfdc  = process_->riskFreeRate()->dayCounter();
         DayCounter divdc = process_->dividendYield()->dayCounter();
-        DayCounter voldc = process_->blackVolatility()->dayCounter();
-        Calendar volcal = process_->blackVolatility()->calendar();
+        Date maturityDate = arguments_.exercise->lastDate();
 
         Real s0 = process_->stateVariable()->value();
         QL_REQUIRE(s0 > 0.0, "negative or null underlying given");
-        Volatility v = process_->blackVolatility()->blackVol(
-            arguments_.exercise->lastDate(), s0);
-        Date maturityDate = arguments_.exercise->lastDate();
-        Rate r = process_->riskFreeRate()->zeroRate(maturityDate,
-            rfdc, Continuous, NoFrequency);
-        Rate q = process_->dividendYield()->zeroRate(maturityDate,
-            divdc, Continuous, NoFrequency);
-        Date referenceDate = process_->riskFreeRate()->referenceDate();
-
-        // binomial trees with constant coefficient
-        Handle<YieldTermStructure> flatRiskFree(
-            boost::shared_ptr<YieldTermStructure>(
-                new FlatForward(referenceDate, r, rfdc)));
-        Handle<YieldTermStructure> flatDividends(
-            boost::shared_ptr<YieldTermStructure>(
-                new FlatForward(referenceDate, q, divdc)));
-        Handle<BlackVolTermStructure> flatVol(
-            boost::shared_ptr<BlackVolTermStructure>(
-                new BlackConstantVol(referenceDate, volcal, v, voldc)));
+
+        BinomialParameters_2 parameters;
+        parameters.underlying = s0;
+        parameters.riskFreeRate = process_->riskFreeRate()->zeroRate(
+            maturityDate, rfdc, Continuous, NoFrequency);
+        parameters.dividendYield = process_->dividendYield()->zeroRate(
+            maturityDate, divdc, Continuous, NoFrequency);
+        parameters.volatility = process_->blackVolatility()->blackVol(
+            maturityDate, s0);
+        parameters.maturity = maturity;
+        parameters.timeSteps = timeSteps_;
+        return parameters;
+    }
+
+    template <class T>
+    void BinomialVanillaEngine_2<T>::calculate() const {
 
         boost::shared_ptr<PlainVanillaPayoff> payoff =
             boost::dynamic_pointer_cast<PlainVanillaPayoff>(arguments_.payoff);
         QL_REQUIRE(payoff, "non-plain payoff given");
 
-        Time maturity = rfdc.yearFraction(referenceDate, maturityDate);
-
-        boost::shared_ptr<StochasticProcess1D> bs(
-                         new GeneralizedBlackScholesProcess(
-                                      process_->stateVariable(),
-                                      flatDividends, flatRiskFree, flatVol));
-
-        TimeGrid grid(maturity, timeSteps_);
-
-        boost::shared_ptr<T> tree(new T(bs, maturity, timeSteps_,
-                                        payoff->strike()));
-
-        boost::shared_ptr<BlackScholesLattice<T> > lattice(
-            new BlackScholesLattice<T>(tree, r, maturity, timeSteps_));
-
-        DiscretizedVanillaOption option(arguments_, *process_, grid);
+        Time maturity = process_->time(arguments_.exercise->lastDate());
+        BinomialParameters_2 parameters = flatParameters(maturity);
+
+        // binomial trees with constant coefficient, built on the
+        // engine-owned process and memory
+        flatProcess_->reset(parameters);
+        arena_.reset();
+        T tree(flatProcess_, maturity, timeSteps_, payoff->strike());
+
+        // the tree might have adjusted the number of steps
+        Size n = tree.columns()-1;
+        Time dt = maturity/n;
+        DiscountFactor discount = std::exp(-parameters.riskFreeRate*dt);
+
+        // steps at which exercise is checked; the exercise times are
+        // snapped to the closest step as in DiscretizedVanillaOption
+        exerciseSteps_.clear();
+        Size firstExercise = n;
+        switch (arguments_.exercise->type()) {
+          case Exercise::American:
+            firstExercise = std::min<Size>(
+                n, Size(std::max<Real>(0.0,
+                    process_->time(arguments_.exercise->date(0))/dt + 0.5)));
+            break;
+          case Exercise::Bermudan:
+            for (Size k=0; k<arguments_.exercise->dates().size(); ++k) {
+                Time t = process_->time(arguments_.exercise->date(k));
+                if (t >= 0.0)
+                    exerciseSteps_.push_back(
+                                 std::min<Size>(n, Size(t/dt + 0.5)));
+            }
+            std::sort(exerciseSteps_.begin(), exerciseSteps_.end());
+            break;
+          case Exercise::European:
+            break;
+          default:
+            QL_FAIL("invalid exercise type");
+        }
+        std::vector<Size>::const_reverse_iterator nextExercise =
+            exerciseSteps_.rbegin();
 
-        option.initialize(lattice, maturity);
+        // values at maturity
+        Real* values = arena_.allocate(tree.size(n));
+        for (Size j=0; j<tree.size(n); ++j)
+            values[j] = (*payoff)(tree.underlying(n, j));
 
         // Partial derivatives calculated from various points in the
-        // binomial tree 
+        // binomial tree
         // (see J.C.Hull, "Options, Futures and other derivatives", 6th edition, pp 397/398)
+        Real p2u = 0.0, p2m = 0.0, p2d = 0.0, p1u = 0.0, p1d = 0.0;
+
+        for (Size i=n; i>0; --i) {
+            Size k = i-1;
+            Real pd = tree.probability(k, 0, 0);
+            Real pu = tree.probability(k, 0, 1);
+            Size nodes = tree.size(k);
+            // in place: node j reads nodes j and j+1 of the next step,
+            // which are not overwritten yet
+            for (Size j=0; j<nodes; ++j)
+                values[j] = discount*(pd*values[j] + pu*values[j+1]);
+
+            while (nextExercise != exerciseSteps_.rend() && *nextExercise > k)
+                ++nextExercise;
+            bool exercise = (k >= firstExercise) ||
+                (nextExercise != exerciseSteps_.rend() && *nextExercise == k);
+            if (exercise) {
+                for (Size j=0; j<nodes; ++j)
+                    values[j] = std::max(values[j],
+                                         (*payoff)(tree.underlying(k, j)));
+            }
+
+            if (k == 2) {
+                p2u = values[2]; // up
+                p2m = values[1]; // mid
+                p2d = values[0]; // down (low)
+            } else if (k == 1) {
+                p1u = values[1];
+                p1d = values[0];
+            }
+        }
+        Real p0 = values[0];
 
-        // Rollback to third-last step, and get underlying prices (s2) &
-        // option values (p2) at this point
-        option.rollback(grid[2]);
-        Array va2(option.values());
-        QL_ENSURE(va2.size() == 3, "Expect 3 nodes in grid at second step");
-        Real p2u = va2[2]; // up
-        Real p2m = va2[1]; // mid
-        Real p2d = va2[0]; // down (low)
-        Real s2u = lattice->underlying(2, 2); // up price
-        Real s2m = lattice->underlying(2, 1); // middle price
-        Real s2d = lattice->underlying(2, 0); // down (low) price
+        // option values (p2) and underlying prices (s2) at the
+        // third-last step
+        Real s2u = tree.underlying(2, 2); // up price
+        Real s2m = tree.underlying(2, 1); // middle price
+        Real s2d = tree.underlying(2, 0); // down (low) price
 
         // calculate gamma by taking the first derivate of the two deltas
         Real delta2u = (p2u - p2m)/(s2u-s2m);
         Real delta2d = (p2m-p2d)/(s2m-s2d);
         Real gamma = (delta2u - delta2d) / ((s2u-s2d)/2);
 
-        // Rollback to second-last step, and get option values (p1) at
-        // this point
-        option.rollback(grid[1]);
-        Array va(option.values());
-        QL_ENSURE(va.size() == 2, "Expect 2 nodes in grid at first step");
-        Real p1u = va[1];
-        Real p1d = va[0];
-        Real s1u = lattice->underlying(1, 1); // up (high) price
-        Real s1d = lattice->underlying(1, 0); // down (low) price
+        // option values (p1) at the second-last step
+        Real s1u = tree.underlying(1, 1); // up (high) price
+        Real s1d = tree.underlying(1, 0); // down (low) price
 
         Real delta = (p1u - p1d) / (s1u - s1d);
 
-        // Finally, rollback to t=0
-        option.rollback(0.0);
-        Real p0 = option.presentValue();
-
         // Store results
         results_.value = p0;
         results_.delta = delta;
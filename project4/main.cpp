@@ -1,16 +1,162 @@
 
 #include "binomialengine.hpp"
+#include "../common/engineinstrumentation.hpp"
 #include <ql/pricingengines/vanilla/binomialengine.hpp>
 #include <ql/methods/lattices/binomialtree.hpp>
+#include <ql/instruments/vanillaoption.hpp>
+#include <ql/quotes/simplequote.hpp>
+#include <ql/settings.hpp>
+#include <ql/termstructures/yield/flatforward.hpp>
+#include <ql/termstructures/volatility/equityfx/blackconstantvol.hpp>
+#include <ql/time/calendars/target.hpp>
+#include <ql/time/daycounters/actual365fixed.hpp>
 #include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <ctime>
 
 using namespace QuantLib;
 
+namespace {
+
+    struct Timing {
+        Real value, delta, gamma;
+        double seconds;
+        // heap allocations per calculation, once the engine memory
+        // has reached its size; Null<Real>() if they are not counted
+        Real allocations;
+    };
+
+    /* The engine is called directly, so that the count doesn't
+       include the allocations of the instrument machinery.  The
+       first two calculations are not measured: the arena of the
+       in-place engine grows during the first one and is merged into
+       a single block at the beginning of the second. */
+    Timing timing(PricingEngine& engine, const VanillaOption& option,
+                  Size repetitions) {
+        Timing result;
+        option.setupArguments(engine.getArguments());
+        engine.getArguments()->validate();
+        for (Size i=0; i<2; ++i) {
+            engine.reset();
+            engine.calculate();
+        }
+
+        #if defined(QL_ENABLE_ENGINE_INSTRUMENTATION)
+        unsigned long start = engineAllocationCount();
+        #endif
+        std::clock_t clockStart = std::clock();
+        for (Size i=0; i<repetitions; ++i) {
+            engine.reset();
+            engine.calculate();
+        }
+        result.seconds =
+            double(std::clock()-clockStart)/CLOCKS_PER_SEC/repetitions;
+        #if defined(QL_ENABLE_ENGINE_INSTRUMENTATION)
+        result.allocations =
+            Real(engineAllocationCount()-start)/repetitions;
+        #else
+        result.allocations = Null<Real>();
+        #endif
+
+        const OneAssetOption::results* r =
+            dynamic_cast<const OneAssetOption::results*>(engine.getResults());
+        QL_REQUIRE(r != 0, "no results returned from engine");
+        result.value = r->value;
+        result.delta = r->delta;
+        result.gamma = r->gamma;
+        return result;
+    }
+
+    std::string allocations(const Timing& t) {
+        if (t.allocations == Null<Real>())
+            return "N/A";
+        std::ostringstream out;
+        out << t.allocations;
+        return out.str();
+    }
+
+    // in-place rollback against the lattice-based rollback
+    template <class T>
+    void compare(const std::string& method,
+                 const boost::shared_ptr<GeneralizedBlackScholesProcess>& p,
+                 const VanillaOption& option, Size timeSteps) {
+        Size repetitions =
+            std::max<Size>(1, 50000000/(timeSteps*timeSteps));
+        BinomialVanillaEngine<T> lattice(p, timeSteps);
+        BinomialVanillaEngine_2<T> inPlace(p, timeSteps);
+        Timing l = timing(lattice, option, repetitions);
+        Timing i = timing(inPlace, option, repetitions);
+        Real difference = std::max(std::fabs(l.value - i.value),
+                                   std::max(std::fabs(l.delta - i.delta),
+                                            std::fabs(l.gamma - i.gamma)));
+
+        std::cout << std::setw(24) << std::left << method
+                  << std::setw(8) << std::left << timeSteps
+                  << std::setw(14) << std::left << difference
+                  << std::setw(12) << std::left << l.seconds
+                  << std::setw(10) << std::left << allocations(l)
+                  << std::setw(12) << std::left << i.seconds
+                  << std::setw(10) << std::left << allocations(i)
+                  << std::setw(10) << std::left
+                  << l.seconds/std::max(i.seconds, 1.0e-9)
+                  << std::endl;
+    }
+
+}
+
 int main() {
 
     try {
 
-        // add your code here
+        Date todaysDate(15, May, 1998);
+        Settings::instance().evaluationDate() = todaysDate;
+        Date maturity(17, May, 1999);
+        DayCounter dayCounter = Actual365Fixed();
+
+        Handle<Quote> spot(boost::shared_ptr<Quote>(new SimpleQuote(36.0)));
+        Handle<YieldTermStructure> riskFree(
+            boost::shared_ptr<YieldTermStructure>(
+                new FlatForward(todaysDate, 0.06, dayCounter)));
+        Handle<YieldTermStructure> dividends(
+            boost::shared_ptr<YieldTermStructure>(
+                new FlatForward(todaysDate, 0.02, dayCounter)));
+        Handle<BlackVolTermStructure> volatility(
+            boost::shared_ptr<BlackVolTermStructure>(
+                new BlackConstantVol(todaysDate, TARGET(), 0.20,
+                                     dayCounter)));
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process(
+            new BlackScholesMertonProcess(spot, dividends, riskFree,
+                                          volatility));
+
+        VanillaOption option(
+            boost::shared_ptr<StrikedTypePayoff>(
+                new PlainVanillaPayoff(Option::Put, 40.0)),
+            boost::shared_ptr<Exercise>(
+                new AmericanExercise(todaysDate, maturity)));
+
+        #if !defined(QL_ENABLE_ENGINE_INSTRUMENTATION)
+        std::cout << "Heap allocations are only counted when "
+                  << "QL_ENABLE_ENGINE_INSTRUMENTATION is defined"
+                  << std::endl;
+        #endif
+        std::cout << std::setw(24) << std::left << "Method"
+                  << std::setw(8) << std::left << "Steps"
+                  << std::setw(14) << std::left << "Difference"
+                  << std::setw(12) << std::left << "Lattice"
+                  << std::setw(10) << std::left << "Allocs"
+                  << std::setw(12) << std::left << "In place"
+                  << std::setw(10) << std::left << "Allocs"
+                  << std::setw(10) << std::left << "Speedup"
+                  << std::endl;
+        Size steps[] = { 500, 1000, 5000 };
+        for (Size k=0; k<sizeof(steps)/sizeof(steps[0]); ++k) {
+            compare<CoxRossRubinstein>("Cox-Ross-Rubinstein",
+                                       process, option, steps[k]);
+            compare<Tian>("Tian", process, option, steps[k]);
+            compare<LeisenReimer>("Leisen-Reimer",
+                                  process, option, steps[k]+1);
+        }
 
         return 0;
 
@@ -22,4 +168,3 @@ int main() {
         return 1;
     }
 }
-